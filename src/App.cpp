@@ -1,13 +1,16 @@
 #include "App.h"
 #include "ancillary.h"
 #include "ConsoleCapture.h"
+#include "FrameScheduler.h"
 #include "FusedArchive.h"
+#include "Headless.h"
 #include "LuaHost.h"
 #include "misc.h"
 #include "Renderer.h"
 #include "Screen.h"
 #include "ScreenInfo.h"
 #include "ScreenLua.h"
+#include "TerminalPresenter.h"
 #include "Window.h"
 
 #include <iostream>
@@ -393,20 +396,20 @@ static void executeFusedScript(LuaHost& luaHost,
 
 App::~App()
 {
-    float dt = static_cast<float>(difftime(time(0), metrics.start_time));
+    float dt = static_cast<float>(difftime(::time(0), metrics.start_time));
 
     if (dt > 1.0f)
     {
-        char rps[16], dps[16], bups[16];
+        char rps[16], dps[16], bups[16], kbps[16];
 
         sprintf_s(rps, "%.1f", metrics.renders / dt);
         sprintf_s(dps, "%.1f", metrics.draws / dt);
         sprintf_s(bups, "%.1f", metrics.ssbo_updates / dt);
+        sprintf_s(kbps, "%.1f", metrics.ssbo_bytes / 1024.0 / dt);
         std::cout << "Metrics:\n Renders: " << rps << "/s\n Draws:   " << dps << "/s";
-        if (metrics.ssbo_updates == metrics.draws)
-            std::cout << std::endl;
-        else
-            std::cout << "\n SSBO Updates: " << bups << "/s\n";
+        if (metrics.ssbo_updates != metrics.draws)
+            std::cout << "\n SSBO Updates: " << bups << "/s";
+        std::cout << "\n SSBO Upload: " << kbps << " KB/s" << std::endl;
     }
 
     cout("Exiting.");
@@ -425,7 +428,15 @@ void App::setColor(float r, float g, float b, bool on)
 
 void App::run()
 {
-    metrics.start_time = time(0);
+    metrics.start_time = ::time(0);
+
+    const bool headless = Headless::options.enabled;
+    if (headless) Headless::init();
+    else
+    {
+        window.init();
+        renderer.init();
+    }
 
     // Bind error.log to EXE-dir (or initial CWD) BEFORE we possibly change CWD to the script dir.
     g_errorLogPath = fs::absolute(fs::current_path() / kErrorLogFile);
@@ -451,31 +462,38 @@ void App::run()
         ConsoleCapture::init();
         cout("Unable to resolve script!");
         logError(e.what());
+        if (headless) fatal(e.what()); // Nobody to show the error to
         info_screen.setError(e.what());
         window.show(&info_screen);
     }
 
     cout("Entering main loop...");
 
-    double t = glfwGetTime();
+    double t = time();
     float dt = 1.0f / window.refresh_rate_at_startup; // Provide reasonable initial dt
 
-    while (!window.shouldClose()) // Main loop
+    while (headless ? !Headless::finished() : !window.shouldClose()) // Main loop
     {
         update(dt);
 
         // We could simply draw every iteration but this is more efficient
-        if (screen && screen->redraw/* || metrics.buffer_swaps % window.refresh_rate_at_startup == 0*/)
+        if (screen && screen->needsDraw()/* || metrics.buffer_swaps % window.refresh_rate_at_startup == 0*/)
             screen->_draw();
 
-        if (Screen::render_frames)
-            renderer.render();
+        if (headless) Headless::endFrame(); // Nothing is presented
+        else if (FrameScheduler::shouldIdle())
+            window.waitEvents(FrameScheduler::IDLE_TIMEOUT); // Nothing can change until an event arrives
+        else
+        {
+            if (Screen::render_frames)
+                renderer.render();
 
-        window.swapBuffers();
-        window.pollEvents();
+            window.swapBuffers();
+            window.pollEvents();
+        }
 
         double pt = t;
-        dt = static_cast<float>((t = glfwGetTime()) - pt);
+        dt = static_cast<float>((t = time()) - pt);
     }
 
     shutdown();
@@ -486,8 +504,19 @@ void App::update(float dt)
     if (screen) screen->update(dt);
 }
 
+double App::time() const
+{
+    return Headless::options.enabled ? Headless::time() : glfwGetTime();
+}
+
+double App::realTime() const
+{
+    return Headless::options.enabled ? Headless::realTime() : glfwGetTime();
+}
+
 void App::cleanup()
 {
+    TerminalPresenter::restore();
     cout("Performing cleanup...");
 
     lua.shutdown();
@@ -514,6 +543,8 @@ void App::shutdown(int exit_code)
 
 void App::fatal(const char* error_msg)
 {
+    TerminalPresenter::restore(); // So the message can be seen
+
     std::string msg = "Fatal error!";
 
     std::string activeSection = lua.getActiveProfilerSection();
@@ -550,7 +581,7 @@ void App::fatal(const char* error_msg)
             // Keep rendering until user exits (Esc/Ctrl+X) or closes the window.
             while (!window.shouldClose())
             {
-                if (screen && screen->redraw)
+                if (screen && screen->needsDraw())
                     screen->_draw();
 
                 if (Screen::render_frames)
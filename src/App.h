@@ -23,6 +23,7 @@ public:
         int renders;
         int draws;
         int ssbo_updates;
+        long long ssbo_bytes; // Canvas bytes uploaded to the GPU
         int buffer_swaps;
     }metrics = {};
 
@@ -35,6 +36,9 @@ public:
     void run();
     void update(float dt); // Gets called every frame
 
+    double time() const; // Seconds since startup (the virtual clock in headless mode)
+    double realTime() const; // Seconds since startup on the wall clock (for profiling)
+
     void shutdown(int exit_code = 0);
     void fatal(const char* error_msg = nullptr);
 
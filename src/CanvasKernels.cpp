@@ -0,0 +1,447 @@
+#include "CanvasKernels.h"
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define LIME_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define LIME_TARGET_SSE2
+#define LIME_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define LIME_TARGET_SSE2 __attribute__((target("sse2")))
+#define LIME_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+using Op = CanvasKernels::Op;
+
+static inline unsigned char combineByte(unsigned char d, unsigned char s, Op op)
+{
+    switch (op)
+    {
+    case Op::Copy: return s;
+    case Op::Or: return d | s;
+    case Op::And: return d & s;
+    case Op::Xor: return d ^ s;
+    default: return d & (unsigned char)~s;
+    }
+}
+
+// ============================================================================
+// Scalar (64-bit words)
+// ============================================================================
+
+static inline uint64_t load64(const unsigned char* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+static inline void store64(unsigned char* p, uint64_t v) { memcpy(p, &v, 8); }
+
+static void fill_scalar(unsigned char* d, size_t n, unsigned char value)
+{
+    memset(d, value, n);
+}
+
+static void invert_scalar(unsigned char* d, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) store64(d + i, ~load64(d + i));
+    for (; i < n; i++) d[i] = (unsigned char)~d[i];
+}
+
+static void combine_scalar(unsigned char* d, const unsigned char* s, size_t n, Op op)
+{
+    size_t i = 0;
+    switch (op)
+    {
+    case Op::Copy: memcpy(d, s, n); return;
+    case Op::Or:     for (; i + 8 <= n; i += 8) store64(d + i, load64(d + i) | load64(s + i)); break;
+    case Op::And:    for (; i + 8 <= n; i += 8) store64(d + i, load64(d + i) & load64(s + i)); break;
+    case Op::Xor:    for (; i + 8 <= n; i += 8) store64(d + i, load64(d + i) ^ load64(s + i)); break;
+    case Op::AndNot: for (; i + 8 <= n; i += 8) store64(d + i, load64(d + i) & ~load64(s + i)); break;
+    }
+    for (; i < n; i++) d[i] = combineByte(d[i], s[i], op);
+}
+
+static void select_scalar(unsigned char* d, const unsigned char* s, const unsigned char* m, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        uint64_t mv = load64(m + i);
+        store64(d + i, (load64(d + i) & ~mv) | (load64(s + i) & mv));
+    }
+    for (; i < n; i++) d[i] = (unsigned char)((d[i] & ~m[i]) | (s[i] & m[i]));
+}
+
+static size_t popcount_scalar(const unsigned char* s, size_t n)
+{
+    size_t count = 0, i = 0;
+    for (; i + 8 <= n; i += 8) count += std::popcount(load64(s + i));
+    for (; i < n; i++) count += std::popcount((unsigned)s[i]);
+    return count;
+}
+
+static void expand_scalar(uint32_t* d, const unsigned char* s, size_t n, int scale, const uint32_t (*lut)[8])
+{
+    if (scale == 1)
+    {
+        for (size_t i = 0; i < n; i++, d += 8) memcpy(d, lut[s[i]], 32);
+        return;
+    }
+    for (size_t i = 0; i < n; i++)
+        for (int k = 0; k < 8; k++)
+            for (int r = 0; r < scale; r++) *d++ = lut[s[i]][k];
+}
+
+#ifdef LIME_X86
+
+// ============================================================================
+// SSE2 (128-bit vectors)
+// ============================================================================
+
+LIME_TARGET_SSE2 static void fill_sse2(unsigned char* d, size_t n, unsigned char value)
+{
+    const __m128i v = _mm_set1_epi8((char)value);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) _mm_storeu_si128((__m128i*)(d + i), v);
+    for (; i < n; i++) d[i] = value;
+}
+
+LIME_TARGET_SSE2 static void invert_sse2(unsigned char* d, size_t n)
+{
+    const __m128i ones = _mm_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        _mm_storeu_si128((__m128i*)(d + i), _mm_xor_si128(_mm_loadu_si128((const __m128i*)(d + i)), ones));
+    for (; i < n; i++) d[i] = (unsigned char)~d[i];
+}
+
+LIME_TARGET_SSE2 static void combine_sse2(unsigned char* d, const unsigned char* s, size_t n, Op op)
+{
+#define LD(p) _mm_loadu_si128((const __m128i*)(p))
+#define ST(p, v) _mm_storeu_si128((__m128i*)(p), v)
+    size_t i = 0;
+    switch (op)
+    {
+    case Op::Copy:   for (; i + 16 <= n; i += 16) ST(d + i, LD(s + i)); break;
+    case Op::Or:     for (; i + 16 <= n; i += 16) ST(d + i, _mm_or_si128(LD(d + i), LD(s + i))); break;
+    case Op::And:    for (; i + 16 <= n; i += 16) ST(d + i, _mm_and_si128(LD(d + i), LD(s + i))); break;
+    case Op::Xor:    for (; i + 16 <= n; i += 16) ST(d + i, _mm_xor_si128(LD(d + i), LD(s + i))); break;
+    case Op::AndNot: for (; i + 16 <= n; i += 16) ST(d + i, _mm_andnot_si128(LD(s + i), LD(d + i))); break;
+    }
+#undef LD
+#undef ST
+    for (; i < n; i++) d[i] = combineByte(d[i], s[i], op);
+}
+
+LIME_TARGET_SSE2 static void select_sse2(unsigned char* d, const unsigned char* s, const unsigned char* m, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i mv = _mm_loadu_si128((const __m128i*)(m + i));
+        __m128i kept = _mm_andnot_si128(mv, _mm_loadu_si128((const __m128i*)(d + i)));
+        __m128i taken = _mm_and_si128(mv, _mm_loadu_si128((const __m128i*)(s + i)));
+        _mm_storeu_si128((__m128i*)(d + i), _mm_or_si128(kept, taken));
+    }
+    for (; i < n; i++) d[i] = (unsigned char)((d[i] & ~m[i]) | (s[i] & m[i]));
+}
+
+// SWAR bit count per byte, then horizontal byte sums with psadbw
+LIME_TARGET_SSE2 static size_t popcount_sse2(const unsigned char* s, size_t n)
+{
+    const __m128i m1 = _mm_set1_epi8(0x55);
+    const __m128i m2 = _mm_set1_epi8(0x33);
+    const __m128i m4 = _mm_set1_epi8(0x0F);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+        v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi16(v, 1), m1));
+        v = _mm_add_epi8(_mm_and_si128(v, m2), _mm_and_si128(_mm_srli_epi16(v, 2), m2));
+        v = _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi16(v, 4)), m4);
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    size_t count = (size_t)(lanes[0] + lanes[1]);
+    for (; i < n; i++) count += std::popcount((unsigned)s[i]);
+    return count;
+}
+
+// Writes scale (3 or more) copies of the pixel in every lane of v; the last store may overlap the one before
+LIME_TARGET_SSE2 static inline void spread_sse2(uint32_t* d, __m128i v, int scale)
+{
+    if (scale == 3)
+    {
+        d[0] = d[1] = d[2] = (uint32_t)_mm_cvtsi128_si32(v);
+        return;
+    }
+    int j = 0;
+    for (; j + 4 <= scale; j += 4) _mm_storeu_si128((__m128i*)(d + j), v);
+    if (j < scale) _mm_storeu_si128((__m128i*)(d + scale - 4), v);
+}
+
+// Whole lookup table rows are widened with unpacks for scale 2
+LIME_TARGET_SSE2 static void expand_sse2(uint32_t* d, const unsigned char* s, size_t n, int scale, const uint32_t (*lut)[8])
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        const uint32_t* p = lut[s[i]];
+        if (scale <= 2)
+        {
+            const __m128i lo = _mm_loadu_si128((const __m128i*)p), hi = _mm_loadu_si128((const __m128i*)(p + 4));
+            if (scale == 1)
+            {
+                _mm_storeu_si128((__m128i*)d, lo);
+                _mm_storeu_si128((__m128i*)(d + 4), hi);
+                d += 8;
+                continue;
+            }
+            _mm_storeu_si128((__m128i*)d, _mm_unpacklo_epi32(lo, lo));
+            _mm_storeu_si128((__m128i*)(d + 4), _mm_unpackhi_epi32(lo, lo));
+            _mm_storeu_si128((__m128i*)(d + 8), _mm_unpacklo_epi32(hi, hi));
+            _mm_storeu_si128((__m128i*)(d + 12), _mm_unpackhi_epi32(hi, hi));
+            d += 16;
+            continue;
+        }
+        for (int k = 0; k < 8; k++, d += scale) spread_sse2(d, _mm_set1_epi32((int)p[k]), scale);
+    }
+}
+
+// ============================================================================
+// AVX2 (256-bit vectors)
+// ============================================================================
+
+LIME_TARGET_AVX2 static void fill_avx2(unsigned char* d, size_t n, unsigned char value)
+{
+    const __m256i v = _mm256_set1_epi8((char)value);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) _mm256_storeu_si256((__m256i*)(d + i), v);
+    for (; i < n; i++) d[i] = value;
+}
+
+LIME_TARGET_AVX2 static void invert_avx2(unsigned char* d, size_t n)
+{
+    const __m256i ones = _mm256_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+        _mm256_storeu_si256((__m256i*)(d + i), _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(d + i)), ones));
+    for (; i < n; i++) d[i] = (unsigned char)~d[i];
+}
+
+LIME_TARGET_AVX2 static void combine_avx2(unsigned char* d, const unsigned char* s, size_t n, Op op)
+{
+#define LD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define ST(p, v) _mm256_storeu_si256((__m256i*)(p), v)
+    size_t i = 0;
+    switch (op)
+    {
+    case Op::Copy:   for (; i + 32 <= n; i += 32) ST(d + i, LD(s + i)); break;
+    case Op::Or:     for (; i + 32 <= n; i += 32) ST(d + i, _mm256_or_si256(LD(d + i), LD(s + i))); break;
+    case Op::And:    for (; i + 32 <= n; i += 32) ST(d + i, _mm256_and_si256(LD(d + i), LD(s + i))); break;
+    case Op::Xor:    for (; i + 32 <= n; i += 32) ST(d + i, _mm256_xor_si256(LD(d + i), LD(s + i))); break;
+    case Op::AndNot: for (; i + 32 <= n; i += 32) ST(d + i, _mm256_andnot_si256(LD(s + i), LD(d + i))); break;
+    }
+#undef LD
+#undef ST
+    for (; i < n; i++) d[i] = combineByte(d[i], s[i], op);
+}
+
+LIME_TARGET_AVX2 static void select_avx2(unsigned char* d, const unsigned char* s, const unsigned char* m, size_t n)
+{
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i mv = _mm256_loadu_si256((const __m256i*)(m + i));
+        __m256i kept = _mm256_andnot_si256(mv, _mm256_loadu_si256((const __m256i*)(d + i)));
+        __m256i taken = _mm256_and_si256(mv, _mm256_loadu_si256((const __m256i*)(s + i)));
+        _mm256_storeu_si256((__m256i*)(d + i), _mm256_or_si256(kept, taken));
+    }
+    for (; i < n; i++) d[i] = (unsigned char)((d[i] & ~m[i]) | (s[i] & m[i]));
+}
+
+// Nibble lookup with vpshufb, then horizontal byte sums with vpsadbw
+LIME_TARGET_AVX2 static size_t popcount_avx2(const unsigned char* s, size_t n)
+{
+    const __m256i lut = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low4 = _mm256_set1_epi8(0x0F);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc = zero;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+        __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, low4));
+        __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low4));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), zero));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    size_t count = (size_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+    for (; i < n; i++) count += std::popcount((unsigned)s[i]);
+    return count;
+}
+
+// Lookup table rows are widened with cross-lane permutes for scales 2 and 4
+LIME_TARGET_AVX2 static void expand_avx2(uint32_t* d, const unsigned char* s, size_t n, int scale, const uint32_t (*lut)[8])
+{
+    const __m256i x2_lo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3), x2_hi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+    for (size_t i = 0; i < n; i++)
+    {
+        const uint32_t* p = lut[s[i]];
+        const __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        if (scale == 1)
+        {
+            _mm256_storeu_si256((__m256i*)d, v);
+            d += 8;
+        }
+        else if (scale == 2)
+        {
+            _mm256_storeu_si256((__m256i*)d, _mm256_permutevar8x32_epi32(v, x2_lo));
+            _mm256_storeu_si256((__m256i*)(d + 8), _mm256_permutevar8x32_epi32(v, x2_hi));
+            d += 16;
+        }
+        else if (scale == 4)
+        {
+            for (int k = 0; k < 8; k += 2, d += 8)
+                _mm256_storeu_si256((__m256i*)d, _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(k, k, k, k, k + 1, k + 1, k + 1, k + 1)));
+        }
+        else if (scale >= 8)
+        {
+            for (int k = 0; k < 8; k++, d += scale)
+            {
+                const __m256i c = _mm256_set1_epi32((int)p[k]);
+                int j = 0;
+                for (; j + 8 <= scale; j += 8) _mm256_storeu_si256((__m256i*)(d + j), c);
+                if (j < scale) _mm256_storeu_si256((__m256i*)(d + scale - 8), c);
+            }
+        }
+        else
+        {
+            for (int k = 0; k < 8; k++, d += scale) spread_sse2(d, _mm_set1_epi32((int)p[k]), scale);
+        }
+    }
+}
+
+// ============================================================================
+// CPU feature detection
+// ============================================================================
+
+static void cpuid(int leaf, int subleaf, unsigned regs[4])
+{
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuidex(r, leaf, subleaf);
+    for (int i = 0; i < 4; i++) regs[i] = (unsigned)r[i];
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static bool cpuHasSse2()
+{
+    unsigned r[4];
+    cpuid(1, 0, r);
+    return (r[3] & (1u << 26)) != 0;
+}
+
+static bool cpuHasAvx2()
+{
+    unsigned r[4];
+    cpuid(0, 0, r);
+    if (r[0] < 7) return false;
+
+    // AVX state must be enabled by the OS (OSXSAVE set and XCR0 saving XMM and YMM registers)
+    cpuid(1, 0, r);
+    if (!(r[2] & (1u << 27)) || !(r[2] & (1u << 28))) return false;
+#if defined(_MSC_VER)
+    unsigned long long xcr0 = _xgetbv(0);
+#else
+    unsigned lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    unsigned long long xcr0 = ((unsigned long long)hi << 32) | lo;
+#endif
+    if ((xcr0 & 6) != 6) return false;
+
+    cpuid(7, 0, r);
+    return (r[1] & (1u << 5)) != 0;
+}
+
+#endif // LIME_X86
+
+// ============================================================================
+// Dispatch
+// ============================================================================
+
+static struct Impl
+{
+    const char* name;
+    void (*fill)(unsigned char*, size_t, unsigned char);
+    void (*invert)(unsigned char*, size_t);
+    void (*combine)(unsigned char*, const unsigned char*, size_t, Op);
+    void (*select)(unsigned char*, const unsigned char*, const unsigned char*, size_t);
+    size_t (*popcount)(const unsigned char*, size_t);
+    void (*expand)(uint32_t*, const unsigned char*, size_t, int, const uint32_t (*)[8]);
+}impl = { "Scalar", fill_scalar, invert_scalar, combine_scalar, select_scalar, popcount_scalar, expand_scalar };
+
+void CanvasKernels::init()
+{
+    impl = { "Scalar", fill_scalar, invert_scalar, combine_scalar, select_scalar, popcount_scalar, expand_scalar };
+
+#ifdef LIME_X86
+    if (cpuHasAvx2())
+        impl = { "AVX2", fill_avx2, invert_avx2, combine_avx2, select_avx2, popcount_avx2, expand_avx2 };
+    else if (cpuHasSse2())
+        impl = { "SSE2", fill_sse2, invert_sse2, combine_sse2, select_sse2, popcount_sse2, expand_sse2 };
+#endif
+}
+
+const char* CanvasKernels::isaName() { return impl.name; }
+
+void CanvasKernels::fill(unsigned char* dst, size_t n, unsigned char value) { impl.fill(dst, n, value); }
+void CanvasKernels::invert(unsigned char* dst, size_t n) { impl.invert(dst, n); }
+void CanvasKernels::copy(unsigned char* dst, const unsigned char* src, size_t n) { impl.combine(dst, src, n, Op::Copy); }
+void CanvasKernels::combine(unsigned char* dst, const unsigned char* src, size_t n, Op op) { impl.combine(dst, src, n, op); }
+void CanvasKernels::select(unsigned char* dst, const unsigned char* src, const unsigned char* mask, size_t n) { impl.select(dst, src, mask, n); }
+size_t CanvasKernels::popcount(const unsigned char* src, size_t n) { return impl.popcount(src, n); }
+void CanvasKernels::expand(uint32_t* dst, const unsigned char* src, size_t n, int scale, const uint32_t (*lut)[8]) { impl.expand(dst, src, n, scale, lut); }
+
+// Rectangles whose rows are contiguous collapse into a single range
+void CanvasKernels::fillRect(unsigned char* dst, int dst_stride, int row_bytes, int rows, unsigned char value)
+{
+    if (row_bytes <= 0 || rows <= 0) return;
+    if (row_bytes == dst_stride) { impl.fill(dst, (size_t)row_bytes * rows, value); return; }
+    for (int r = 0; r < rows; r++, dst += dst_stride) impl.fill(dst, row_bytes, value);
+}
+
+void CanvasKernels::invertRect(unsigned char* dst, int dst_stride, int row_bytes, int rows)
+{
+    if (row_bytes <= 0 || rows <= 0) return;
+    if (row_bytes == dst_stride) { impl.invert(dst, (size_t)row_bytes * rows); return; }
+    for (int r = 0; r < rows; r++, dst += dst_stride) impl.invert(dst, row_bytes);
+}
+
+void CanvasKernels::combineRect(unsigned char* dst, int dst_stride, const unsigned char* src, int src_stride,
+    int row_bytes, int rows, Op op)
+{
+    if (row_bytes <= 0 || rows <= 0) return;
+    if (row_bytes == dst_stride && row_bytes == src_stride) { impl.combine(dst, src, (size_t)row_bytes * rows, op); return; }
+    for (int r = 0; r < rows; r++, dst += dst_stride, src += src_stride) impl.combine(dst, src, row_bytes, op);
+}
+
+size_t CanvasKernels::popcountRect(const unsigned char* src, int src_stride, int row_bytes, int rows)
+{
+    if (row_bytes <= 0 || rows <= 0) return 0;
+    if (row_bytes == src_stride) return impl.popcount(src, (size_t)row_bytes * rows);
+    size_t count = 0;
+    for (int r = 0; r < rows; r++, src += src_stride) count += impl.popcount(src, row_bytes);
+    return count;
+}
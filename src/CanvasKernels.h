@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Bulk operations over packed 1bpp pixel data (byte ranges and byte-column rectangles)
+// Each operation has scalar, SSE2 and AVX2 implementations; the fastest one supported by
+// the CPU is selected once by init() (called from Screen::_init)
+namespace CanvasKernels
+{
+    enum class Op
+    {
+        Copy,   // dst = src
+        Or,     // dst |= src
+        And,    // dst &= src
+        Xor,    // dst ^= src
+        AndNot  // dst &= ~src
+    };
+
+    void init(); // Detects CPU features and selects implementations
+    const char* isaName(); // "AVX2", "SSE2" or "Scalar"
+
+    /* Byte ranges */
+    void fill(unsigned char* dst, size_t n, unsigned char value);
+    void invert(unsigned char* dst, size_t n);
+    void copy(unsigned char* dst, const unsigned char* src, size_t n); // Ranges must not overlap
+    void combine(unsigned char* dst, const unsigned char* src, size_t n, Op op);
+    void select(unsigned char* dst, const unsigned char* src, const unsigned char* mask, size_t n); // dst = (dst & ~mask) | (src & mask)
+    size_t popcount(const unsigned char* src, size_t n); // Number of set bits (pixels on)
+
+    /* Rectangles of row_bytes x rows within buffers of the given row strides (in bytes) */
+    void fillRect(unsigned char* dst, int dst_stride, int row_bytes, int rows, unsigned char value);
+    void invertRect(unsigned char* dst, int dst_stride, int row_bytes, int rows);
+    void combineRect(unsigned char* dst, int dst_stride, const unsigned char* src, int src_stride,
+        int row_bytes, int rows, Op op);
+    size_t popcountRect(const unsigned char* src, int src_stride, int row_bytes, int rows);
+
+    /* Presentation */
+    // Expands n bytes of 1bpp pixels to 32-bit pixels, each repeated scale times (n * 8 * scale pixels);
+    // lut[b] holds the 8 pixels of byte value b
+    void expand(uint32_t* dst, const unsigned char* src, size_t n, int scale, const uint32_t (*lut)[8]);
+}
@@ -0,0 +1,116 @@
+#include "CanvasSnapshots.h"
+#include "misc.h"
+
+#include <cstring>
+#include <unordered_set>
+
+// Bytes per row and rows of tile tx,ty of a canvas
+static inline void tileSize(int width, int height, int tx, int ty, int& row_bytes, int& rows)
+{
+    const int TW = CanvasSnapshots::TILE_WIDTH / 8, TH = CanvasSnapshots::TILE_HEIGHT;
+    row_bytes = min(TW, width / 8 - tx * TW);
+    rows = min(TH, height - ty * TH);
+}
+
+int CanvasSnapshots::take(const std::string& canvas, const unsigned char* pixels, int width, int height)
+{
+    const int stride = width / 8, TW = TILE_WIDTH / 8;
+    const int tiles_x = (width + TILE_WIDTH - 1) / TILE_WIDTH, tiles_y = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+
+    // Tiles are shared with the latest snapshot of the same canvas
+    const Snapshot* prev = nullptr;
+    for (auto it = snapshots.rbegin(); it != snapshots.rend() && !prev; ++it)
+        if (it->second.canvas == canvas && it->second.width == width && it->second.height == height) prev = &it->second;
+
+    Snapshot snap;
+    snap.canvas = canvas;
+    snap.width = width;
+    snap.height = height;
+    snap.tiles.resize((size_t)tiles_x * tiles_y);
+
+    Tile blank;
+    for (int ty = 0; ty < tiles_y; ty++)
+    {
+        for (int tx = 0; tx < tiles_x; tx++)
+        {
+            int row_bytes, rows;
+            tileSize(width, height, tx, ty, row_bytes, rows);
+            const unsigned char* src = pixels + (size_t)ty * TILE_HEIGHT * stride + tx * TW;
+            const size_t i = (size_t)ty * tiles_x + tx;
+
+            bool same = prev != nullptr, zero = true;
+            for (int r = 0; r < rows; r++)
+            {
+                const unsigned char* row = src + (size_t)r * stride;
+                if (same) same = memcmp(row, prev->tiles[i]->data() + r * row_bytes, row_bytes) == 0;
+                for (int b = 0; b < row_bytes && zero; b++) zero = row[b] == 0;
+            }
+
+            if (same)
+                snap.tiles[i] = prev->tiles[i];
+            else if (zero && blank && (int)blank->size() == row_bytes * rows)
+                snap.tiles[i] = blank;
+            else
+            {
+                auto tile = std::make_shared<std::vector<unsigned char>>((size_t)row_bytes * rows);
+                for (int r = 0; r < rows; r++) memcpy(tile->data() + r * row_bytes, src + (size_t)r * stride, row_bytes);
+                snap.tiles[i] = tile;
+                if (zero) blank = tile;
+            }
+        }
+    }
+
+    snapshots[next_id] = std::move(snap);
+    return next_id++;
+}
+
+const CanvasSnapshots::Snapshot* CanvasSnapshots::find(int id) const
+{
+    auto it = snapshots.find(id);
+    return it == snapshots.end() ? nullptr : &it->second;
+}
+
+int CanvasSnapshots::restore(int id, unsigned char* pixels, int& y1, int& y2) const
+{
+    const Snapshot* snap = find(id);
+    if (!snap) return 0;
+
+    const int stride = snap->width / 8, TW = TILE_WIDTH / 8;
+    const int tiles_x = (snap->width + TILE_WIDTH - 1) / TILE_WIDTH, tiles_y = (snap->height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+
+    int changed = 0;
+    for (int ty = 0; ty < tiles_y; ty++)
+    {
+        for (int tx = 0; tx < tiles_x; tx++)
+        {
+            int row_bytes, rows;
+            tileSize(snap->width, snap->height, tx, ty, row_bytes, rows);
+            unsigned char* dst = pixels + (size_t)ty * TILE_HEIGHT * stride + tx * TW;
+            const unsigned char* src = snap->tiles[(size_t)ty * tiles_x + tx]->data();
+
+            bool same = true;
+            for (int r = 0; r < rows && same; r++) same = memcmp(dst + (size_t)r * stride, src + r * row_bytes, row_bytes) == 0;
+            if (same) continue;
+
+            for (int r = 0; r < rows; r++) memcpy(dst + (size_t)r * stride, src + r * row_bytes, row_bytes);
+            if (changed++ == 0) y1 = ty * TILE_HEIGHT;
+            y2 = ty * TILE_HEIGHT + rows - 1;
+        }
+    }
+    return changed;
+}
+
+void CanvasSnapshots::discard(int id)
+{
+    snapshots.erase(id);
+}
+
+size_t CanvasSnapshots::memory() const
+{
+    std::unordered_set<const std::vector<unsigned char>*> seen;
+    size_t bytes = 0;
+    for (const auto& [id, snap] : snapshots)
+        for (const Tile& tile : snap.tiles)
+            if (seen.insert(tile.get()).second) bytes += tile->size();
+    return bytes;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Snapshots of packed 1bpp canvases for undo/redo. A snapshot splits its canvas into tiles; tiles are
+// immutable and refcounted, and a new snapshot shares every tile that is unchanged since the previous
+// snapshot of the same canvas (blank tiles are shared too), so each step only costs the tiles that changed.
+class CanvasSnapshots
+{
+public:
+    static constexpr int TILE_WIDTH = 64, TILE_HEIGHT = 32; // Pixels (tiles on the right and bottom edges may be smaller)
+
+    using Tile = std::shared_ptr<const std::vector<unsigned char>>;
+
+    struct Snapshot
+    {
+        std::string canvas; // Name of the image it was taken from ("" for the main canvas)
+        int width = 0, height = 0;
+        std::vector<Tile> tiles; // Row-major; each holds its rows back to back
+    };
+
+    int take(const std::string& canvas, const unsigned char* pixels, int width, int height); // Returns the snapshot id (from 1)
+    const Snapshot* find(int id) const; // nullptr if unknown or discarded
+    int restore(int id, unsigned char* pixels, int& y1, int& y2) const; // Copy the changed tiles back; returns how many, with the rows they span
+    void discard(int id);
+    void clear() { snapshots.clear(); }
+
+    size_t count() const { return snapshots.size(); }
+    size_t memory() const; // Bytes held by distinct tiles
+
+private:
+    std::map<int, Snapshot> snapshots;
+    int next_id = 1;
+};
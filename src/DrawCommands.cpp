@@ -0,0 +1,416 @@
+#include "DrawCommands.h"
+
+#include "App.h"
+#include "Image.h"
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "misc.h"
+
+enum class Op : unsigned char { Clear, Point, Points, Line, Lines, Polyline, Rect, Ellipse, Polygon, Blit };
+
+struct Command
+{
+    Op op;
+    bool on, solid;
+    unsigned char mode; // LineCap, FillRule or CanvasKernels::Op
+    unsigned char join;
+    int state; // Index into states
+    int top, bottom; // Rows the command can touch (within its clip rect)
+    int v[6]; // Coordinates, or the offset and count of a list in coords
+    int width;
+    const Image* image;
+    const Image* mask;
+};
+
+// The clip rect and fill pattern a command was recorded under
+struct State
+{
+    Screen::ClipRect clip;
+    unsigned char pattern[8];
+    Screen::PatternAnchor anchor;
+};
+
+static std::vector<Command> commands;
+static std::vector<State> states;
+static std::vector<int> coords; // Point lists of Points, Lines, Polyline and Polygon commands
+static long long work = 0; // Rows covered by the commands, summed (decides whether to replay in parallel)
+static bool in_scope = false;
+
+static constexpr long long PARALLEL_WORK = 2048; // Smaller batches are replayed on the calling thread
+static constexpr int MAX_BANDS = 16;
+static constexpr int MIN_BAND_ROWS = 16;
+
+DrawCommands::Scope::Scope()
+{
+    in_scope = true;
+}
+
+DrawCommands::Scope::~Scope()
+{
+    flush();
+    in_scope = false;
+}
+
+bool DrawCommands::recording()
+{
+    return enabled && in_scope && !Screen::offscreen && screen;
+}
+
+void DrawCommands::reset()
+{
+    enabled = false;
+    commands.clear();
+    states.clear();
+    coords.clear();
+    work = 0;
+}
+
+// ============================================================================
+// Recording
+// ============================================================================
+
+static bool sameState(const State& s)
+{
+    const Screen::ClipRect& c = Screen::clip;
+    return s.clip.x1 == c.x1 && s.clip.y1 == c.y1 && s.clip.x2 == c.x2 && s.clip.y2 == c.y2
+        && s.anchor == Screen::pattern_anchor && !memcmp(s.pattern, Screen::pattern, 8);
+}
+
+// Appends a command touching rows top..bottom, or returns nullptr if the clip rect hides it
+static Command* add(Op op, long long top, long long bottom)
+{
+    const Screen::ClipRect& c = Screen::clip;
+    top = max(top, (long long)c.y1);
+    bottom = min(bottom, (long long)c.y2);
+    if (top > bottom || c.x1 > c.x2) return nullptr;
+
+    if (states.empty() || !sameState(states.back()))
+    {
+        State s;
+        s.clip = c;
+        memcpy(s.pattern, Screen::pattern, 8);
+        s.anchor = Screen::pattern_anchor;
+        states.push_back(s);
+    }
+
+    Command& cmd = commands.emplace_back();
+    cmd.op = op;
+    cmd.state = (int)states.size() - 1;
+    cmd.top = (int)top;
+    cmd.bottom = (int)bottom;
+    work += bottom - top + 1;
+    return &cmd;
+}
+
+// Rows spanned by n points as x,y pairs, widened by margin
+static void pointRows(const int* xy, int n, long long margin, long long& top, long long& bottom)
+{
+    top = xy[1];
+    bottom = xy[1];
+    for (int i = 1; i < n; i++)
+    {
+        top = min(top, (long long)xy[i * 2 + 1]);
+        bottom = max(bottom, (long long)xy[i * 2 + 1]);
+    }
+    top -= margin;
+    bottom += margin;
+}
+
+// How far a thick line's caps, joins and rounding can reach beyond its points (the longest miter is 2 widths)
+static long long lineMargin(int width)
+{
+    return width > 1 ? 2LL * width + 2 : 0;
+}
+
+static void addList(Command& cmd, const int* xy, int count)
+{
+    cmd.v[0] = (int)coords.size();
+    cmd.v[1] = count;
+    coords.insert(coords.end(), xy, xy + count);
+}
+
+void DrawCommands::clear(bool inverted)
+{
+    // Not limited by the clip rect, and the rows are the whole Canvas however it is split
+    Command& cmd = commands.emplace_back();
+    cmd.op = Op::Clear;
+    cmd.on = inverted;
+    cmd.state = -1;
+    cmd.top = 0;
+    cmd.bottom = Screen::height - 1;
+    work += Screen::height;
+}
+
+void DrawCommands::pset(int x, int y, bool on)
+{
+    if (!Screen::inClip(x, y)) return;
+    Command* cmd = add(Op::Point, y, y);
+    cmd->on = on;
+    cmd->v[0] = x;
+    cmd->v[1] = y;
+}
+
+void DrawCommands::psets(const int* xy, int n, bool on)
+{
+    if (n <= 0) return;
+    long long top, bottom;
+    pointRows(xy, n, 0, top, bottom);
+    Command* cmd = add(Op::Points, top, bottom);
+    if (!cmd) return;
+    cmd->on = on;
+    addList(*cmd, xy, n * 2);
+}
+
+void DrawCommands::lset(int x1, int y1, int x2, int y2, bool on, int width, Screen::LineCap cap)
+{
+    long long margin = lineMargin(width);
+    Command* cmd = add(Op::Line, (long long)min(y1, y2) - margin, (long long)max(y1, y2) + margin);
+    if (!cmd) return;
+    cmd->on = on;
+    cmd->mode = (unsigned char)cap;
+    cmd->width = width;
+    cmd->v[0] = x1; cmd->v[1] = y1;
+    cmd->v[2] = x2; cmd->v[3] = y2;
+}
+
+void DrawCommands::lsets(const int* xy, int n, bool on, int width, Screen::LineCap cap)
+{
+    if (n <= 0) return;
+    long long top, bottom;
+    pointRows(xy, n * 2, lineMargin(width), top, bottom);
+    Command* cmd = add(Op::Lines, top, bottom);
+    if (!cmd) return;
+    cmd->on = on;
+    cmd->mode = (unsigned char)cap;
+    cmd->width = width;
+    addList(*cmd, xy, n * 4);
+}
+
+void DrawCommands::lsetsc(const int* xy, int n, bool on, int width, Screen::LineJoin join, Screen::LineCap cap)
+{
+    if (n <= 0) return;
+    long long top, bottom;
+    pointRows(xy, n, lineMargin(width), top, bottom);
+    Command* cmd = add(Op::Polyline, top, bottom);
+    if (!cmd) return;
+    cmd->on = on;
+    cmd->mode = (unsigned char)cap;
+    cmd->join = (unsigned char)join;
+    cmd->width = width;
+    addList(*cmd, xy, n * 2);
+}
+
+void DrawCommands::rset(int x, int y, int w, int h, bool solid, bool on)
+{
+    long long top = h < 0 ? (long long)y + h : y;
+    Command* cmd = add(Op::Rect, top, top + (h < 0 ? -(long long)h : h) - 1);
+    if (!cmd) return;
+    cmd->on = on;
+    cmd->solid = solid;
+    cmd->v[0] = x; cmd->v[1] = y;
+    cmd->v[2] = w; cmd->v[3] = h;
+}
+
+void DrawCommands::eset(int x, int y, int w, int h, bool solid, bool on)
+{
+    long long top = h < 0 ? (long long)y + h : y;
+    Command* cmd = add(Op::Ellipse, top, top + (h < 0 ? -(long long)h : h) - 1);
+    if (!cmd) return;
+    cmd->on = on;
+    cmd->solid = solid;
+    cmd->v[0] = x; cmd->v[1] = y;
+    cmd->v[2] = w; cmd->v[3] = h;
+}
+
+void DrawCommands::polyset(const int* xy, int n, bool solid, bool on, Screen::FillRule rule)
+{
+    if (n <= 0) return;
+    long long top, bottom;
+    pointRows(xy, n, 0, top, bottom);
+    Command* cmd = add(Op::Polygon, top, bottom);
+    if (!cmd) return;
+    cmd->on = on;
+    cmd->solid = solid;
+    cmd->mode = (unsigned char)rule;
+    addList(*cmd, xy, n * 2);
+}
+
+void DrawCommands::blit(const Image* image, int x, int y, CanvasKernels::Op op, const Image* mask)
+{
+    Command* cmd = add(Op::Blit, y, (long long)y + image->height - 1);
+    if (!cmd) return;
+    cmd->mode = (unsigned char)op;
+    cmd->v[0] = x; cmd->v[1] = y;
+    cmd->image = image;
+    cmd->mask = mask;
+}
+
+// ============================================================================
+// Replay
+// ============================================================================
+
+static void run(Screen* s, const Command& c, int y1, int y2)
+{
+    const int* list = coords.data() + c.v[0];
+    const Screen::LineCap cap = (Screen::LineCap)c.mode;
+
+    switch (c.op)
+    {
+    case Op::Clear:
+    {
+        size_t stride = Screen::width / 8;
+        Screen::markDirty(y1, y2);
+        CanvasKernels::fill(Screen::pixels + y1 * stride, (y2 - y1 + 1) * stride, c.on ? 0xFF : 0);
+        break;
+    }
+    case Op::Point:
+        if (!Screen::inClip(c.v[0], c.v[1])) break;
+        if (c.on) ponUnsafe(c.v[0], c.v[1]);
+        else poffUnsafe(c.v[0], c.v[1]);
+        break;
+    case Op::Points:
+        for (int i = 0; i < c.v[1]; i += 2)
+        {
+            int x = list[i], y = list[i + 1];
+            if (!Screen::inClip(x, y)) continue;
+            if (c.on) ponUnsafe(x, y);
+            else poffUnsafe(x, y);
+        }
+        break;
+    case Op::Line: s->lset(c.v[0], c.v[1], c.v[2], c.v[3], c.on, c.width, cap); break;
+    case Op::Lines: s->lsets(list, c.v[1] / 4, c.on, c.width, cap); break;
+    case Op::Polyline: s->lsetsc(list, c.v[1] / 2, c.on, c.width, (Screen::LineJoin)c.join, cap); break;
+    case Op::Rect: s->rset(c.v[0], c.v[1], c.v[2], c.v[3], c.solid, c.on); break;
+    case Op::Ellipse: s->eset(c.v[0], c.v[1], c.v[2], c.v[3], c.solid, c.on); break;
+    case Op::Polygon: s->polyset(list, c.v[1] / 2, c.solid, c.on, (Screen::FillRule)c.mode); break;
+    case Op::Blit: s->blit(c.image, c.v[0], c.v[1], (CanvasKernels::Op)c.mode, c.mask); break;
+    }
+}
+
+// Runs every command that reaches rows y1..y2, clipped to them (on any thread)
+static void replayBand(Screen* s, int y1, int y2)
+{
+    int applied = -1;
+    for (const Command& c : commands)
+    {
+        if (c.bottom < y1 || c.top > y2) continue;
+        if (c.op == Op::Clear)
+        {
+            run(s, c, y1, y2);
+            continue;
+        }
+
+        if (c.state != applied)
+        {
+            const State& st = states[c.state];
+            Screen::clip = { st.clip.x1, max(st.clip.y1, y1), st.clip.x2, min(st.clip.y2, y2) };
+            Screen::setPattern(st.pattern, st.anchor);
+            applied = c.state;
+        }
+        run(s, c, y1, y2);
+    }
+}
+
+// Worker threads, started on the first parallel replay; thread k (1 and up) replays band k, the caller band 0
+static struct Pool
+{
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable start, finished;
+    unsigned job = 0; // Incremented for each replay
+    int bands = 0, running = 0;
+    bool stopping = false;
+    Screen* target = nullptr; // The Screen replaying (its drawing functions only use the Canvas statics)
+    int top[MAX_BANDS], bottom[MAX_BANDS]; // Dirty rows each band wrote
+
+    ~Pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        start.notify_all();
+        for (std::thread& t : threads) t.join();
+    }
+} pool;
+
+static int bandRow(int band, int bands)
+{
+    return (int)((long long)Screen::height * band / bands);
+}
+
+static void worker(int band)
+{
+    unsigned seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(pool.mutex);
+            pool.start.wait(lock, [&] { return pool.stopping || pool.job != seen; });
+            if (pool.stopping) return;
+            seen = pool.job;
+            if (band >= pool.bands) continue;
+        }
+
+        Screen::clearDirty();
+        replayBand(pool.target, bandRow(band, pool.bands), bandRow(band + 1, pool.bands) - 1);
+
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.top[band] = Screen::dirty_top;
+        pool.bottom[band] = Screen::dirty_bottom;
+        if (--pool.running == 0) pool.finished.notify_one();
+    }
+}
+
+static int bandCount()
+{
+    static const int threads = max((int)std::thread::hardware_concurrency(), 1);
+    return max(1, min(min(threads, MAX_BANDS), Screen::height / MIN_BAND_ROWS));
+}
+
+static void replayParallel(Screen* s, int bands)
+{
+    while ((int)pool.threads.size() < bands - 1) pool.threads.emplace_back(worker, (int)pool.threads.size() + 1);
+
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.target = s;
+        pool.bands = bands;
+        pool.running = bands - 1;
+        pool.job++;
+    }
+    pool.start.notify_all();
+
+    replayBand(s, 0, bandRow(1, bands) - 1);
+
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    pool.finished.wait(lock, [] { return pool.running == 0; });
+    for (int i = 1; i < bands; i++)
+        if (pool.top[i] <= pool.bottom[i]) Screen::markDirty(pool.top[i], pool.bottom[i]);
+}
+
+void DrawCommands::flush()
+{
+    if (commands.empty()) return;
+
+    // The replay moves this thread's clip rect and pattern; the script's are put back after
+    const Screen::ClipRect clip = Screen::clip;
+    unsigned char pattern[8];
+    memcpy(pattern, Screen::pattern, 8);
+    const Screen::PatternAnchor anchor = Screen::pattern_anchor;
+
+    int bands = bandCount();
+    if (work < PARALLEL_WORK || bands < 2) replayBand(screen, 0, Screen::height - 1);
+    else replayParallel(screen, bands);
+
+    Screen::clip = clip;
+    Screen::setPattern(pattern, anchor);
+
+    commands.clear();
+    states.clear();
+    coords.clear();
+    work = 0;
+}
@@ -0,0 +1,43 @@
+#ifndef DRAW_COMMANDS_H
+#define DRAW_COMMANDS_H
+
+#include "CanvasKernels.h"
+#include "Screen.h"
+
+struct Image;
+
+// Deferred drawing (lime.graphics.setDeferred). While lime.draw or a layer's draw function runs, shape and
+// blit calls are appended to a command buffer, with the clip rect and fill pattern they were made under,
+// instead of being drawn. The buffer is replayed when the callback returns, and before any call that reads
+// the Canvas or could change what a command refers to (those call flush).
+// Large batches are replayed by a pool of threads that each own a band of rows: every thread runs, in order,
+// each command that reaches its band with the clip rect narrowed to the band. Rasterization never depends on
+// the clip rect (it only masks pixels), so the result is bit-identical to drawing immediately.
+namespace DrawCommands
+{
+    inline bool enabled = false;
+
+    struct Scope // Around a draw callback: records while enabled, then replays
+    {
+        Scope();
+        ~Scope();
+    };
+
+    bool recording(); // Enabled, within a Scope, and drawing to the Canvas (not to a render target)
+    void flush(); // Replays and empties the buffer (nothing to do when it is empty)
+    void reset(); // Off, with the buffer emptied (for a newly loaded script)
+
+    // Record a call while recording(); the arguments are those of the Screen functions of the same name
+    void clear(bool inverted);
+    void pset(int x, int y, bool on);
+    void psets(const int* xy, int n, bool on); // n points as x,y pairs
+    void lset(int x1, int y1, int x2, int y2, bool on, int width, Screen::LineCap cap);
+    void lsets(const int* xy, int n, bool on, int width, Screen::LineCap cap);
+    void lsetsc(const int* xy, int n, bool on, int width, Screen::LineJoin join, Screen::LineCap cap);
+    void rset(int x, int y, int w, int h, bool solid, bool on);
+    void eset(int x, int y, int w, int h, bool solid, bool on);
+    void polyset(const int* xy, int n, bool solid, bool on, Screen::FillRule rule);
+    void blit(const Image* image, int x, int y, CanvasKernels::Op op, const Image* mask);
+}
+
+#endif
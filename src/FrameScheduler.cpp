@@ -0,0 +1,114 @@
+#include "FrameScheduler.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#include "App.h"
+#include "gl.h"
+#include "Headless.h"
+#include "Screen.h"
+
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+static double accumulator = 0.0; // Time not yet taken by fixed updates
+
+int FrameScheduler::steps(double dt)
+{
+    const double step = settings.fixed_step;
+    accumulator += dt;
+
+    int n = 0;
+    while (accumulator >= step && n < MAX_STEPS)
+    {
+        accumulator -= step;
+        n++;
+    }
+    if (accumulator >= step) accumulator = fmod(accumulator, step); // Too far behind to catch up (e.g. after a stall)
+    return n;
+}
+
+double FrameScheduler::alpha()
+{
+    return settings.fixed_step > 0.0 ? accumulator / settings.fixed_step : 0.0;
+}
+
+void FrameScheduler::setFixedStep(double step)
+{
+    settings.fixed_step = step;
+    accumulator = 0.0;
+}
+
+void FrameScheduler::reset()
+{
+    settings = {};
+    accumulator = 0.0;
+}
+
+bool FrameScheduler::shouldIdle()
+{
+    return settings.idle && !Headless::options.enabled && !Screen::render_frames
+        && screen && !screen->needsDraw() && !screen->animated();
+}
+
+#if defined(_WIN32)
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+// Sleep rounds up to the 15.6 ms system tick; a high-resolution waitable timer (Windows 10 1803+) does not
+static void sleepOnce(double seconds)
+{
+    static HANDLE timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (!timer)
+    {
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        return;
+    }
+
+    LARGE_INTEGER due;
+    due.QuadPart = -(LONGLONG)(seconds * 1e7); // Relative, in 100 ns units
+    SetWaitableTimer(timer, &due, 0, nullptr, nullptr, FALSE);
+    WaitForSingleObject(timer, INFINITE);
+}
+#else
+static void sleepOnce(double seconds)
+{
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+}
+#endif
+
+// Sleeps 1 ms at a time while more remains than a sleep is likely to take (the running mean plus one standard
+// deviation of how long they have taken), then spins to the deadline
+static void sleepUntil(double deadline)
+{
+    static double mean = 0.002, variance = 0.0;
+    constexpr double rate = 0.05; // Weight of each new sleep in the running estimates
+
+    double now = glfwGetTime();
+    while (deadline - now > mean + sqrt(variance))
+    {
+        const double start = now;
+        sleepOnce(0.001);
+        now = glfwGetTime();
+
+        const double delta = (now - start) - mean;
+        mean += rate * delta;
+        variance = (1.0 - rate) * (variance + rate * delta * delta);
+    }
+    while (now < deadline) now = glfwGetTime();
+}
+
+void FrameScheduler::limit(double fps)
+{
+    static double next_frame = 0.0;
+    const double period = 1.0 / fps;
+
+    sleepUntil(next_frame);
+    const double now = glfwGetTime();
+    next_frame = (next_frame > now - period ? next_frame : now - period) + period; // After a stall, start over rather than catch up
+}
@@ -0,0 +1,34 @@
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+// Decides how App::run spends each frame. Set from Lua through lime.time:
+//   Idle          While the app has no lime.update and nothing needs drawing or presenting, the loop blocks
+//                 for window events instead of spinning at the refresh rate (on by default)
+//   Fixed step    lime.update runs at a fixed rate, as often as the time since the last frame allows, and
+//                 lime.draw receives how far the clock is into the next step (0-1) for interpolation
+//   Frame limit   Frames are held to a rate with a sleep that is topped up by spinning, for when vsync is
+//                 off or broken (software presentation keeps to the refresh rate this way)
+namespace FrameScheduler
+{
+    struct Settings
+    {
+        bool idle = true;
+        double fixed_step = 0.0; // Seconds per update (0 = one update per frame with the frame's dt)
+        double frame_limit = 0.0; // Frames per second (0 = none)
+    };
+
+    inline Settings settings;
+
+    constexpr int MAX_STEPS = 8; // Fixed updates per frame before the rest of a stall is dropped
+    constexpr double IDLE_TIMEOUT = 0.5; // Longest block for events, as a safety net
+
+    int steps(double dt); // Adds dt to the fixed-step accumulator and takes the updates now due
+    double alpha(); // Fraction of a fixed step left in the accumulator
+    void setFixedStep(double step); // Changes the step and empties the accumulator
+    void reset(); // Back to the default settings (for a newly loaded script)
+
+    bool shouldIdle(); // Nothing to update, draw or present in a window, so App::run may block for events
+    void limit(double fps); // Sleeps until the next frame is due at fps
+}
+
+#endif
@@ -0,0 +1,175 @@
+#include "Headless.h"
+
+#include <chrono> // Before misc.h, whose min/max macros break these
+#include <thread>
+
+#include "App.h"
+#include "misc.h"
+#include "miniz/miniz.h"
+#include "Renderer.h"
+#include "Screen.h"
+#include "TerminalPresenter.h"
+#include "Window.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+static std::chrono::steady_clock::time_point start;
+static std::chrono::steady_clock::time_point schedule; // When frame 0 would have started, for pacing
+static long long frame = 0; // Frames completed
+
+static long long parseCount(const std::string& value, const char* option)
+{
+    size_t used = 0;
+    long long n = 0;
+    try { n = std::stoll(value, &used); }
+    catch (const std::exception&) { used = 0; }
+    if (used == 0 || used != value.size() || n <= 0)
+        throw std::runtime_error(std::string("Invalid value for ") + option + ": '" + value + "' (expected a positive integer)");
+    return n;
+}
+
+bool Headless::parseOption(const std::string& arg)
+{
+    size_t eq = arg.find('=');
+    std::string name = arg.substr(0, eq);
+    std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+
+    if (name == "--headless")
+    {
+        options.enabled = true;
+        if (eq == std::string::npos) return true;
+
+        size_t x = value.find('x');
+        if (x == std::string::npos) throw std::runtime_error("Invalid value for --headless: '" + value + "' (expected WxH)");
+        long long w = parseCount(value.substr(0, x), "--headless width");
+        long long h = parseCount(value.substr(x + 1), "--headless height");
+        if (w % 8 || w > 16384 || h > 16384)
+            throw std::runtime_error("Invalid canvas size for --headless: width must be a multiple of 8, and sides at most 16384");
+        options.width = (int)w;
+        options.height = (int)h;
+    }
+    else if (name == "--frames") options.frames = parseCount(value, "--frames");
+    else if (name == "--fps") options.step = 1.0 / (double)parseCount(value, "--fps");
+    else if (name == "--real-clock") options.real_clock = true;
+    else if (name == "--dump")
+    {
+        if (value.empty()) throw std::runtime_error("--dump needs a directory (--dump=DIR)");
+        options.dump_dir = std::filesystem::absolute(value); // The working directory changes at startup
+    }
+    else if (name == "--dump-every") options.dump_every = parseCount(value, "--dump-every");
+    else if (name == "--png") options.png = true;
+    else return false;
+
+    return true;
+}
+
+void Headless::init()
+{
+    cout("Starting application (headless)...");
+
+    start = schedule = std::chrono::steady_clock::now();
+    frame = 0;
+
+    Screen::_init(options.width, options.height);
+    window.width = options.width;
+    window.height = options.height;
+    window.refresh_rate_at_startup = (int)(1.0 / options.step + 0.5);
+
+    if (!options.dump_dir.empty())
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(options.dump_dir, ec);
+        if (ec) throw std::runtime_error("Cannot create frame dump directory " + options.dump_dir.string() + ": " + ec.message());
+    }
+
+    TerminalPresenter::init();
+}
+
+bool Headless::finished()
+{
+    return options.frames > 0 && frame >= options.frames;
+}
+
+void Headless::endFrame()
+{
+    TerminalPresenter::present();
+    TerminalPresenter::pollInput();
+
+    if (!options.dump_dir.empty() && frame % options.dump_every == 0)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "frame_%06lld.%s", frame, options.png ? "png" : "pbm");
+        if (!writeFrame(options.dump_dir / name, options.png))
+            APP_FATAL << "Failed to write " << (options.dump_dir / name).string();
+    }
+    frame++;
+
+    if (options.paced)
+    {
+        // Frames that fall behind are dropped from the schedule rather than rushed
+        auto due = schedule + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(frame * options.step));
+        auto now = std::chrono::steady_clock::now();
+        if (now < due) std::this_thread::sleep_until(due);
+        else if (now - due > std::chrono::duration<double>(options.step)) schedule += now - due;
+    }
+}
+
+double Headless::time()
+{
+    return options.real_clock ? realTime() : frame * options.step;
+}
+
+double Headless::realTime()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool Headless::writeFrame(const std::filesystem::path& path, bool png)
+{
+    const int w = Screen::canvas_width, h = Screen::canvas_height, stride = w / 8;
+    const unsigned char* pixels = Screen::offscreen ? nullptr : Screen::pixels;
+    if (!pixels) return false;
+
+    std::ofstream f(path, std::ios::binary);
+    if (!f) return false;
+
+    if (!png)
+    {
+        // P4 rows are MSB-first with 1 for black
+        std::vector<unsigned char> row(stride);
+        f << "P4\n" << w << " " << h << "\n";
+        for (int y = 0; y < h; y++)
+        {
+            for (int i = 0; i < stride; i++)
+            {
+                unsigned char b = pixels[y * stride + i], r = 0;
+                for (int k = 0; k < 8; k++) r |= ((b >> k) & 1) << (7 - k);
+                row[i] = (unsigned char)~r;
+            }
+            f.write((const char*)row.data(), stride);
+        }
+        return (bool)f;
+    }
+
+    unsigned char colors[2][3];
+    for (int c = 0; c < 3; c++)
+    {
+        colors[0][c] = (unsigned char)(renderer.bgColor()[c] * 255 + 0.5f);
+        colors[1][c] = (unsigned char)(renderer.fgColor()[c] * 255 + 0.5f);
+    }
+
+    std::vector<unsigned char> rgb((size_t)w * h * 3);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+            memcpy(&rgb[((size_t)y * w + x) * 3], colors[(pixels[y * stride + x / 8] >> (x & 7)) & 1], 3);
+
+    size_t size = 0;
+    void* data = tdefl_write_image_to_png_file_in_memory_ex(rgb.data(), w, h, 3, &size, 6, MZ_FALSE);
+    if (!data) return false;
+    f.write((const char*)data, size);
+    mz_free(data);
+    return (bool)f;
+}
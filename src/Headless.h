@@ -0,0 +1,44 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <filesystem>
+#include <string>
+
+// Headless backend for CI, benchmarking and server-side rendering: App::run's update/draw loop runs without
+// GLFW or OpenGL, so no display or GPU is needed. It is chosen at startup with command-line options:
+//   --headless[=WxH]    Canvas size (default 640x360)
+//   --frames=N          Quit after N frames (default: run until the app quits)
+//   --fps=N             Virtual clock step of 1/N seconds per frame (default 60)
+//   --real-clock        Use the wall clock instead of the virtual one (e.g. for timing)
+//   --dump=DIR          Write frames to DIR/frame_NNNNNN.pbm (or .png)
+//   --dump-every=N      Write every Nth frame only
+//   --png               Write PNG files in the window colours instead of PBM
+// --terminal (see TerminalPresenter.h) also runs headless, showing the frames in the terminal.
+namespace Headless
+{
+    struct Options
+    {
+        bool enabled = false;
+        int width = 640, height = 360;
+        double step = 1.0 / 60;
+        bool real_clock = false;
+        bool paced = false; // Wait for each frame's time on the real clock
+        long long frames = 0;
+        std::filesystem::path dump_dir;
+        long long dump_every = 1;
+        bool png = false;
+    };
+
+    inline Options options;
+
+    bool parseOption(const std::string& arg); // Applies arg if it is one of the options above (throws on bad values)
+    void init(); // Sets up the Canvas in place of the window and renderer
+    bool finished(); // True once the frame limit is reached
+    void endFrame(); // Presents or writes the frame if due, then advances the clock
+    double time(); // Seconds since init on the clock in use
+    double realTime(); // Seconds since init on the wall clock
+
+    bool writeFrame(const std::filesystem::path& path, bool png); // Writes the main Canvas as PBM (on pixels white) or PNG; false on failure
+}
+
+#endif
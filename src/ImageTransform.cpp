@@ -0,0 +1,143 @@
+#include "ImageTransform.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Bit-reversed bytes (LSB-first rows read right to left)
+static const struct ReverseTable
+{
+    unsigned char v[256];
+    ReverseTable()
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            int r = 0;
+            for (int b = 0; b < 8; b++)
+                if (i & (1 << b)) r |= 0x80 >> b;
+            v[i] = (unsigned char)r;
+        }
+    }
+} reversed;
+
+// Transposes an 8x8 bit matrix held as 8 row bytes (bit c of byte r <-> bit r of byte c)
+static inline uint64_t transpose8(uint64_t x)
+{
+    uint64_t t;
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAull; x ^= t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCull; x ^= t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ull; x ^= t ^ (t << 28);
+    return x;
+}
+
+static void flipRow(const unsigned char* src, unsigned char* dst, int row_bytes)
+{
+    for (int i = 0; i < row_bytes; i++)
+        dst[row_bytes - 1 - i] = reversed.v[src[i]];
+}
+
+void ImageTransform::flipX(const Image& src, unsigned char* dst)
+{
+    const int stride = src.width / 8;
+    for (int y = 0; y < src.height; y++)
+        flipRow(src.pixels + y * stride, dst + y * stride, stride);
+}
+
+void ImageTransform::flipY(const Image& src, unsigned char* dst)
+{
+    const int stride = src.width / 8;
+    for (int y = 0; y < src.height; y++)
+        memcpy(dst + (src.height - 1 - y) * stride, src.pixels + y * stride, stride);
+}
+
+void ImageTransform::rotate180(const Image& src, unsigned char* dst)
+{
+    const int stride = src.width / 8;
+    for (int y = 0; y < src.height; y++)
+        flipRow(src.pixels + y * stride, dst + (src.height - 1 - y) * stride, stride);
+}
+
+// Both quarter turns work on 8x8 blocks: 8 source rows of one byte column are gathered into a
+// word, transposed, and each resulting byte is one byte of a destination row. The source is
+// padded with off rows up to rotatedWidth (at the top for clockwise turns, at the bottom for
+// counter-clockwise ones) so that the padding always lands on the right of the result.
+template <bool clockwise>
+static void rotateQuarter(const Image& src, unsigned char* dst)
+{
+    const int src_stride = src.width / 8;
+    const int padded = ImageTransform::rotatedWidth(src);
+    const int dst_stride = padded / 8;
+    const int pad = clockwise ? padded - src.height : 0;
+
+    for (int j0 = 0; j0 < padded; j0 += 8)
+    {
+        for (int bx = 0; bx < src_stride; bx++)
+        {
+            uint64_t block = 0;
+            for (int r = 0; r < 8; r++)
+            {
+                int y = j0 + r - pad; // Row of the padded block in the source
+                if (y >= 0 && y < src.height)
+                    block |= (uint64_t)src.pixels[y * src_stride + bx] << (r * 8);
+            }
+
+            uint64_t t = transpose8(block); // Byte c holds source column bx * 8 + c, bit r its row j0 + r
+            for (int c = 0; c < 8; c++)
+            {
+                unsigned char v = (unsigned char)(t >> (c * 8));
+                int x = bx * 8 + c;
+                if (clockwise) // dst(x', y') = padded(y', padded - 1 - x')
+                    dst[x * dst_stride + (padded - 8 - j0) / 8] = reversed.v[v];
+                else // dst(x', y') = padded(width - 1 - y', x')
+                    dst[(src.width - 1 - x) * dst_stride + j0 / 8] = v;
+            }
+        }
+    }
+}
+
+void ImageTransform::rotate90(const Image& src, unsigned char* dst)
+{
+    rotateQuarter<true>(src, dst);
+}
+
+void ImageTransform::rotate270(const Image& src, unsigned char* dst)
+{
+    rotateQuarter<false>(src, dst);
+}
+
+void ImageTransform::scale(const Image& src, unsigned char* dst, int w, int h)
+{
+    const int src_stride = src.width / 8;
+    const int dst_stride = w / 8;
+
+    // Source column of every destination pixel (pixel centres, as for the rows below)
+    std::vector<int> columns(w);
+    for (int x = 0; x < w; x++)
+        columns[x] = (int)(((long long)x * 2 + 1) * src.width / (2LL * w));
+
+    int prev = -1;
+    for (int y = 0; y < h; y++)
+    {
+        int sy = (int)(((long long)y * 2 + 1) * src.height / (2LL * h));
+        unsigned char* row = dst + (size_t)y * dst_stride;
+
+        if (sy == prev) // Repeated source rows are copies of the row above
+        {
+            memcpy(row, row - dst_stride, dst_stride);
+            continue;
+        }
+        prev = sy;
+
+        const unsigned char* srow = src.pixels + (size_t)sy * src_stride;
+        for (int b = 0; b < dst_stride; b++)
+        {
+            unsigned char v = 0;
+            for (int k = 0; k < 8; k++)
+            {
+                int sx = columns[b * 8 + k];
+                v |= ((srow[sx >> 3] >> (sx & 7)) & 1) << k;
+            }
+            row[b] = v;
+        }
+    }
+}
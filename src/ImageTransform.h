@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Image.h"
+
+// Geometric transforms of packed 1bpp images into new buffers (dst must not overlap src)
+// Results keep widths a multiple of 8: 90/270-degree rotations of images whose height is not
+// a multiple of 8 get off pixels padded on the right (see rotatedWidth)
+namespace ImageTransform
+{
+    inline int rotatedWidth(const Image& src) { return (src.height + 7) & ~7; }
+
+    void flipX(const Image& src, unsigned char* dst); // Mirror left to right (same size)
+    void flipY(const Image& src, unsigned char* dst); // Mirror top to bottom (same size)
+    void rotate180(const Image& src, unsigned char* dst); // Same size
+    void rotate90(const Image& src, unsigned char* dst); // Clockwise; dst is rotatedWidth(src) x src.width
+    void rotate270(const Image& src, unsigned char* dst); // Counter-clockwise; dst is rotatedWidth(src) x src.width
+    void scale(const Image& src, unsigned char* dst, int w, int h); // Nearest-neighbour resize to w x h (w must be a multiple of 8)
+}
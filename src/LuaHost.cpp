@@ -1,7 +1,10 @@
 #include "LuaHost.h"
 
 #include "App.h"
+#include "DrawCommands.h"
+#include "FrameScheduler.h"
 #include "FusedArchive.h"
+#include "ImageTransform.h"
 #include "misc.h"
 #include "MonospaceMonochromePixelFont.h"
 #include "Screen.h"
@@ -76,6 +79,7 @@ static fs::path luaUtf8ToPath(lua_State* L, int idx)
 static Screen* requireScreen(lua_State* L)
 {
     if (!screen) luaL_error(L, "Lime2D: no active screen");
+    DrawCommands::flush(); // Whatever the caller does comes after the deferred calls
     return screen;
 }
 
@@ -107,6 +111,11 @@ void LuaHost::shutdown()
     if (!L) return;
 
     images.clear();
+    tilemaps.clear();
+    packedImages.clear();
+    worlds.clear();
+    snapshots.clear();
+    DrawCommands::reset();
 
     // Clear profiler state
     profilerSections.clear();
@@ -137,6 +146,7 @@ void LuaHost::pcall(int nargs, int nrets)
     int status = lua_pcall(L, nargs, nrets, errFuncIndex);
 
     lua_remove(L, errFuncIndex);
+    Screen::resetTarget(); // Render targets last for one callback at most
 
     if (status != LUA_OK)
     {
@@ -324,6 +334,7 @@ void LuaHost::registerGraphicsSubtable()
     lua_pushinteger(L, Screen::text_offset_y); lua_setfield(L, -2, "TEXT_OFFSET_Y");
     lua_pushinteger(L, Screen::rows); lua_setfield(L, -2, "ROWS");
     lua_pushinteger(L, Screen::cols); lua_setfield(L, -2, "COLS");
+    lua_pushinteger(L, Screen::MAX_LAYERS); lua_setfield(L, -2, "MAX_LAYERS");
 
     // Functions
     static const luaL_Reg graphicsFns[] = {
@@ -352,6 +363,31 @@ void LuaHost::registerGraphicsSubtable()
         {"eset", l_graphics_eset},
         {"eon", l_graphics_eon},
         {"eoff", l_graphics_eoff},
+        {"polyset", l_graphics_polyset},
+        {"polyon", l_graphics_polyon},
+        {"polyoff", l_graphics_polyoff},
+        {"tset", l_graphics_tset},
+        {"ton", l_graphics_ton},
+        {"toff", l_graphics_toff},
+        {"fset", l_graphics_fset},
+        {"fon", l_graphics_fon},
+        {"foff", l_graphics_foff},
+
+        // Clipping
+        {"pushClip", l_graphics_pushClip},
+        {"popClip", l_graphics_popClip},
+        {"getClip", l_graphics_getClip},
+
+        // Fill pattern
+        {"setPattern", l_graphics_setPattern},
+
+        // Deferred drawing
+        {"setDeferred", l_graphics_setDeferred},
+
+        // Layers
+        {"removeLayer", l_graphics_removeLayer},
+        {"showLayer", l_graphics_showLayer},
+        {"redrawLayer", l_graphics_redrawLayer},
 
         // Text
         {"locate", l_graphics_locate},
@@ -378,6 +414,80 @@ void LuaHost::registerGraphicsSubtable()
     lua_pushcclosure(L, &LuaHost::l_graphics_image, 1);
     lua_setfield(L, -2, "image");
 
+    lua_pushlightuserdata(L, this);
+    lua_pushcclosure(L, &LuaHost::l_graphics_blit, 1);
+    lua_setfield(L, -2, "blit");
+
+    lua_pushlightuserdata(L, this);
+    lua_pushcclosure(L, &LuaHost::l_graphics_transformImage, 1);
+    lua_setfield(L, -2, "transformImage");
+
+    lua_pushlightuserdata(L, this);
+    lua_pushcclosure(L, &LuaHost::l_graphics_blitRect, 1);
+    lua_setfield(L, -2, "blitRect");
+
+    lua_pushcfunction(L, &LuaHost::l_graphics_scroll);
+    lua_setfield(L, -2, "scroll");
+
+    // More functions that take the host as an upvalue
+    static const luaL_Reg selfFns[] = {
+        {"newTilemap", l_graphics_newTilemap},
+        {"setTile", l_graphics_setTile},
+        {"getTile", l_graphics_getTile},
+        {"setTiles", l_graphics_setTiles},
+        {"drawTilemap", l_graphics_drawTilemap},
+        {"packImage", l_graphics_packImage},
+        {"definePackedImage", l_graphics_definePackedImage},
+        {"blitPacked", l_graphics_blitPacked},
+        {"unpackImage", l_graphics_unpackImage},
+        {"newWorld", l_graphics_newWorld},
+        {"drawWorld", l_graphics_drawWorld},
+        {"blitWorld", l_graphics_blitWorld},
+        {"worldTiles", l_graphics_worldTiles},
+        {"snapshot", l_graphics_snapshot},
+        {"restoreSnapshot", l_graphics_restoreSnapshot},
+        {"discardSnapshot", l_graphics_discardSnapshot},
+        {"snapshotMemory", l_graphics_snapshotMemory},
+        {nullptr, nullptr}
+    };
+    for (const luaL_Reg* fn = selfFns; fn->name; fn++)
+    {
+        lua_pushlightuserdata(L, this);
+        lua_pushcclosure(L, fn->func, 1);
+        lua_setfield(L, -2, fn->name);
+    }
+
+    lua_pushlightuserdata(L, this);
+    lua_pushcclosure(L, &LuaHost::l_graphics_newCanvas, 1);
+    lua_setfield(L, -2, "newCanvas");
+
+    lua_pushlightuserdata(L, this);
+    lua_pushcclosure(L, &LuaHost::l_graphics_setTarget, 1);
+    lua_setfield(L, -2, "setTarget");
+
+    lua_pushcfunction(L, &LuaHost::l_graphics_resetTarget);
+    lua_setfield(L, -2, "resetTarget");
+
+    lua_pushlightuserdata(L, this);
+    lua_pushcclosure(L, &LuaHost::l_graphics_setLayer, 1);
+    lua_setfield(L, -2, "setLayer");
+
+    lua_pushlightuserdata(L, this);
+    lua_pushcclosure(L, &LuaHost::l_graphics_overlap, 1);
+    lua_setfield(L, -2, "overlap");
+
+    lua_pushlightuserdata(L, this);
+    lua_pushcclosure(L, &LuaHost::l_graphics_overlapCanvas, 1);
+    lua_setfield(L, -2, "overlapCanvas");
+
+    lua_pushlightuserdata(L, this);
+    lua_pushcclosure(L, &LuaHost::l_graphics_countPixels, 1);
+    lua_setfield(L, -2, "countPixels");
+
+    lua_pushlightuserdata(L, this);
+    lua_pushcclosure(L, &LuaHost::l_graphics_raycast, 1);
+    lua_setfield(L, -2, "raycast");
+
     lua_setfield(L, -2, "graphics"); // lime.graphics = {...}
 }
 
@@ -408,7 +518,8 @@ int LuaHost::l_graphics_setBgColor(lua_State* L)
 int LuaHost::l_graphics_clear(lua_State* L)
 {
     bool inverted = lua_toboolean(L, 1) != 0;
-    requireScreen(L)->clear(inverted);
+    if (DrawCommands::recording()) DrawCommands::clear(inverted);
+    else requireScreen(L)->clear(inverted);
     return 0;
 }
 
@@ -417,8 +528,8 @@ int LuaHost::l_graphics_pset(lua_State* L)
     int x = (int)luaL_checkinteger(L, 1);
     int y = (int)luaL_checkinteger(L, 2);
     bool on = lua_isnone(L, 3) ? true : (lua_toboolean(L, 3) != 0);
-    if (x < 0 || x >= Screen::width || y < 0 || y >= Screen::height)
-        return luaL_error(L, "lime.graphics.pset: out of bounds (%d,%d)", x, y);
+    if (DrawCommands::recording()) { DrawCommands::pset(x, y, on); return 0; }
+    if (!Screen::inClip(x, y)) return 0;
     if (on) ponUnsafe(x, y);
     else poffUnsafe(x, y);
     return 0;
@@ -428,8 +539,8 @@ int LuaHost::l_graphics_pon(lua_State* L)
 {
     int x = (int)luaL_checkinteger(L, 1);
     int y = (int)luaL_checkinteger(L, 2);
-    if (x < 0 || x >= Screen::width || y < 0 || y >= Screen::height)
-        return luaL_error(L, "lime.graphics.pon: out of bounds (%d,%d)", x, y);
+    if (DrawCommands::recording()) { DrawCommands::pset(x, y, true); return 0; }
+    if (!Screen::inClip(x, y)) return 0;
     ponUnsafe(x, y);
     return 0;
 }
@@ -438,8 +549,8 @@ int LuaHost::l_graphics_poff(lua_State* L)
 {
     int x = (int)luaL_checkinteger(L, 1);
     int y = (int)luaL_checkinteger(L, 2);
-    if (x < 0 || x >= Screen::width || y < 0 || y >= Screen::height)
-        return luaL_error(L, "lime.graphics.poff: out of bounds (%d,%d)", x, y);
+    if (DrawCommands::recording()) { DrawCommands::pset(x, y, false); return 0; }
+    if (!Screen::inClip(x, y)) return 0;
     poffUnsafe(x, y);
     return 0;
 }
@@ -451,15 +562,31 @@ static void getIntFromArrayTable(lua_State* L, int tindex, int i, lua_Integer* o
     lua_pop(L, 1);
 }
 
+// Reads n coordinates from the table at idx into xy as pons does (non-numbers are 0)
+static void readPoints(lua_State* L, int idx, int n, std::vector<int>& xy)
+{
+    xy.resize(n);
+    for (int i = 0; i < n; i++)
+    {
+        lua_rawgeti(L, idx, i + 1);
+        xy[i] = (int)lua_tointeger(L, -1);
+        lua_pop(L, 1);
+    }
+}
+
 int LuaHost::l_graphics_pons(lua_State* L)
 {
     luaL_checktype(L, 1, LUA_TTABLE);
     int n = (int)lua_rawlen(L, 1);
     if ((n % 2) != 0)
         return luaL_error(L, "lime.graphics.pons: coordinate list length must be even");
-
-    int w{ Screen::width }, h{ Screen::height };
-    static const char* ERR_BOUNDS = "lime.graphics.pons: out of bounds (%d,%d)";
+    if (DrawCommands::recording())
+    {
+        static std::vector<int> xy;
+        readPoints(L, 1, n, xy);
+        DrawCommands::psets(xy.data(), n / 2, true);
+        return 0;
+    }
 
     int i = 1;
     for (; i + 7 <= n; i += 8)
@@ -472,24 +599,16 @@ int LuaHost::l_graphics_pons(lua_State* L)
         int x, y;
 
         x = (int)lua_tointeger(L, -8); y = (int)lua_tointeger(L, -7);
-        if (x < 0 || x >= w || y < 0 || y >= h)
-            return luaL_error(L, ERR_BOUNDS, x, y);
-        ponUnsafe(x, y);
+        if (Screen::inClip(x, y)) ponUnsafe(x, y);
 
         x = (int)lua_tointeger(L, -6); y = (int)lua_tointeger(L, -5);
-        if (x < 0 || x >= w || y < 0 || y >= h)
-            return luaL_error(L, ERR_BOUNDS, x, y);
-        ponUnsafe(x, y);
+        if (Screen::inClip(x, y)) ponUnsafe(x, y);
 
         x = (int)lua_tointeger(L, -4); y = (int)lua_tointeger(L, -3);
-        if (x < 0 || x >= w || y < 0 || y >= h)
-            return luaL_error(L, ERR_BOUNDS, x, y);
-        ponUnsafe(x, y);
+        if (Screen::inClip(x, y)) ponUnsafe(x, y);
 
         x = (int)lua_tointeger(L, -2); y = (int)lua_tointeger(L, -1);
-        if (x < 0 || x >= w || y < 0 || y >= h)
-            return luaL_error(L, ERR_BOUNDS, x, y);
-        ponUnsafe(x, y);
+        if (Screen::inClip(x, y)) ponUnsafe(x, y);
 
         lua_pop(L, 8);
     }
@@ -500,9 +619,7 @@ int LuaHost::l_graphics_pons(lua_State* L)
         lua_rawgeti(L, 1, i + 1);
         int x = (int)lua_tointeger(L, -2);
         int y = (int)lua_tointeger(L, -1);
-        if (x < 0 || x >= w || y < 0 || y >= h)
-            return luaL_error(L, ERR_BOUNDS, x, y);
-        ponUnsafe(x, y);
+        if (Screen::inClip(x, y)) ponUnsafe(x, y);
         lua_pop(L, 2);
     }
 
@@ -515,9 +632,13 @@ int LuaHost::l_graphics_poffs(lua_State* L)
     int n = (int)lua_rawlen(L, 1);
     if ((n % 2) != 0)
         return luaL_error(L, "lime.graphics.poffs: coordinate list length must be even");
-
-    int w{ Screen::width }, h{ Screen::height };
-    static const char* ERR_BOUNDS = "lime.graphics.poffs: out of bounds (%d,%d)";
+    if (DrawCommands::recording())
+    {
+        static std::vector<int> xy;
+        readPoints(L, 1, n, xy);
+        DrawCommands::psets(xy.data(), n / 2, false);
+        return 0;
+    }
 
     int i = 1;
     for (; i + 7 <= n; i += 8)
@@ -530,24 +651,16 @@ int LuaHost::l_graphics_poffs(lua_State* L)
         int x, y;
 
         x = (int)lua_tointeger(L, -8); y = (int)lua_tointeger(L, -7);
-        if (x < 0 || x >= w || y < 0 || y >= h)
-            return luaL_error(L, ERR_BOUNDS, x, y);
-        poffUnsafe(x, y);
+        if (Screen::inClip(x, y)) poffUnsafe(x, y);
 
         x = (int)lua_tointeger(L, -6); y = (int)lua_tointeger(L, -5);
-        if (x < 0 || x >= w || y < 0 || y >= h)
-            return luaL_error(L, ERR_BOUNDS, x, y);
-        poffUnsafe(x, y);
+        if (Screen::inClip(x, y)) poffUnsafe(x, y);
 
         x = (int)lua_tointeger(L, -4); y = (int)lua_tointeger(L, -3);
-        if (x < 0 || x >= w || y < 0 || y >= h)
-            return luaL_error(L, ERR_BOUNDS, x, y);
-        poffUnsafe(x, y);
+        if (Screen::inClip(x, y)) poffUnsafe(x, y);
 
         x = (int)lua_tointeger(L, -2); y = (int)lua_tointeger(L, -1);
-        if (x < 0 || x >= w || y < 0 || y >= h)
-            return luaL_error(L, ERR_BOUNDS, x, y);
-        poffUnsafe(x, y);
+        if (Screen::inClip(x, y)) poffUnsafe(x, y);
 
         lua_pop(L, 8);
     }
@@ -558,15 +671,56 @@ int LuaHost::l_graphics_poffs(lua_State* L)
         lua_rawgeti(L, 1, i + 1);
         int x = (int)lua_tointeger(L, -2);
         int y = (int)lua_tointeger(L, -1);
-        if (x < 0 || x >= w || y < 0 || y >= h)
-            return luaL_error(L, ERR_BOUNDS, x, y);
-        poffUnsafe(x, y);
+        if (Screen::inClip(x, y)) poffUnsafe(x, y);
         lua_pop(L, 2);
     }
 
     return 0;
 }
 
+static int checkLineWidth(lua_State* L, int idx, const char* fname)
+{
+    lua_Integer width = luaL_optinteger(L, idx, 1);
+    if (width < 1 || width > Screen::MAX_LINE_WIDTH)
+        return luaL_error(L, "lime.graphics.%s: line width must be 1-%d", fname, Screen::MAX_LINE_WIDTH);
+    return (int)width;
+}
+
+static Screen::LineCap checkLineCap(lua_State* L, int idx)
+{
+    static const char* const caps[] = { "butt", "square", "round", nullptr };
+    return (Screen::LineCap)luaL_checkoption(L, idx, "butt", caps);
+}
+
+static Screen::LineJoin checkLineJoin(lua_State* L, int idx)
+{
+    static const char* const joins[] = { "miter", "bevel", "round", nullptr };
+    return (Screen::LineJoin)luaL_checkoption(L, idx, "miter", joins);
+}
+
+// Reads n integers from the table at idx into xy (reused between calls), eight per batch of stack pushes
+static void readInts(lua_State* L, int idx, int n, const char* fname, std::vector<int>& xy)
+{
+    xy.resize(n);
+    int i = 0;
+    while (i < n)
+    {
+        int batch = min(8, n - i);
+        for (int k = 1; k <= batch; k++) lua_rawgeti(L, idx, i + k);
+
+        for (int k = 0; k < batch; k++)
+        {
+            int isnum;
+            lua_Integer v = lua_tointegerx(L, k - batch, &isnum);
+            if (!isnum) luaL_error(L, "lime.graphics.%s: element %d is not a number", fname, i + k + 1);
+            xy[i + k] = (int)v;
+        }
+
+        lua_pop(L, batch);
+        i += batch;
+    }
+}
+
 int LuaHost::l_graphics_lset(lua_State* L)
 {
     int x1 = (int)luaL_checkinteger(L, 1);
@@ -574,10 +728,10 @@ int LuaHost::l_graphics_lset(lua_State* L)
     int x2 = (int)luaL_checkinteger(L, 3);
     int y2 = (int)luaL_checkinteger(L, 4);
     bool on = lua_isnone(L, 5) ? true : (lua_toboolean(L, 5) != 0);
-    if (x1 < 0 || x1 >= Screen::width || y1 < 0 || y1 >= Screen::height ||
-        x2 < 0 || x2 >= Screen::width || y2 < 0 || y2 >= Screen::height)
-        return luaL_error(L, "lime.graphics.lset: out of bounds (%d,%d)-(%d,%d)", x1, y1, x2, y2);
-    requireScreen(L)->lset(x1, y1, x2, y2, on);
+    int width = checkLineWidth(L, 6, "lset");
+    Screen::LineCap cap = checkLineCap(L, 7);
+    if (DrawCommands::recording()) DrawCommands::lset(x1, y1, x2, y2, on, width, cap);
+    else requireScreen(L)->lset(x1, y1, x2, y2, on, width, cap);
     return 0;
 }
 
@@ -587,10 +741,10 @@ int LuaHost::l_graphics_lon(lua_State* L)
     int y1 = (int)luaL_checkinteger(L, 2);
     int x2 = (int)luaL_checkinteger(L, 3);
     int y2 = (int)luaL_checkinteger(L, 4);
-    if (x1 < 0 || x1 >= Screen::width || y1 < 0 || y1 >= Screen::height ||
-        x2 < 0 || x2 >= Screen::width || y2 < 0 || y2 >= Screen::height)
-        return luaL_error(L, "lime.graphics.lon: out of bounds (%d,%d)-(%d,%d)", x1, y1, x2, y2);
-    requireScreen(L)->lon(x1, y1, x2, y2);
+    int width = checkLineWidth(L, 5, "lon");
+    Screen::LineCap cap = checkLineCap(L, 6);
+    if (DrawCommands::recording()) DrawCommands::lset(x1, y1, x2, y2, true, width, cap);
+    else requireScreen(L)->lon(x1, y1, x2, y2, width, cap);
     return 0;
 }
 
@@ -600,10 +754,10 @@ int LuaHost::l_graphics_loff(lua_State* L)
     int y1 = (int)luaL_checkinteger(L, 2);
     int x2 = (int)luaL_checkinteger(L, 3);
     int y2 = (int)luaL_checkinteger(L, 4);
-    if (x1 < 0 || x1 >= Screen::width || y1 < 0 || y1 >= Screen::height ||
-        x2 < 0 || x2 >= Screen::width || y2 < 0 || y2 >= Screen::height)
-        return luaL_error(L, "lime.graphics.loff: out of bounds (%d,%d)-(%d,%d)", x1, y1, x2, y2);
-    requireScreen(L)->loff(x1, y1, x2, y2);
+    int width = checkLineWidth(L, 5, "loff");
+    Screen::LineCap cap = checkLineCap(L, 6);
+    if (DrawCommands::recording()) DrawCommands::lset(x1, y1, x2, y2, false, width, cap);
+    else requireScreen(L)->loff(x1, y1, x2, y2, width, cap);
     return 0;
 }
 
@@ -611,25 +765,16 @@ int LuaHost::l_graphics_lsets(lua_State* L)
 {
     luaL_checktype(L, 1, LUA_TTABLE);
     bool on = lua_isnone(L, 2) ? true : (lua_toboolean(L, 2) != 0);
+    int width = checkLineWidth(L, 3, "lsets");
+    Screen::LineCap cap = checkLineCap(L, 4);
 
     int n = (int)lua_rawlen(L, 1);
     if ((n % 4) != 0) return luaL_error(L, "lime.graphics.lsets: list length must be a multiple of 4");
 
-    Screen* s = requireScreen(L);
-    int w{ Screen::width }, h{ Screen::height };
-
-    for (int i = 1; i <= n; i += 4)
-    {
-        lua_Integer x1, y1, x2, y2;
-        getIntFromArrayTable(L, 1, i, &x1);
-        getIntFromArrayTable(L, 1, i + 1, &y1);
-        getIntFromArrayTable(L, 1, i + 2, &x2);
-        getIntFromArrayTable(L, 1, i + 3, &y2);
-        if (x1 < 0 || x1 >= w || y1 < 0 || y1 >= h ||
-            x2 < 0 || x2 >= w || y2 < 0 || y2 >= h)
-            return luaL_error(L, "lime.graphics.lsets: out of bounds (%d,%d)-(%d,%d)", x1, y1, x2, y2);
-        s->lset((int)x1, (int)y1, (int)x2, (int)y2, on);
-    }
+    static std::vector<int> xy;
+    readInts(L, 1, n, "lsets", xy);
+    if (DrawCommands::recording()) DrawCommands::lsets(xy.data(), n / 4, on, width, cap);
+    else requireScreen(L)->lsets(xy.data(), n / 4, on, width, cap);
     return 0;
 }
 
@@ -637,35 +782,18 @@ int LuaHost::l_graphics_lsetsc(lua_State* L)
 {
     luaL_checktype(L, 1, LUA_TTABLE);
     bool on = lua_isnone(L, 2) ? true : (lua_toboolean(L, 2) != 0);
+    int width = checkLineWidth(L, 3, "lsetsc");
+    Screen::LineJoin join = checkLineJoin(L, 4);
+    Screen::LineCap cap = checkLineCap(L, 5);
 
     int n = (int)lua_rawlen(L, 1);
     if ((n % 2) != 0) return luaL_error(L, "lime.graphics.lsetsc: coordinate list length must be even");
     if (n < 4) return 0;
 
-    Screen* s = requireScreen(L);
-    int w{ Screen::width }, h{ Screen::height };
-
-    lua_Integer px, py;
-    getIntFromArrayTable(L, 1, 1, &px);
-    getIntFromArrayTable(L, 1, 2, &py);
-    if (px < 0 || px >= w || py < 0 || py >= h)
-    {
-        lua_Integer x, y;
-        getIntFromArrayTable(L, 1, 3, &x);
-        getIntFromArrayTable(L, 1, 4, &y);
-        return luaL_error(L, "lime.graphics.lsetsc: out of bounds (%d,%d)-(%d,%d)", px, py, x, y);
-    }
-
-    for (int i = 3; i <= n; i += 2)
-    {
-        lua_Integer x, y;
-        getIntFromArrayTable(L, 1, i, &x);
-        getIntFromArrayTable(L, 1, i + 1, &y);
-        if (x < 0 || x >= w || y < 0 || y >= h)
-            return luaL_error(L, "lime.graphics.lsetsc: out of bounds (%d,%d)-(%d,%d)", px, py, x, y);
-        s->lset((int)px, (int)py, (int)x, (int)y, on);
-        px = x; py = y;
-    }
+    static std::vector<int> xy;
+    readInts(L, 1, n, "lsetsc", xy);
+    if (DrawCommands::recording()) DrawCommands::lsetsc(xy.data(), n / 2, on, width, join, cap);
+    else requireScreen(L)->lsetsc(xy.data(), n / 2, on, width, join, cap);
     return 0;
 }
 
@@ -677,11 +805,8 @@ int LuaHost::l_graphics_rset(lua_State* L)
     int h = (int)luaL_checkinteger(L, 4);
     bool solid = lua_isnone(L, 5) ? true : (lua_toboolean(L, 5) != 0);
     bool on = lua_isnone(L, 6) ? true : (lua_toboolean(L, 6) != 0);
-    if (w < 0) x -= (w = -w);
-    if (h < 0) y -= (h = -h);
-    if (x < 0 || (x + w - 1) >= Screen::width || y < 0 || (y + h - 1) >= Screen::height)
-        return luaL_error(L, "lime.graphics.rset: out of bounds (%d,%d)-(%d,%d)", x, y, x + w - 1, y + h - 1);
-    requireScreen(L)->rset(x, y, w, h, solid, on);
+    if (DrawCommands::recording()) DrawCommands::rset(x, y, w, h, solid, on);
+    else requireScreen(L)->rset(x, y, w, h, solid, on);
     return 0;
 }
 
@@ -692,11 +817,8 @@ int LuaHost::l_graphics_ron(lua_State* L)
     int w = (int)luaL_checkinteger(L, 3);
     int h = (int)luaL_checkinteger(L, 4);
     bool solid = lua_isnone(L, 5) ? true : (lua_toboolean(L, 5) != 0);
-    if (w < 0) x -= (w = -w);
-    if (h < 0) y -= (h = -h);
-    if (x < 0 || (x + w - 1) >= Screen::width || y < 0 || (y + h - 1) >= Screen::height)
-        return luaL_error(L, "lime.graphics.ron: out of bounds (%d,%d)-(%d,%d)", x, y, x + w - 1, y + h - 1);
-    requireScreen(L)->ron(x, y, w, h, solid);
+    if (DrawCommands::recording()) DrawCommands::rset(x, y, w, h, solid, true);
+    else requireScreen(L)->ron(x, y, w, h, solid);
     return 0;
 }
 
@@ -707,11 +829,8 @@ int LuaHost::l_graphics_roff(lua_State* L)
     int w = (int)luaL_checkinteger(L, 3);
     int h = (int)luaL_checkinteger(L, 4);
     bool solid = lua_isnone(L, 5) ? true : (lua_toboolean(L, 5) != 0);
-    if (w < 0) x -= (w = -w);
-    if (h < 0) y -= (h = -h);
-    if (x < 0 || (x + w - 1) >= Screen::width || y < 0 || (y + h - 1) >= Screen::height)
-        return luaL_error(L, "lime.graphics.roff: out of bounds (%d,%d)-(%d,%d)", x, y, x + w - 1, y + h - 1);
-    requireScreen(L)->roff(x, y, w, h, solid);
+    if (DrawCommands::recording()) DrawCommands::rset(x, y, w, h, solid, false);
+    else requireScreen(L)->roff(x, y, w, h, solid);
     return 0;
 }
 
@@ -722,15 +841,8 @@ int LuaHost::l_graphics_cset(lua_State* L)
     int size = (int)luaL_checkinteger(L, 3);
     bool solid = lua_isnone(L, 4) ? true : (lua_toboolean(L, 4) != 0);
     bool on = lua_isnone(L, 5) ? true : (lua_toboolean(L, 5) != 0);
-    if (size < 0)
-    {
-        x += size;
-        y += size;
-        size = -size;
-    }
-    if (x < 0 || (x + size - 1) >= Screen::width || y < 0 || (y + size - 1) >= Screen::height)
-        return luaL_error(L, "lime.graphics.cset: out of bounds (%d,%d)-(%d,%d)", x, y, x + size - 1, y + size - 1);
-    requireScreen(L)->cset(x, y, size, solid, on);
+    if (DrawCommands::recording()) DrawCommands::eset(x, y, size, size, solid, on);
+    else requireScreen(L)->cset(x, y, size, solid, on);
     return 0;
 }
 
@@ -740,15 +852,8 @@ int LuaHost::l_graphics_con(lua_State* L)
     int y = (int)luaL_checkinteger(L, 2);
     int size = (int)luaL_checkinteger(L, 3);
     bool solid = lua_isnone(L, 4) ? true : (lua_toboolean(L, 4) != 0);
-    if (size < 0)
-    {
-        x += size;
-        y += size;
-        size = -size;
-    }
-    if (x < 0 || (x + size - 1) >= Screen::width || y < 0 || (y + size - 1) >= Screen::height)
-        return luaL_error(L, "lime.graphics.con: out of bounds (%d,%d)-(%d,%d)", x, y, x + size - 1, y + size - 1);
-    requireScreen(L)->con(x, y, size, solid);
+    if (DrawCommands::recording()) DrawCommands::eset(x, y, size, size, solid, true);
+    else requireScreen(L)->con(x, y, size, solid);
     return 0;
 }
 
@@ -758,15 +863,8 @@ int LuaHost::l_graphics_coff(lua_State* L)
     int y = (int)luaL_checkinteger(L, 2);
     int size = (int)luaL_checkinteger(L, 3);
     bool solid = lua_isnone(L, 4) ? true : (lua_toboolean(L, 4) != 0);
-    if (size < 0)
-    {
-        x += size;
-        y += size;
-        size = -size;
-    }
-    if (x < 0 || (x + size - 1) >= Screen::width || y < 0 || (y + size - 1) >= Screen::height)
-        return luaL_error(L, "lime.graphics.coff: out of bounds (%d,%d)-(%d,%d)", x, y, x + size - 1, y + size - 1);
-    requireScreen(L)->coff(x, y, size, solid);
+    if (DrawCommands::recording()) DrawCommands::eset(x, y, size, size, solid, false);
+    else requireScreen(L)->coff(x, y, size, solid);
     return 0;
 }
 
@@ -778,11 +876,8 @@ int LuaHost::l_graphics_eset(lua_State* L)
     int h = (int)luaL_checkinteger(L, 4);
     bool solid = lua_isnone(L, 5) ? true : (lua_toboolean(L, 5) != 0);
     bool on = lua_isnone(L, 6) ? true : (lua_toboolean(L, 6) != 0);
-    if (w < 0) x -= (w = -w);
-    if (h < 0) y -= (h = -h);
-    if (x < 0 || (x + w - 1) >= Screen::width || y < 0 || (y + h - 1) >= Screen::height)
-        return luaL_error(L, "lime.graphics.eset: out of bounds (%d,%d)-(%d,%d)", x, y, x + w - 1, y + h - 1);
-    requireScreen(L)->eset(x, y, w, h, solid, on);
+    if (DrawCommands::recording()) DrawCommands::eset(x, y, w, h, solid, on);
+    else requireScreen(L)->eset(x, y, w, h, solid, on);
     return 0;
 }
 
@@ -793,11 +888,8 @@ int LuaHost::l_graphics_eon(lua_State* L)
     int w = (int)luaL_checkinteger(L, 3);
     int h = (int)luaL_checkinteger(L, 4);
     bool solid = lua_isnone(L, 5) ? true : (lua_toboolean(L, 5) != 0);
-    if (w < 0) x -= (w = -w);
-    if (h < 0) y -= (h = -h);
-    if (x < 0 || (x + w - 1) >= Screen::width || y < 0 || (y + h - 1) >= Screen::height)
-        return luaL_error(L, "lime.graphics.eon: out of bounds (%d,%d)-(%d,%d)", x, y, x + w - 1, y + h - 1);
-    requireScreen(L)->eon(x, y, w, h, solid);
+    if (DrawCommands::recording()) DrawCommands::eset(x, y, w, h, solid, true);
+    else requireScreen(L)->eon(x, y, w, h, solid);
     return 0;
 }
 
@@ -808,11 +900,226 @@ int LuaHost::l_graphics_eoff(lua_State* L)
     int w = (int)luaL_checkinteger(L, 3);
     int h = (int)luaL_checkinteger(L, 4);
     bool solid = lua_isnone(L, 5) ? true : (lua_toboolean(L, 5) != 0);
-    if (w < 0) x -= (w = -w);
-    if (h < 0) y -= (h = -h);
-    if (x < 0 || (x + w - 1) >= Screen::width || y < 0 || (y + h - 1) >= Screen::height)
-        return luaL_error(L, "lime.graphics.eoff: out of bounds (%d,%d)-(%d,%d)", x, y, x + w - 1, y + h - 1);
-    requireScreen(L)->eoff(x, y, w, h, solid);
+    if (DrawCommands::recording()) DrawCommands::eset(x, y, w, h, solid, false);
+    else requireScreen(L)->eoff(x, y, w, h, solid);
+    return 0;
+}
+
+// Reads a flat {x1,y1,x2,y2,...} table into xy (reused between calls), returns the number of points
+static int readPolygon(lua_State* L, int idx, const char* fname, std::vector<int>& xy)
+{
+    luaL_checktype(L, idx, LUA_TTABLE);
+    int n = (int)lua_rawlen(L, idx);
+    if ((n % 2) != 0) return luaL_error(L, "lime.graphics.%s: coordinate list length must be even", fname);
+
+    xy.resize(n);
+    for (int i = 1; i <= n; i++)
+    {
+        lua_Integer v;
+        getIntFromArrayTable(L, idx, i, &v);
+        if (v < -Screen::MAX_POLY_COORD || v > Screen::MAX_POLY_COORD)
+            return luaL_error(L, "lime.graphics.%s: coordinate out of range (%d)", fname, (int)v);
+        xy[i - 1] = (int)v;
+    }
+    return n / 2;
+}
+
+static Screen::FillRule checkFillRule(lua_State* L, int idx)
+{
+    static const char* const rules[] = { "evenodd", "nonzero", nullptr };
+    return luaL_checkoption(L, idx, "evenodd", rules) ? Screen::FillRule::NonZero : Screen::FillRule::EvenOdd;
+}
+
+int LuaHost::l_graphics_polyset(lua_State* L)
+{
+    static std::vector<int> xy;
+    int n = readPolygon(L, 1, "polyset", xy);
+    bool solid = lua_isnone(L, 2) ? true : (lua_toboolean(L, 2) != 0);
+    bool on = lua_isnone(L, 3) ? true : (lua_toboolean(L, 3) != 0);
+    Screen::FillRule rule = checkFillRule(L, 4);
+    if (DrawCommands::recording()) DrawCommands::polyset(xy.data(), n, solid, on, rule);
+    else requireScreen(L)->polyset(xy.data(), n, solid, on, rule);
+    return 0;
+}
+
+int LuaHost::l_graphics_polyon(lua_State* L)
+{
+    static std::vector<int> xy;
+    int n = readPolygon(L, 1, "polyon", xy);
+    bool solid = lua_isnone(L, 2) ? true : (lua_toboolean(L, 2) != 0);
+    Screen::FillRule rule = checkFillRule(L, 3);
+    if (DrawCommands::recording()) DrawCommands::polyset(xy.data(), n, solid, true, rule);
+    else requireScreen(L)->polyon(xy.data(), n, solid, rule);
+    return 0;
+}
+
+int LuaHost::l_graphics_polyoff(lua_State* L)
+{
+    static std::vector<int> xy;
+    int n = readPolygon(L, 1, "polyoff", xy);
+    bool solid = lua_isnone(L, 2) ? true : (lua_toboolean(L, 2) != 0);
+    Screen::FillRule rule = checkFillRule(L, 3);
+    if (DrawCommands::recording()) DrawCommands::polyset(xy.data(), n, solid, false, rule);
+    else requireScreen(L)->polyoff(xy.data(), n, solid, rule);
+    return 0;
+}
+
+int LuaHost::l_graphics_tset(lua_State* L)
+{
+    int xy[6];
+    for (int i = 0; i < 6; i++)
+    {
+        lua_Integer v = luaL_checkinteger(L, i + 1);
+        if (v < -Screen::MAX_POLY_COORD || v > Screen::MAX_POLY_COORD)
+            return luaL_error(L, "lime.graphics.tset: coordinate out of range (%d)", (int)v);
+        xy[i] = (int)v;
+    }
+    bool solid = lua_isnone(L, 7) ? true : (lua_toboolean(L, 7) != 0);
+    bool on = lua_isnone(L, 8) ? true : (lua_toboolean(L, 8) != 0);
+    if (DrawCommands::recording()) DrawCommands::polyset(xy, 3, solid, on, Screen::FillRule::EvenOdd);
+    else requireScreen(L)->tset(xy[0], xy[1], xy[2], xy[3], xy[4], xy[5], solid, on);
+    return 0;
+}
+
+int LuaHost::l_graphics_ton(lua_State* L)
+{
+    int xy[6];
+    for (int i = 0; i < 6; i++)
+    {
+        lua_Integer v = luaL_checkinteger(L, i + 1);
+        if (v < -Screen::MAX_POLY_COORD || v > Screen::MAX_POLY_COORD)
+            return luaL_error(L, "lime.graphics.ton: coordinate out of range (%d)", (int)v);
+        xy[i] = (int)v;
+    }
+    bool solid = lua_isnone(L, 7) ? true : (lua_toboolean(L, 7) != 0);
+    if (DrawCommands::recording()) DrawCommands::polyset(xy, 3, solid, true, Screen::FillRule::EvenOdd);
+    else requireScreen(L)->ton(xy[0], xy[1], xy[2], xy[3], xy[4], xy[5], solid);
+    return 0;
+}
+
+int LuaHost::l_graphics_toff(lua_State* L)
+{
+    int xy[6];
+    for (int i = 0; i < 6; i++)
+    {
+        lua_Integer v = luaL_checkinteger(L, i + 1);
+        if (v < -Screen::MAX_POLY_COORD || v > Screen::MAX_POLY_COORD)
+            return luaL_error(L, "lime.graphics.toff: coordinate out of range (%d)", (int)v);
+        xy[i] = (int)v;
+    }
+    bool solid = lua_isnone(L, 7) ? true : (lua_toboolean(L, 7) != 0);
+    if (DrawCommands::recording()) DrawCommands::polyset(xy, 3, solid, false, Screen::FillRule::EvenOdd);
+    else requireScreen(L)->toff(xy[0], xy[1], xy[2], xy[3], xy[4], xy[5], solid);
+    return 0;
+}
+
+static int checkConnectivity(lua_State* L, int idx, const char* fname)
+{
+    lua_Integer connectivity = luaL_optinteger(L, idx, 4);
+    if (connectivity != 4 && connectivity != 8)
+        return luaL_error(L, "lime.graphics.%s: connectivity must be 4 or 8", fname);
+    return (int)connectivity;
+}
+
+int LuaHost::l_graphics_fset(lua_State* L)
+{
+    int x = (int)luaL_checkinteger(L, 1);
+    int y = (int)luaL_checkinteger(L, 2);
+    bool on = lua_isnone(L, 3) ? true : (lua_toboolean(L, 3) != 0);
+    int connectivity = checkConnectivity(L, 4, "fset");
+    lua_pushinteger(L, requireScreen(L)->fset(x, y, on, connectivity));
+    return 1;
+}
+
+int LuaHost::l_graphics_fon(lua_State* L)
+{
+    int x = (int)luaL_checkinteger(L, 1);
+    int y = (int)luaL_checkinteger(L, 2);
+    int connectivity = checkConnectivity(L, 3, "fon");
+    lua_pushinteger(L, requireScreen(L)->fon(x, y, connectivity));
+    return 1;
+}
+
+int LuaHost::l_graphics_foff(lua_State* L)
+{
+    int x = (int)luaL_checkinteger(L, 1);
+    int y = (int)luaL_checkinteger(L, 2);
+    int connectivity = checkConnectivity(L, 3, "foff");
+    lua_pushinteger(L, requireScreen(L)->foff(x, y, connectivity));
+    return 1;
+}
+
+int LuaHost::l_graphics_pushClip(lua_State* L)
+{
+    int x = (int)luaL_checkinteger(L, 1);
+    int y = (int)luaL_checkinteger(L, 2);
+    int w = (int)luaL_checkinteger(L, 3);
+    int h = (int)luaL_checkinteger(L, 4);
+    if (Screen::clip_depth == Screen::MAX_CLIP_DEPTH)
+        return luaL_error(L, "lime.graphics.pushClip: clip stack overflow (max depth %d)", Screen::MAX_CLIP_DEPTH);
+    Screen::pushClip(x, y, w, h);
+    return 0;
+}
+
+int LuaHost::l_graphics_popClip(lua_State* L)
+{
+    if (!Screen::clip_depth)
+        return luaL_error(L, "lime.graphics.popClip: clip stack is empty");
+    Screen::popClip();
+    return 0;
+}
+
+int LuaHost::l_graphics_getClip(lua_State* L)
+{
+    const Screen::ClipRect& c = Screen::clip;
+    lua_pushinteger(L, c.x1);
+    lua_pushinteger(L, c.y1);
+    lua_pushinteger(L, max(c.x2 - c.x1 + 1, 0));
+    lua_pushinteger(L, max(c.y2 - c.y1 + 1, 0));
+    return 4;
+}
+
+int LuaHost::l_graphics_setPattern(lua_State* L)
+{
+    static const char* const anchors[] = { "screen", "shape", nullptr };
+    Screen::PatternAnchor anchor = (Screen::PatternAnchor)luaL_checkoption(L, 2, "screen", anchors);
+
+    if (lua_isnoneornil(L, 1))
+    {
+        Screen::resetPattern();
+    }
+    else if (lua_type(L, 1) == LUA_TNUMBER)
+    {
+        lua_Integer level = lua_tointeger(L, 1);
+        if (level < 0 || level > Screen::DITHER_LEVELS)
+            return luaL_error(L, "lime.graphics.setPattern: dither level must be 0-%d", Screen::DITHER_LEVELS);
+        Screen::setDither((int)level, anchor);
+    }
+    else
+    {
+        luaL_checktype(L, 1, LUA_TTABLE);
+        if (lua_rawlen(L, 1) != 8)
+            return luaL_error(L, "lime.graphics.setPattern: pattern must have 8 rows");
+
+        unsigned char rows[8];
+        for (int i = 0; i < 8; i++)
+        {
+            lua_Integer v;
+            getIntFromArrayTable(L, 1, i + 1, &v);
+            if (v < 0 || v > 255)
+                return luaL_error(L, "lime.graphics.setPattern: row %d out of range (0-255)", i + 1);
+            rows[i] = (unsigned char)v;
+        }
+        Screen::setPattern(rows, anchor);
+    }
+    return 0;
+}
+
+int LuaHost::l_graphics_setDeferred(lua_State* L)
+{
+    luaL_checkany(L, 1);
+    DrawCommands::flush();
+    DrawCommands::enabled = lua_toboolean(L, 1) != 0;
     return 0;
 }
 
@@ -824,248 +1131,1034 @@ int LuaHost::l_graphics_locate(lua_State* L)
     return 0;
 }
 
-int LuaHost::l_graphics_print(lua_State* L)
+int LuaHost::l_graphics_print(lua_State* L)
+{
+    bool inverted = lua_toboolean(L, 2) != 0;
+
+    Screen* s = requireScreen(L);
+    if (lua_type(L, 1) == LUA_TNUMBER)
+    {
+        int glyph = (int)luaL_checkinteger(L, 1);
+        if (glyph < 0 || glyph >= (Screen::font)->num_glyphs)
+            return luaL_error(L, "lime.graphics.print: invalid glyph index (%d)", glyph);
+        s->print(glyph, inverted);
+    }
+    else
+    {
+        const char* text = luaL_checkstring(L, 1);
+        s->print(text, inverted);
+    }
+    return 0;
+}
+
+int LuaHost::l_graphics_repeat(lua_State* L)
+{
+    int glyph = (int)luaL_checkinteger(L, 1);
+    int n = (int)luaL_checkinteger(L, 2);
+    bool inverted = lua_toboolean(L, 3) != 0;
+    requireScreen(L)->repeat(glyph, n, inverted);
+    return 0;
+}
+
+int LuaHost::l_graphics_center(lua_State* L)
+{
+    const char* text = luaL_checkstring(L, 1);
+    int row = (int)luaL_checkinteger(L, 2);
+    bool inverted = lua_toboolean(L, 3) != 0;
+    requireScreen(L)->center(text, row, inverted);
+    return 0;
+}
+
+int LuaHost::l_graphics_wrap(lua_State* L)
+{
+    const char* text = luaL_checkstring(L, 1);
+    int max_rows = (int)luaL_checkinteger(L, 2);
+    int max_cols = (int)luaL_checkinteger(L, 3);
+    int scrolling = lua_isnone(L, 4) ? 0 : (int)luaL_checkinteger(L, 4);
+    bool convert = lua_isnone(L, 5) ? true : (lua_toboolean(L, 5) != 0);
+    bool test = lua_toboolean(L, 6) != 0;
+
+    int lines = requireScreen(L)->wrap(text, max_rows, max_cols, scrolling, convert, test);
+
+    lua_pushinteger(L, lines);
+    lua_pushinteger(L, scrolling);
+    return 2;
+}
+
+int LuaHost::l_graphics_printInt(lua_State* L)
+{
+    int n = (int)luaL_checkinteger(L, 1);
+    bool inverted = lua_toboolean(L, 2) != 0;
+    requireScreen(L)->printInt(n, inverted);
+    return 0;
+}
+
+int LuaHost::l_graphics_textFill(lua_State* L)
+{
+    int row = (int)luaL_checkinteger(L, 1);
+    int col = (int)luaL_checkinteger(L, 2);
+    int nrows = (int)luaL_checkinteger(L, 3);
+    int ncols = (int)luaL_checkinteger(L, 4);
+    int glyph = (int)luaL_checkinteger(L, 5);
+    bool inverted = lua_toboolean(L, 6) != 0;
+
+    if (nrows < 1 || ncols < 1)
+        return luaL_error(L, "lime.graphics.textFill: invalid size [%dx%d]", nrows, ncols);
+    if (glyph < 0 || glyph >= (Screen::font)->num_glyphs)
+        return luaL_error(L, "lime.graphics.textFill: invalid glyph index (%d)", glyph);
+
+    requireScreen(L)->textFill(row, col, nrows, ncols, glyph, inverted);
+
+    return 0;
+}
+
+int LuaHost::l_graphics_textBox(lua_State* L)
+{
+    int row = (int)luaL_checkinteger(L, 1);
+    int col = (int)luaL_checkinteger(L, 2);
+    int nrows = (int)luaL_checkinteger(L, 3);
+    int ncols = (int)luaL_checkinteger(L, 4);
+    int border_style = (int)luaL_checkinteger(L, 5);
+    int fill_glyph = lua_isnone(L, 6) ? 32 : (int)luaL_checkinteger(L, 6);
+    bool inverted = lua_toboolean(L, 7) != 0;
+
+    if (nrows < 2 || ncols < 2)
+        return luaL_error(L, "lime.graphics.textBox: invalid size [%dx%d], minimum is 2x2", nrows, ncols);
+    if (border_style < 0 || border_style > 3)
+        return luaL_error(L, "lime.graphics.textBox: invalid border style (%d), must be 0-3", border_style);
+    if (fill_glyph < 0 || fill_glyph >= (Screen::font)->num_glyphs)
+        return luaL_error(L, "lime.graphics.textBox: invalid fill glyph index (%d)", fill_glyph);
+
+    requireScreen(L)->textBox(row, col, nrows, ncols, border_style, fill_glyph, inverted);
+    return 0;
+}
+
+int LuaHost::l_graphics_textScrollbarV(lua_State* L)
+{
+    int row = (int)luaL_checkinteger(L, 1);
+    int col = (int)luaL_checkinteger(L, 2);
+    int length = (int)luaL_checkinteger(L, 3);
+    int current_scroll = (int)luaL_checkinteger(L, 4);
+    int max_scroll = (int)luaL_checkinteger(L, 5);
+    int visible_rows = (int)luaL_checkinteger(L, 6);
+
+    if (length <= 0 || max_scroll <= 0 || visible_rows <= 0)
+        return luaL_error(L, "lime.graphics.textScrollbarV: invalid params (length=%d, max_scroll=%d, visible_rows=%d)",
+            length, max_scroll, visible_rows);
+
+    requireScreen(L)->scrollbarV(row, col, length, current_scroll, max_scroll, visible_rows);
+    return 0;
+}
+
+int LuaHost::l_graphics_textScrollbarH(lua_State* L)
+{
+    int row = (int)luaL_checkinteger(L, 1);
+    int col = (int)luaL_checkinteger(L, 2);
+    int length = (int)luaL_checkinteger(L, 3);
+    int current_scroll = (int)luaL_checkinteger(L, 4);
+    int max_scroll = (int)luaL_checkinteger(L, 5);
+    int visible_cols = (int)luaL_checkinteger(L, 6);
+
+    if (length <= 0 || max_scroll <= 0 || visible_cols <= 0)
+        return luaL_error(L, "lime.graphics.textScrollbarH: invalid params (length=%d, max_scroll=%d, visible_cols=%d)",
+            length, max_scroll, visible_cols);
+
+    requireScreen(L)->scrollbarH(row, col, length, current_scroll, max_scroll, visible_cols);
+    return 0;
+}
+
+static std::vector<unsigned char> parseByteData(lua_State* L, int idx)
+{
+    if (lua_type(L, idx) == LUA_TSTRING)
+    {
+        size_t len = 0;
+        const char* s = lua_tolstring(L, idx, &len);
+        return std::vector<unsigned char>((const unsigned char*)s, (const unsigned char*)s + len);
+    }
+
+    if (lua_type(L, idx) == LUA_TTABLE)
+    {
+        int n = (int)lua_rawlen(L, idx);
+        std::vector<unsigned char> out;
+        out.reserve(n);
+
+        for (int i = 1; i <= n; i++)
+        {
+            lua_rawgeti(L, idx, i);
+            lua_Integer v = luaL_checkinteger(L, -1);
+            lua_pop(L, 1);
+
+            if (v < 0 || v > 255) luaL_error(L, "byte[%d] out of range (0..255)", (int)i);
+            out.push_back((unsigned char)v);
+        }
+        return out;
+    }
+
+    luaL_error(L, "bytes must be a string or an array table of integers");
+    return {};
+}
+
+int LuaHost::l_graphics_defineImage(lua_State* L)
+{
+    LuaHost* self = selfFromUpvalue(L);
+    DrawCommands::flush(); // Deferred blits may point at an image this replaces
+
+    const char* name = luaL_checkstring(L, 1);
+    int w = (int)luaL_checkinteger(L, 2);
+    int h = (int)luaL_checkinteger(L, 3);
+
+    if (w <= 0 || h <= 0) return luaL_error(L, "defineImage: invalid dimensions");
+    if (w % 8) return luaL_error(L, "defineImage: width must be a multiple of 8");
+
+    std::vector<unsigned char> bytes = parseByteData(L, 4);
+
+    size_t expected = (size_t)(w * h / 8);
+    if (bytes.size() != expected)
+        return luaL_error(L, "defineImage: expected %d bytes, got %d", (int)expected, (int)bytes.size());
+    if (self->isTarget(name))
+        return luaL_error(L, "defineImage: '%s' is the current render target", name);
+
+    auto owned = std::make_unique<OwnedImage>();
+    owned->bytes = std::move(bytes);
+    owned->img.width = w;
+    owned->img.height = h;
+    owned->img.pixels = owned->bytes.data();
+    owned->generation = ++self->imageGeneration;
+
+    self->images[std::string(name)] = std::move(owned);
+    return 0;
+}
+
+int LuaHost::l_graphics_image(lua_State* L)
+{
+    LuaHost* self = selfFromUpvalue(L);
+
+    const char* name = luaL_checkstring(L, 1);
+    int row = (int)luaL_checkinteger(L, 2);
+    int col = (int)luaL_checkinteger(L, 3);
+    bool draw_bg = lua_isnone(L, 4) ? true : (lua_toboolean(L, 4) != 0);
+    int dy = (int)luaL_optinteger(L, 5, 0);
+
+    auto it = self->images.find(name);
+    if (it == self->images.end())
+        return luaL_error(L, "Unknown image '%s' (did you call lime.graphics.defineImage?)", name);
+    if (self->isTarget(name))
+        return luaL_error(L, "lime.graphics.image: cannot draw '%s' onto itself", name);
+
+    requireScreen(L)->image(&it->second->img, row, col, draw_bg, dy);
+    return 0;
+}
+
+// ============================================================================
+// Layers
+// ============================================================================
+// Layer draw functions live in a registry table indexed like the layers (1-based)
+
+static const char* const LAYER_FUNCTIONS = "lime.layers";
+
+static int checkLayerIndex(lua_State* L, int idx)
+{
+    int index = (int)luaL_checkinteger(L, idx);
+    if (index < 1 || index > Screen::MAX_LAYERS)
+        luaL_error(L, "Layer index must be 1-%d", Screen::MAX_LAYERS);
+    return index;
+}
+
+int LuaHost::l_graphics_setLayer(lua_State* L)
+{
+    LuaHost* self = selfFromUpvalue(L);
+
+    static const char* const modes[] = { "or", "and", "xor", "andnot", "replace", nullptr };
+    static const CanvasKernels::Op ops[] = {
+        CanvasKernels::Op::Or, CanvasKernels::Op::And, CanvasKernels::Op::Xor,
+        CanvasKernels::Op::AndNot, CanvasKernels::Op::Copy
+    };
+
+    int index = checkLayerIndex(L, 1);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    int mode = luaL_checkoption(L, 3, "or", modes);
+
+    const Image* mask = nullptr;
+    if (!lua_isnoneornil(L, 4))
+    {
+        if (ops[mode] != CanvasKernels::Op::Copy)
+            return luaL_error(L, "setLayer: a mask requires mode \"replace\"");
+        mask = self->findImage(L, 4);
+        if (mask->width != Screen::canvas_width || mask->height != Screen::canvas_height)
+            return luaL_error(L, "setLayer: mask size %dx%d does not match canvas size %dx%d",
+                mask->width, mask->height, Screen::canvas_width, Screen::canvas_height);
+    }
+
+    lua_getfield(L, LUA_REGISTRYINDEX, LAYER_FUNCTIONS);
+    if (lua_isnil(L, -1))
+    {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_setfield(L, LUA_REGISTRYINDEX, LAYER_FUNCTIONS);
+    }
+    lua_pushvalue(L, 2);
+    lua_rawseti(L, -2, index);
+    lua_pop(L, 1);
+
+    requireScreen(L)->setLayer(index - 1, ops[mode], mask);
+    return 0;
+}
+
+int LuaHost::l_graphics_removeLayer(lua_State* L)
+{
+    int index = checkLayerIndex(L, 1);
+    requireScreen(L)->removeLayer(index - 1);
+    return 0;
+}
+
+int LuaHost::l_graphics_showLayer(lua_State* L)
+{
+    int index = checkLayerIndex(L, 1);
+    luaL_checkany(L, 2);
+    requireScreen(L)->showLayer(index - 1, lua_toboolean(L, 2) != 0);
+    return 0;
+}
+
+int LuaHost::l_graphics_redrawLayer(lua_State* L)
+{
+    int index = checkLayerIndex(L, 1);
+    requireScreen(L)->redrawLayer(index - 1);
+    return 0;
+}
+
+// The current render target viewed as an Image
+static Image currentTarget()
+{
+    Image target;
+    target.width = Screen::width;
+    target.height = Screen::height;
+    target.pixels = Screen::pixels;
+    return target;
+}
+
+static CanvasKernels::Op checkBlitMode(lua_State* L, int idx)
+{
+    static const char* const modes[] = { "copy", "or", "and", "xor", "andnot", nullptr };
+    static const CanvasKernels::Op ops[] = {
+        CanvasKernels::Op::Copy, CanvasKernels::Op::Or, CanvasKernels::Op::And,
+        CanvasKernels::Op::Xor, CanvasKernels::Op::AndNot
+    };
+    return ops[luaL_checkoption(L, idx, "copy", modes)];
+}
+
+int LuaHost::l_graphics_blit(lua_State* L)
+{
+    LuaHost* self = selfFromUpvalue(L);
+
+    const char* name = luaL_checkstring(L, 1);
+    int x = (int)luaL_checkinteger(L, 2);
+    int y = (int)luaL_checkinteger(L, 3);
+    CanvasKernels::Op op = checkBlitMode(L, 4);
+    const char* mask_name = luaL_optstring(L, 5, nullptr);
+
+    auto it = self->images.find(name);
+    if (it == self->images.end())
+        return luaL_error(L, "Unknown image '%s' (did you call lime.graphics.defineImage?)", name);
+    Image* img = &it->second->img;
+    if (self->isTarget(name))
+        return luaL_error(L, "lime.graphics.blit: cannot draw '%s' onto itself", name);
+
+    Image* mask = nullptr;
+    if (mask_name)
+    {
+        auto mit = self->images.find(mask_name);
+        if (mit == self->images.end())
+            return luaL_error(L, "Unknown mask image '%s' (did you call lime.graphics.defineImage?)", mask_name);
+        mask = &mit->second->img;
+        if (self->isTarget(mask_name))
+            return luaL_error(L, "lime.graphics.blit: cannot use '%s' as a mask while drawing onto it", mask_name);
+        if (mask->width != img->width || mask->height != img->height)
+            return luaL_error(L, "lime.graphics.blit: mask size %dx%d does not match image size %dx%d",
+                mask->width, mask->height, img->width, img->height);
+    }
+
+    if (DrawCommands::recording()) DrawCommands::blit(img, x, y, op, mask);
+    else requireScreen(L)->blit(img, x, y, op, mask);
+    return 0;
+}
+
+int LuaHost::l_graphics_transformImage(lua_State* L)
+{
+    LuaHost* self = selfFromUpvalue(L);
+    DrawCommands::flush(); // Deferred blits may point at an image this replaces
+
+    enum { FlipX, FlipY, Rot90, Rot180, Rot270, Scale, Resize };
+    static const char* const transforms[] = { "flipx", "flipy", "rot90", "rot180", "rot270", "scale", "resize", nullptr };
+
+    const char* name = luaL_checkstring(L, 1);
+    int transform = luaL_checkoption(L, 2, nullptr, transforms);
+
+    auto it = self->images.find(name);
+    if (it == self->images.end())
+        return luaL_error(L, "Unknown image '%s' (did you call lime.graphics.defineImage?)", name);
+    const OwnedImage& source = *it->second;
+
+    // Size of the result; parameterized transforms get the parameters in their handle
+    std::string key = std::string(name) + "@" + transforms[transform];
+    const long long maxSide = 65536;
+    long long w = source.img.width, h = source.img.height;
+    if (transform == Rot90 || transform == Rot270)
+    {
+        w = ImageTransform::rotatedWidth(source.img);
+        h = source.img.width;
+    }
+    else if (transform == Scale || transform == Resize)
+    {
+        long long a = luaL_checkinteger(L, 3);
+        long long b = transform == Scale ? luaL_optinteger(L, 4, a) : luaL_checkinteger(L, 4);
+        if (a <= 0 || b <= 0) return luaL_error(L, "transformImage: %s parameters must be positive", transforms[transform]);
+        if (transform == Resize && a % 8) return luaL_error(L, "transformImage: width must be a multiple of 8");
+        // Checked before multiplying: a and b are unbounded Lua integers
+        if (transform == Scale ? (w && a > maxSide / w) || (h && b > maxSide / h) : a > maxSide || b > maxSide)
+            return luaL_error(L, "transformImage: result is too large");
+        w = transform == Scale ? w * a : a;
+        h = transform == Scale ? h * b : b;
+        key += std::to_string(a) + "x" + std::to_string(b);
+    }
+    if (w > maxSide || h > maxSide || w * h > (1LL << 28))
+        return luaL_error(L, "transformImage: result is too large");
+
+    // The cached result stays valid while the source keeps its generation; a source that is the
+    // current render target may still change, so results made from it are never reused
+    auto cached = self->images.find(key);
+    bool source_is_target = self->isTarget(name);
+    if (cached != self->images.end() && !source_is_target && cached->second->sourceGeneration == source.generation)
+    {
+        lua_pushstring(L, key.c_str());
+        return 1;
+    }
+    if (self->isTarget(key))
+        return luaL_error(L, "transformImage: '%s' is the current render target", key.c_str());
+
+    auto owned = std::make_unique<OwnedImage>();
+    owned->bytes.assign((size_t)(w * h / 8), 0);
+    owned->img.width = (int)w;
+    owned->img.height = (int)h;
+    owned->img.pixels = owned->bytes.data();
+    owned->generation = ++self->imageGeneration;
+    owned->sourceGeneration = source_is_target ? 0 : source.generation;
+
+    unsigned char* dst = owned->bytes.data();
+    switch (transform)
+    {
+    case FlipX: ImageTransform::flipX(source.img, dst); break;
+    case FlipY: ImageTransform::flipY(source.img, dst); break;
+    case Rot90: ImageTransform::rotate90(source.img, dst); break;
+    case Rot180: ImageTransform::rotate180(source.img, dst); break;
+    case Rot270: ImageTransform::rotate270(source.img, dst); break;
+    default: ImageTransform::scale(source.img, dst, (int)w, (int)h); break;
+    }
+
+    self->images[key] = std::move(owned);
+    lua_pushstring(L, key.c_str());
+    return 1;
+}
+
+int LuaHost::l_graphics_blitRect(lua_State* L)
+{
+    LuaHost* self = selfFromUpvalue(L);
+
+    int sx = (int)luaL_checkinteger(L, 1);
+    int sy = (int)luaL_checkinteger(L, 2);
+    int w = (int)luaL_checkinteger(L, 3);
+    int h = (int)luaL_checkinteger(L, 4);
+    int x = (int)luaL_checkinteger(L, 5);
+    int y = (int)luaL_checkinteger(L, 6);
+    CanvasKernels::Op op = checkBlitMode(L, 7);
+
+    // The current target may be its own source (copies behave like memmove)
+    Image target = currentTarget();
+    const Image* source = lua_isnoneornil(L, 8) ? &target : self->findImage(L, 8);
+
+    requireScreen(L)->blitRect(source, sx, sy, w, h, x, y, op);
+    return 0;
+}
+
+int LuaHost::l_graphics_scroll(lua_State* L)
+{
+    int dx = (int)luaL_checkinteger(L, 1);
+    int dy = (int)luaL_checkinteger(L, 2);
+    bool fill_on = lua_toboolean(L, 3) != 0;
+
+    Screen* screen = requireScreen(L);
+    if (lua_isnoneornil(L, 4))
+    {
+        screen->scroll(dx, dy, fill_on);
+        return 0;
+    }
+
+    int x = (int)luaL_checkinteger(L, 4);
+    int y = (int)luaL_checkinteger(L, 5);
+    int w = (int)luaL_checkinteger(L, 6);
+    int h = (int)luaL_checkinteger(L, 7);
+    screen->scroll(x, y, w, h, dx, dy, fill_on);
+    return 0;
+}
+
+bool LuaHost::isTarget(const std::string& name) const
+{
+    auto it = images.find(name);
+    return Screen::offscreen && it != images.end() && it->second->bytes.data() == Screen::pixels;
+}
+
+// ============================================================================
+// Packed images
+// ============================================================================
+
+const PackedImage* LuaHost::findPackedImage(lua_State* L, int idx) const
+{
+    const char* name = luaL_checkstring(L, idx);
+    auto it = packedImages.find(name);
+    if (it == packedImages.end())
+        luaL_error(L, "Unknown packed image '%s' (did you call lime.graphics.definePackedImage?)", name);
+    return it->second.get();
+}
+
+int LuaHost::l_graphics_packImage(lua_State* L)
+{
+    LuaHost* self = selfFromUpvalue(L);
+
+    const Image* img = self->findImage(L, 1);
+    const Image* base = lua_isnoneornil(L, 2) ? nullptr : self->findImage(L, 2);
+    if (img->width > 65535 || img->height > 65535)
+        return luaL_error(L, "packImage: images larger than 65535 pixels per side cannot be packed");
+    if (base && (base->width != img->width || base->height != img->height))
+        return luaL_error(L, "packImage: base size %dx%d does not match image size %dx%d",
+            base->width, base->height, img->width, img->height);
+
+    PackedImage packed;
+    PackedImageCodec::pack(*img, base, packed);
+    std::vector<unsigned char> data;
+    PackedImageCodec::serialize(packed, data);
+
+    lua_pushlstring(L, (const char*)data.data(), data.size());
+    return 1;
+}
+
+int LuaHost::l_graphics_definePackedImage(lua_State* L)
+{
+    LuaHost* self = selfFromUpvalue(L);
+
+    const char* name = luaL_checkstring(L, 1);
+    size_t size = 0;
+    const char* data = luaL_checklstring(L, 2, &size);
+
+    auto packed = std::make_unique<PackedImage>();
+    if (const char* error = PackedImageCodec::parse((const unsigned char*)data, size, *packed))
+        return luaL_error(L, "definePackedImage: %s", error);
+
+    self->packedImages[std::string(name)] = std::move(packed);
+    return 0;
+}
+
+int LuaHost::l_graphics_blitPacked(lua_State* L)
+{
+    LuaHost* self = selfFromUpvalue(L);
+
+    const PackedImage& packed = *self->findPackedImage(L, 1);
+    int x = (int)luaL_checkinteger(L, 2);
+    int y = (int)luaL_checkinteger(L, 3);
+    CanvasKernels::Op op = checkBlitMode(L, 4);
+
+    requireScreen(L)->blitPacked(packed, x, y, op);
+    return 0;
+}
+
+int LuaHost::l_graphics_unpackImage(lua_State* L)
+{
+    LuaHost* self = selfFromUpvalue(L);
+    DrawCommands::flush(); // Deferred blits may point at an image this replaces
+
+    const PackedImage& packed = *self->findPackedImage(L, 1);
+    const char* name = luaL_checkstring(L, 2);
+    const Image* base = lua_isnoneornil(L, 3) ? nullptr : self->findImage(L, 3);
+
+    if (packed.delta && !base)
+        return luaL_error(L, "unpackImage: '%s' is a delta image and needs a base image", lua_tostring(L, 1));
+    if (base && (base->width != packed.width || base->height != packed.height))
+        return luaL_error(L, "unpackImage: base size %dx%d does not match image size %dx%d",
+            base->width, base->height, packed.width, packed.height);
+    if (self->isTarget(name))
+        return luaL_error(L, "unpackImage: '%s' is the current render target", name);
+
+    auto owned = std::make_unique<OwnedImage>();
+    if (packed.delta) owned->bytes.assign(base->pixels, base->pixels + (size_t)packed.width / 8 * packed.height);
+    else owned->bytes.resize((size_t)packed.width / 8 * packed.height);
+    PackedImageCodec::unpack(packed, owned->bytes.data());
+    owned->img.width = packed.width;
+    owned->img.height = packed.height;
+    owned->img.pixels = owned->bytes.data();
+    owned->generation = ++self->imageGeneration;
+
+    self->images[std::string(name)] = std::move(owned);
+    return 0;
+}
+
+// ============================================================================
+// Worlds
+// ============================================================================
+
+WorldBitmap* LuaHost::findWorld(lua_State* L, int idx) const
+{
+    const char* name = luaL_checkstring(L, idx);
+    auto it = worlds.find(name);
+    if (it == worlds.end())
+        luaL_error(L, "Unknown world '%s' (did you call lime.graphics.newWorld?)", name);
+    return it->second.get();
+}
+
+int LuaHost::l_graphics_newWorld(lua_State* L)
+{
+    LuaHost* self = selfFromUpvalue(L);
+
+    const char* name = luaL_checkstring(L, 1);
+    int w = (int)luaL_checkinteger(L, 2);
+    int h = (int)luaL_checkinteger(L, 3);
+    if (w <= 0 || h <= 0 || w > WorldBitmap::MAX_SIZE || h > WorldBitmap::MAX_SIZE)
+        return luaL_error(L, "newWorld: size must be 1-%d pixels per side", WorldBitmap::MAX_SIZE);
+
+    self->worlds[std::string(name)] = std::make_unique<WorldBitmap>(w, h);
+    return 0;
+}
+
+int LuaHost::l_graphics_drawWorld(lua_State* L)
+{
+    LuaHost* self = selfFromUpvalue(L);
+    DrawCommands::flush(); // Deferred calls are for the Canvas, drawn before fn changes the target
+
+    WorldBitmap* world = self->findWorld(L, 1);
+    int x = (int)luaL_checkinteger(L, 2);
+    int y = (int)luaL_checkinteger(L, 3);
+    int w = (int)luaL_checkinteger(L, 4);
+    int h = (int)luaL_checkinteger(L, 5);
+    luaL_checktype(L, 6, LUA_TFUNCTION);
+
+    if (w <= 0 || h <= 0 || w > 8192 || h > 8192) return luaL_error(L, "drawWorld: region size must be 1-8192 pixels per side");
+    if (w % 8) return luaL_error(L, "drawWorld: width must be a multiple of 8");
+    if (Screen::offscreen) // The target is reset afterwards, which would lose the current one
+        return luaL_error(L, "drawWorld: a render target is already set (call resetTarget first)");
+
+    // The region is drawn as an ordinary render target, then stored back into the tiles
+    std::vector<unsigned char> region((size_t)w / 8 * h);
+    world->read(x, y, w, h, region.data());
+
+    Screen::setTarget(region.data(), w, h);
+    lua_pushvalue(L, 6);
+    lua_call(L, 0, 0);
+    Screen::resetTarget();
+
+    // fn may have replaced the world
+    auto it = self->worlds.find(lua_tostring(L, 1));
+    if (it != self->worlds.end() && it->second.get() == world)
+        world->write(x, y, w, h, region.data());
+    return 0;
+}
+
+int LuaHost::l_graphics_blitWorld(lua_State* L)
+{
+    WorldBitmap* world = selfFromUpvalue(L)->findWorld(L, 1);
+    int cam_x = (int)luaL_checkinteger(L, 2);
+    int cam_y = (int)luaL_checkinteger(L, 3);
+    int x = (int)luaL_optinteger(L, 4, 0);
+    int y = (int)luaL_optinteger(L, 5, 0);
+    int w = (int)luaL_optinteger(L, 6, Screen::width);
+    int h = (int)luaL_optinteger(L, 7, Screen::height);
+    CanvasKernels::Op op = checkBlitMode(L, 8);
+
+    requireScreen(L)->blitWorld(*world, cam_x, cam_y, x, y, w, h, op);
+    return 0;
+}
+
+int LuaHost::l_graphics_worldTiles(lua_State* L)
+{
+    WorldBitmap* world = selfFromUpvalue(L)->findWorld(L, 1);
+    lua_pushinteger(L, world->allocatedTiles());
+    lua_pushinteger(L, (lua_Integer)world->tilesX() * world->tilesY());
+    return 2;
+}
+
+// ============================================================================
+// Snapshots
+// ============================================================================
+
+int LuaHost::l_graphics_snapshot(lua_State* L)
+{
+    LuaHost* self = selfFromUpvalue(L);
+    DrawCommands::flush(); // Reads the Canvas
+
+    std::string name;
+    const unsigned char* pixels = Screen::pixels;
+    int w = Screen::width, h = Screen::height;
+
+    if (!lua_isnoneornil(L, 1))
+    {
+        name = luaL_checkstring(L, 1);
+        const Image* img = self->findImage(L, 1);
+        pixels = img->pixels;
+        w = img->width;
+        h = img->height;
+    }
+    else if (Screen::offscreen)
+    {
+        // The current target is an image, or a buffer that cannot be restored later (a world region)
+        for (const auto& [image_name, owned] : self->images)
+            if (owned->bytes.data() == Screen::pixels) name = image_name;
+        if (name.empty()) return luaL_error(L, "snapshot: the current render target is not an image");
+    }
+
+    lua_pushinteger(L, self->snapshots.take(name, pixels, w, h));
+    return 1;
+}
+
+int LuaHost::l_graphics_restoreSnapshot(lua_State* L)
 {
-    bool inverted = lua_toboolean(L, 2) != 0;
+    LuaHost* self = selfFromUpvalue(L);
+    DrawCommands::flush(); // Writes the Canvas
 
-    Screen* s = requireScreen(L);
-    if (lua_type(L, 1) == LUA_TNUMBER)
+    int id = (int)luaL_checkinteger(L, 1);
+    const CanvasSnapshots::Snapshot* snap = self->snapshots.find(id);
+    if (!snap) return luaL_error(L, "restoreSnapshot: unknown snapshot %d", id);
+
+    unsigned char* pixels;
+    int w, h;
+    OwnedImage* owned = nullptr;
+    if (snap->canvas.empty())
     {
-        int glyph = (int)luaL_checkinteger(L, 1);
-        if (glyph < 0 || glyph >= (Screen::font)->num_glyphs)
-            return luaL_error(L, "lime.graphics.print: invalid glyph index (%d)", glyph);
-        s->print(glyph, inverted);
+        if (Screen::offscreen) return luaL_error(L, "restoreSnapshot: snapshot %d is of the main canvas (call resetTarget first)", id);
+        pixels = Screen::pixels;
+        w = Screen::width;
+        h = Screen::height;
     }
     else
     {
-        const char* text = luaL_checkstring(L, 1);
-        s->print(text, inverted);
+        auto it = self->images.find(snap->canvas);
+        if (it == self->images.end())
+            return luaL_error(L, "restoreSnapshot: image '%s' no longer exists", snap->canvas.c_str());
+        owned = it->second.get();
+        pixels = owned->bytes.data();
+        w = owned->img.width;
+        h = owned->img.height;
     }
-    return 0;
-}
+    if (w != snap->width || h != snap->height)
+        return luaL_error(L, "restoreSnapshot: canvas size %dx%d does not match snapshot size %dx%d", w, h, snap->width, snap->height);
 
-int LuaHost::l_graphics_repeat(lua_State* L)
-{
-    int glyph = (int)luaL_checkinteger(L, 1);
-    int n = (int)luaL_checkinteger(L, 2);
-    bool inverted = lua_toboolean(L, 3) != 0;
-    requireScreen(L)->repeat(glyph, n, inverted);
+    int y1, y2;
+    if (self->snapshots.restore(id, pixels, y1, y2) > 0)
+    {
+        if (owned) owned->generation = ++self->imageGeneration;
+        else Screen::markDirty(y1, y2);
+    }
     return 0;
 }
 
-int LuaHost::l_graphics_center(lua_State* L)
+int LuaHost::l_graphics_discardSnapshot(lua_State* L)
 {
-    const char* text = luaL_checkstring(L, 1);
-    int row = (int)luaL_checkinteger(L, 2);
-    bool inverted = lua_toboolean(L, 3) != 0;
-    requireScreen(L)->center(text, row, inverted);
+    selfFromUpvalue(L)->snapshots.discard((int)luaL_checkinteger(L, 1));
     return 0;
 }
 
-int LuaHost::l_graphics_wrap(lua_State* L)
+int LuaHost::l_graphics_snapshotMemory(lua_State* L)
 {
-    const char* text = luaL_checkstring(L, 1);
-    int max_rows = (int)luaL_checkinteger(L, 2);
-    int max_cols = (int)luaL_checkinteger(L, 3);
-    int scrolling = lua_isnone(L, 4) ? 0 : (int)luaL_checkinteger(L, 4);
-    bool convert = lua_isnone(L, 5) ? true : (lua_toboolean(L, 5) != 0);
-    bool test = lua_toboolean(L, 6) != 0;
-
-    int lines = requireScreen(L)->wrap(text, max_rows, max_cols, scrolling, convert, test);
-
-    lua_pushinteger(L, lines);
-    lua_pushinteger(L, scrolling);
+    LuaHost* self = selfFromUpvalue(L);
+    lua_pushinteger(L, (lua_Integer)self->snapshots.memory());
+    lua_pushinteger(L, (lua_Integer)self->snapshots.count());
     return 2;
 }
 
-int LuaHost::l_graphics_printInt(lua_State* L)
+// ============================================================================
+// Tilemaps
+// ============================================================================
+
+Tilemap* LuaHost::findTilemap(lua_State* L, int idx) const
 {
-    int n = (int)luaL_checkinteger(L, 1);
-    bool inverted = lua_toboolean(L, 2) != 0;
-    requireScreen(L)->printInt(n, inverted);
-    return 0;
+    const char* name = luaL_checkstring(L, idx);
+    auto it = tilemaps.find(name);
+    if (it == tilemaps.end())
+        luaL_error(L, "Unknown tilemap '%s' (did you call lime.graphics.newTilemap?)", name);
+    return it->second.get();
 }
 
-int LuaHost::l_graphics_textFill(lua_State* L)
+int LuaHost::l_graphics_newTilemap(lua_State* L)
 {
-    int row = (int)luaL_checkinteger(L, 1);
-    int col = (int)luaL_checkinteger(L, 2);
-    int nrows = (int)luaL_checkinteger(L, 3);
-    int ncols = (int)luaL_checkinteger(L, 4);
-    int glyph = (int)luaL_checkinteger(L, 5);
-    bool inverted = lua_toboolean(L, 6) != 0;
+    LuaHost* self = selfFromUpvalue(L);
 
-    if (nrows < 1 || ncols < 1)
-        return luaL_error(L, "lime.graphics.textFill: invalid size [%dx%d]", nrows, ncols);
-    int erow = row + nrows - 1;
-    int ecol = col + ncols - 1;
-    if (row < 0 || col < 0 || erow >= Screen::rows || ecol >= Screen::cols)
-        return luaL_error(L, "lime.graphics.textFill: out of bounds [%d,%d]-[%d,%d]", row, col, erow, ecol);
-    if (glyph < 0 || glyph >= (Screen::font)->num_glyphs)
-        return luaL_error(L, "lime.graphics.textFill: invalid glyph index (%d)", glyph);
+    const char* name = luaL_checkstring(L, 1);
+    int cols = (int)luaL_checkinteger(L, 2);
+    int rows = (int)luaL_checkinteger(L, 3);
+    luaL_checktype(L, 4, LUA_TTABLE);
+
+    if (cols <= 0 || rows <= 0 || (long long)cols * rows > (1 << 24))
+        return luaL_error(L, "newTilemap: invalid dimensions");
+    int count = (int)lua_rawlen(L, 4);
+    if (count < 1 || count > 65535) return luaL_error(L, "newTilemap: expected 1-65535 tiles, got %d", count);
+
+    auto map = std::make_unique<Tilemap>();
+    map->cols = cols;
+    map->rows = rows;
+    map->tile_count = count;
+    map->cells.assign((size_t)cols * rows, 0);
+
+    // Tiles are image handles or glyph indices; the first one sets the tile size
+    const MonospaceMonochromePixelFont& font = *Screen::font;
+    for (int i = 1; i <= count; i++)
+    {
+        lua_rawgeti(L, 4, i);
+        int w, h;
+        const unsigned char* rows_src;
+        unsigned char glyph_rows[MAX_GLYPH_HEIGHT];
+        if (lua_type(L, -1) == LUA_TNUMBER)
+        {
+            int glyph = (int)lua_tointeger(L, -1);
+            if (glyph < 0 || glyph >= font.num_glyphs)
+                return luaL_error(L, "newTilemap: tile %d: glyph index must be 0-%d", i, font.num_glyphs - 1);
+            w = font.glyph_width;
+            h = font.glyph_height;
+            memcpy(glyph_rows, font.glyphs[glyph].row, h);
+            rows_src = glyph_rows;
+        }
+        else
+        {
+            const Image* img = self->findImage(L, -1);
+            w = img->width;
+            h = img->height;
+            rows_src = img->pixels;
+        }
+        lua_pop(L, 1);
 
-    requireScreen(L)->textFill(row, col, nrows, ncols, glyph, inverted);
+        if (i == 1)
+        {
+            map->tile_width = w;
+            map->tile_height = h;
+            map->tiles.resize((size_t)count * map->tileBytes());
+        }
+        else if (w != map->tile_width || h != map->tile_height)
+            return luaL_error(L, "newTilemap: tile %d is %dx%d, expected %dx%d", i, w, h, map->tile_width, map->tile_height);
+
+        memcpy(map->tiles.data() + (size_t)(i - 1) * map->tileBytes(), rows_src, map->tileBytes());
+    }
 
+    self->tilemaps[std::string(name)] = std::move(map);
     return 0;
 }
 
-int LuaHost::l_graphics_textBox(lua_State* L)
+static int checkTileNumber(lua_State* L, int idx, const Tilemap& map)
 {
-    int row = (int)luaL_checkinteger(L, 1);
-    int col = (int)luaL_checkinteger(L, 2);
-    int nrows = (int)luaL_checkinteger(L, 3);
-    int ncols = (int)luaL_checkinteger(L, 4);
-    int border_style = (int)luaL_checkinteger(L, 5);
-    int fill_glyph = lua_isnone(L, 6) ? 32 : (int)luaL_checkinteger(L, 6);
-    bool inverted = lua_toboolean(L, 7) != 0;
-
-    if (nrows < 2 || ncols < 2)
-        return luaL_error(L, "lime.graphics.textBox: invalid size [%dx%d], minimum is 2x2", nrows, ncols);
-    if (border_style < 0 || border_style > 3)
-        return luaL_error(L, "lime.graphics.textBox: invalid border style (%d), must be 0-3", border_style);
-    int erow = row + nrows - 1;
-    int ecol = col + ncols - 1;
-    if (row < 0 || col < 0 || erow >= Screen::rows || ecol >= Screen::cols)
-        return luaL_error(L, "lime.graphics.textBox: out of bounds [%d,%d]-[%d,%d]", row, col, erow, ecol);
-    if (fill_glyph < 0 || fill_glyph >= (Screen::font)->num_glyphs)
-        return luaL_error(L, "lime.graphics.textBox: invalid fill glyph index (%d)", fill_glyph);
-
-    requireScreen(L)->textBox(row, col, nrows, ncols, border_style, fill_glyph, inverted);
-    return 0;
+    lua_Integer n = luaL_checkinteger(L, idx);
+    if (n < 0 || n > map.tile_count) luaL_error(L, "Tile number must be 0-%d", map.tile_count);
+    return (int)n;
 }
 
-int LuaHost::l_graphics_textScrollbarV(lua_State* L)
+int LuaHost::l_graphics_setTile(lua_State* L)
 {
-    int row = (int)luaL_checkinteger(L, 1);
+    Tilemap* map = selfFromUpvalue(L)->findTilemap(L, 1);
     int col = (int)luaL_checkinteger(L, 2);
-    int length = (int)luaL_checkinteger(L, 3);
-    int current_scroll = (int)luaL_checkinteger(L, 4);
-    int max_scroll = (int)luaL_checkinteger(L, 5);
-    int visible_rows = (int)luaL_checkinteger(L, 6);
-
-    if (length <= 0 || max_scroll <= 0 || visible_rows <= 0)
-        return luaL_error(L, "lime.graphics.textScrollbarV: invalid params (length=%d, max_scroll=%d, visible_rows=%d)",
-            length, max_scroll, visible_rows);
-
-    int erow = row + length - 1;
-    if (row < 0 || erow >= Screen::rows || col < 0 || col >= Screen::cols)
-        return luaL_error(L, "lime.graphics.textScrollbarV: out of bounds [%d,%d]-[%d,%d]",
-            row, col, erow, col);
+    int row = (int)luaL_checkinteger(L, 3);
+    int n = checkTileNumber(L, 4, *map);
 
-    requireScreen(L)->scrollbarV(row, col, length, current_scroll, max_scroll, visible_rows);
+    if (col < 0 || col >= map->cols || row < 0 || row >= map->rows)
+        return luaL_error(L, "setTile: cell %d,%d is outside the %dx%d map", col, row, map->cols, map->rows);
+    map->cells[(size_t)row * map->cols + col] = (uint16_t)n;
     return 0;
 }
 
-int LuaHost::l_graphics_textScrollbarH(lua_State* L)
+int LuaHost::l_graphics_getTile(lua_State* L)
 {
-    int row = (int)luaL_checkinteger(L, 1);
+    Tilemap* map = selfFromUpvalue(L)->findTilemap(L, 1);
     int col = (int)luaL_checkinteger(L, 2);
-    int length = (int)luaL_checkinteger(L, 3);
-    int current_scroll = (int)luaL_checkinteger(L, 4);
-    int max_scroll = (int)luaL_checkinteger(L, 5);
-    int visible_cols = (int)luaL_checkinteger(L, 6);
-
-    if (length <= 0 || max_scroll <= 0 || visible_cols <= 0)
-        return luaL_error(L, "lime.graphics.textScrollbarH: invalid params (length=%d, max_scroll=%d, visible_cols=%d)",
-            length, max_scroll, visible_cols);
-
-    int ecol = col + length - 1;
-    if (row < 0 || row >= Screen::rows || col < 0 || ecol >= Screen::cols)
-        return luaL_error(L, "lime.graphics.textScrollbarH: out of bounds [%d,%d]-[%d,%d]",
-            row, col, row, ecol);
+    int row = (int)luaL_checkinteger(L, 3);
 
-    requireScreen(L)->scrollbarH(row, col, length, current_scroll, max_scroll, visible_cols);
-    return 0;
+    bool inside = col >= 0 && col < map->cols && row >= 0 && row < map->rows;
+    lua_pushinteger(L, inside ? map->cells[(size_t)row * map->cols + col] : 0);
+    return 1;
 }
 
-static std::vector<unsigned char> parseByteData(lua_State* L, int idx)
+int LuaHost::l_graphics_setTiles(lua_State* L)
 {
-    if (lua_type(L, idx) == LUA_TSTRING)
-    {
-        size_t len = 0;
-        const char* s = lua_tolstring(L, idx, &len);
-        return std::vector<unsigned char>((const unsigned char*)s, (const unsigned char*)s + len);
-    }
+    Tilemap* map = selfFromUpvalue(L)->findTilemap(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    long long col = luaL_optinteger(L, 3, 0);
+    long long row = luaL_optinteger(L, 4, 0);
+    long long width = luaL_optinteger(L, 5, map->cols);
 
-    if (lua_type(L, idx) == LUA_TTABLE)
+    // Checked in 64 bits before anything is narrowed: the arguments are unbounded Lua integers
+    long long n = (long long)lua_rawlen(L, 2);
+    if (width <= 0) return luaL_error(L, "setTiles: width must be positive");
+    if (col < 0 || row < 0 || col >= map->cols || row > map->rows || width > map->cols - col
+        || row + (n + width - 1) / width > map->rows)
+        return luaL_error(L, "setTiles: %s tiles of width %s at %s,%s do not fit the %dx%d map",
+            std::to_string(n).c_str(), std::to_string(width).c_str(), std::to_string(col).c_str(),
+            std::to_string(row).c_str(), map->cols, map->rows);
+
+    // Every entry is checked before any is stored, so an error leaves the map unchanged
+    std::vector<uint16_t> tiles((size_t)n);
+    for (size_t i = 0; i < tiles.size(); i++)
     {
-        int n = (int)lua_rawlen(L, idx);
-        std::vector<unsigned char> out;
-        out.reserve(n);
+        lua_rawgeti(L, 2, (int)i + 1);
+        int isnum;
+        lua_Integer t = lua_tointegerx(L, -1, &isnum);
+        lua_pop(L, 1);
+        if (!isnum || t < 0 || t > map->tile_count)
+            return luaL_error(L, "setTiles: entry %d must be a tile number 0-%d", (int)i + 1, map->tile_count);
+        tiles[i] = (uint16_t)t;
+    }
 
-        for (int i = 1; i <= n; i++)
-        {
-            lua_rawgeti(L, idx, i);
-            lua_Integer v = luaL_checkinteger(L, -1);
-            lua_pop(L, 1);
+    int c = (int)col, r = (int)row, wd = (int)width;
+    for (int i = 0; i < (int)tiles.size(); i++)
+        map->cells[(size_t)(r + i / wd) * map->cols + c + i % wd] = tiles[i];
+    return 0;
+}
 
-            if (v < 0 || v > 255) luaL_error(L, "byte[%d] out of range (0..255)", (int)i);
-            out.push_back((unsigned char)v);
-        }
-        return out;
-    }
+int LuaHost::l_graphics_drawTilemap(lua_State* L)
+{
+    Tilemap* map = selfFromUpvalue(L)->findTilemap(L, 1);
+    int x = (int)luaL_checkinteger(L, 2);
+    int y = (int)luaL_checkinteger(L, 3);
+    int scroll_x = (int)luaL_optinteger(L, 4, 0);
+    int scroll_y = (int)luaL_optinteger(L, 5, 0);
+    int w = (int)luaL_optinteger(L, 6, Screen::width);
+    int h = (int)luaL_optinteger(L, 7, Screen::height);
+    CanvasKernels::Op op = checkBlitMode(L, 8);
 
-    luaL_error(L, "bytes must be a string or an array table of integers");
-    return {};
+    requireScreen(L)->tilemap(*map, x, y, w, h, scroll_x, scroll_y, op);
+    return 0;
 }
 
-int LuaHost::l_graphics_defineImage(lua_State* L)
+int LuaHost::l_graphics_newCanvas(lua_State* L)
 {
     LuaHost* self = selfFromUpvalue(L);
+    DrawCommands::flush(); // Deferred blits may point at an image this replaces
 
     const char* name = luaL_checkstring(L, 1);
     int w = (int)luaL_checkinteger(L, 2);
     int h = (int)luaL_checkinteger(L, 3);
 
-    if (w <= 0 || h <= 0) return luaL_error(L, "defineImage: invalid dimensions");
-    if (w % 8) return luaL_error(L, "defineImage: width must be a multiple of 8");
-
-    std::vector<unsigned char> bytes = parseByteData(L, 4);
-
-    size_t expected = (size_t)(w * h / 8);
-    if (bytes.size() != expected)
-        return luaL_error(L, "defineImage: expected %d bytes, got %d", (int)expected, (int)bytes.size());
+    if (w <= 0 || h <= 0) return luaL_error(L, "newCanvas: invalid dimensions");
+    if (w % 8) return luaL_error(L, "newCanvas: width must be a multiple of 8");
+    if (self->isTarget(name))
+        return luaL_error(L, "newCanvas: '%s' is the current render target", name);
 
     auto owned = std::make_unique<OwnedImage>();
-    owned->bytes = std::move(bytes);
+    owned->bytes.assign((size_t)w * h / 8, 0);
     owned->img.width = w;
     owned->img.height = h;
     owned->img.pixels = owned->bytes.data();
+    owned->generation = ++self->imageGeneration;
 
     self->images[std::string(name)] = std::move(owned);
     return 0;
 }
 
-int LuaHost::l_graphics_image(lua_State* L)
+int LuaHost::l_graphics_setTarget(lua_State* L)
 {
     LuaHost* self = selfFromUpvalue(L);
+    DrawCommands::flush(); // Deferred calls are for the Canvas
 
     const char* name = luaL_checkstring(L, 1);
-    int row = (int)luaL_checkinteger(L, 2);
-    int col = (int)luaL_checkinteger(L, 3);
-    bool draw_bg = lua_isnone(L, 4) ? true : (lua_toboolean(L, 4) != 0);
-    int dy = (int)luaL_optinteger(L, 5, 0);
 
     auto it = self->images.find(name);
     if (it == self->images.end())
-        return luaL_error(L, "Unknown image '%s' (did you call lime.graphics.defineImage?)", name);
+        return luaL_error(L, "Unknown image '%s' (did you call lime.graphics.newCanvas?)", name);
 
-    MonospaceMonochromePixelFont& font = *Screen::font;
-    int x = col * font.glyph_width;
-    int y = row * font.glyph_height + Screen::text_offset_y + dy;
+    OwnedImage& target = *it->second;
+    target.generation = ++self->imageGeneration; // Drawing may change it
+    Screen::setTarget(target.bytes.data(), target.img.width, target.img.height);
+    return 0;
+}
 
-    if (x % 8)
-        return luaL_error(L, "lime.graphics.image: image x not a multiple of 8 (%d)", x);
+int LuaHost::l_graphics_resetTarget(lua_State* L)
+{
+    Screen::resetTarget();
+    return 0;
+}
 
-    Image* img = &it->second->img;
-    int w = img->width;
-    int h = img->height;
+const Image* LuaHost::findImage(lua_State* L, int idx) const
+{
+    const char* name = luaL_checkstring(L, idx);
+    auto it = images.find(name);
+    if (it == images.end())
+        luaL_error(L, "Unknown image '%s' (did you call lime.graphics.defineImage?)", name);
+    return &it->second->img;
+}
 
-    if (x < 0 || y < 0 || x + w > Screen::width || y + h > Screen::height)
-        return luaL_error(L, "lime.graphics.image: out of bounds (%d,%d)-(%d,%d)", x, y, x + w - 1, y + h - 1);
+int LuaHost::l_graphics_overlap(lua_State* L)
+{
+    LuaHost* self = selfFromUpvalue(L);
 
-    requireScreen(L)->image(img, row, col, draw_bg, dy);
-    return 0;
+    const Image* a = self->findImage(L, 1);
+    int ax = (int)luaL_checkinteger(L, 2);
+    int ay = (int)luaL_checkinteger(L, 3);
+    const Image* b = self->findImage(L, 4);
+    int bx = (int)luaL_checkinteger(L, 5);
+    int by = (int)luaL_checkinteger(L, 6);
+    bool count = lua_toboolean(L, 7) != 0;
+
+    long long n = bitmapOverlap(a, ax, ay, b, bx, by, count);
+    if (count) lua_pushinteger(L, (lua_Integer)n);
+    else lua_pushboolean(L, n != 0);
+    return 1;
+}
+
+int LuaHost::l_graphics_overlapCanvas(lua_State* L)
+{
+    LuaHost* self = selfFromUpvalue(L);
+    DrawCommands::flush(); // Reads the Canvas
+
+    const Image* a = self->findImage(L, 1);
+    int x = (int)luaL_checkinteger(L, 2);
+    int y = (int)luaL_checkinteger(L, 3);
+    bool count = lua_toboolean(L, 4) != 0;
+
+    Image target = currentTarget();
+    long long n = bitmapOverlap(a, x, y, &target, 0, 0, count);
+    if (count) lua_pushinteger(L, (lua_Integer)n);
+    else lua_pushboolean(L, n != 0);
+    return 1;
+}
+
+int LuaHost::l_graphics_countPixels(lua_State* L)
+{
+    LuaHost* self = selfFromUpvalue(L);
+    DrawCommands::flush(); // Reads the Canvas
+
+    int x = (int)luaL_checkinteger(L, 1);
+    int y = (int)luaL_checkinteger(L, 2);
+    int w = (int)luaL_checkinteger(L, 3);
+    int h = (int)luaL_checkinteger(L, 4);
+
+    Image target = currentTarget();
+    const Image* image = lua_isnoneornil(L, 5) ? &target : self->findImage(L, 5);
+    lua_pushinteger(L, (lua_Integer)bitmapCount(image, x, y, w, h));
+    return 1;
+}
+
+int LuaHost::l_graphics_raycast(lua_State* L)
+{
+    LuaHost* self = selfFromUpvalue(L);
+    DrawCommands::flush(); // Reads the Canvas
+
+    int x1 = (int)luaL_checkinteger(L, 1);
+    int y1 = (int)luaL_checkinteger(L, 2);
+    int x2 = (int)luaL_checkinteger(L, 3);
+    int y2 = (int)luaL_checkinteger(L, 4);
+
+    Image target = currentTarget();
+    const Image* image = lua_isnoneornil(L, 5) ? &target : self->findImage(L, 5);
+
+    int hit_x, hit_y;
+    if (!bitmapRaycast(image, x1, y1, x2, y2, hit_x, hit_y))
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+    lua_pushinteger(L, hit_x);
+    lua_pushinteger(L, hit_y);
+    return 2;
 }
 
 // ============================================================================
@@ -1139,34 +2232,36 @@ void LuaHost::registerKeyboardSubtable()
     lua_setfield(L, -2, "keyboard"); // lime.keyboard = {...}
 }
 
+// No keys are down without a window (headless mode)
+static bool keyDown(int key)
+{
+    return window.window && glfwGetKey(window.window, key) == GLFW_PRESS;
+}
+
 int LuaHost::l_keyboard_isDown(lua_State* L)
 {
     int key = (int)luaL_checkinteger(L, 1);
-    int state = glfwGetKey(window.window, key);
-    lua_pushboolean(L, state == GLFW_PRESS);
+    lua_pushboolean(L, keyDown(key));
     return 1;
 }
 
 int LuaHost::l_keyboard_ctrlIsDown(lua_State* L)
 {
-    bool down = glfwGetKey(window.window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS ||
-        glfwGetKey(window.window, GLFW_KEY_RIGHT_CONTROL) == GLFW_PRESS;
+    bool down = keyDown(GLFW_KEY_LEFT_CONTROL) || keyDown(GLFW_KEY_RIGHT_CONTROL);
     lua_pushboolean(L, down);
     return 1;
 }
 
 int LuaHost::l_keyboard_altIsDown(lua_State* L)
 {
-    bool down = glfwGetKey(window.window, GLFW_KEY_LEFT_ALT) == GLFW_PRESS ||
-        glfwGetKey(window.window, GLFW_KEY_RIGHT_ALT) == GLFW_PRESS;
+    bool down = keyDown(GLFW_KEY_LEFT_ALT) || keyDown(GLFW_KEY_RIGHT_ALT);
     lua_pushboolean(L, down);
     return 1;
 }
 
 int LuaHost::l_keyboard_shiftIsDown(lua_State* L)
 {
-    bool down = glfwGetKey(window.window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS ||
-        glfwGetKey(window.window, GLFW_KEY_RIGHT_SHIFT) == GLFW_PRESS;
+    bool down = keyDown(GLFW_KEY_LEFT_SHIFT) || keyDown(GLFW_KEY_RIGHT_SHIFT);
     lua_pushboolean(L, down);
     return 1;
 }
@@ -1185,12 +2280,21 @@ void LuaHost::registerTimeSubtable()
     lua_pushcfunction(L, &LuaHost::l_time_sinceEpoch);
     lua_setfield(L, -2, "sinceEpoch");
 
+    lua_pushcfunction(L, &LuaHost::l_time_setIdle);
+    lua_setfield(L, -2, "setIdle");
+
+    lua_pushcfunction(L, &LuaHost::l_time_setFixedStep);
+    lua_setfield(L, -2, "setFixedStep");
+
+    lua_pushcfunction(L, &LuaHost::l_time_setFrameLimit);
+    lua_setfield(L, -2, "setFrameLimit");
+
     lua_setfield(L, -2, "time"); // lime.time = {...}
 }
 
 int LuaHost::l_time_sinceStart(lua_State* L)
 {
-    lua_pushnumber(L, glfwGetTime());
+    lua_pushnumber(L, app.time());
     return 1;
 }
 
@@ -1200,6 +2304,34 @@ int LuaHost::l_time_sinceEpoch(lua_State* L)
     return 1;
 }
 
+// A rate argument: nil or 0 for none, else a positive number
+static double optRate(lua_State* L, int idx, const char* fn)
+{
+    const double rate = luaL_optnumber(L, idx, 0.0);
+    if (!(rate >= 0.0 && rate <= 1e6)) luaL_error(L, "%s: rate must be between 0 and 1000000 (got %f)", fn, rate);
+    return rate;
+}
+
+int LuaHost::l_time_setIdle(lua_State* L)
+{
+    luaL_checkany(L, 1);
+    FrameScheduler::settings.idle = lua_toboolean(L, 1) != 0;
+    return 0;
+}
+
+int LuaHost::l_time_setFixedStep(lua_State* L)
+{
+    const double rate = optRate(L, 1, "lime.time.setFixedStep");
+    FrameScheduler::setFixedStep(rate > 0.0 ? 1.0 / rate : 0.0);
+    return 0;
+}
+
+int LuaHost::l_time_setFrameLimit(lua_State* L)
+{
+    FrameScheduler::settings.frame_limit = optRate(L, 1, "lime.time.setFrameLimit");
+    return 0;
+}
+
 // ============================================================================
 // lime.filesystem Subtable
 // ============================================================================
@@ -1857,7 +2989,7 @@ void LuaHost::profilerStopCurrentSection()
     if (profilerActiveSection.empty())
         return;
 
-    double now = glfwGetTime();
+    double now = app.realTime();
     double elapsed = now - profilerSectionStart;
 
     // Add elapsed time to the section's accumulator
@@ -1924,7 +3056,7 @@ int LuaHost::l_profiler_start(lua_State* L)
 
     // Start timing the new section
     self->profilerActiveSection = sectionId;
-    self->profilerSectionStart = glfwGetTime();
+    self->profilerSectionStart = app.realTime();
 
     return 0;
 }
@@ -1972,7 +3104,7 @@ int LuaHost::l_profiler_get(lua_State* L)
     // If this section is currently active, add the in-progress time
     if (self->profilerActiveSection == sectionId)
     {
-        double now = glfwGetTime();
+        double now = app.realTime();
         accumulated += (now - self->profilerSectionStart);
     }
 
@@ -1990,7 +3122,7 @@ int LuaHost::l_profiler_reset(lua_State* L)
 
     // If there's an active section, reset its start time to now
     if (!self->profilerActiveSection.empty())
-        self->profilerSectionStart = glfwGetTime();
+        self->profilerSectionStart = app.realTime();
 
     return 0;
 }
@@ -2228,6 +3360,12 @@ void LuaHost::loadAppScript(const std::filesystem::path& path)
     if (!L) throw std::runtime_error("LuaHost not initialized");
 
     images.clear();
+    tilemaps.clear();
+    packedImages.clear();
+    worlds.clear();
+    snapshots.clear();
+    FrameScheduler::reset();
+    DrawCommands::reset();
 
     // Clear profiler state when loading a new script
     profilerSections.clear();
@@ -2267,6 +3405,12 @@ void LuaHost::loadFusedScript(const std::string& archivePath)
     if (!L) throw std::runtime_error("LuaHost not initialized");
 
     images.clear();
+    tilemaps.clear();
+    packedImages.clear();
+    worlds.clear();
+    snapshots.clear();
+    FrameScheduler::reset();
+    DrawCommands::reset();
 
     profilerSections.clear();
     profilerActiveSection.clear();
@@ -2379,6 +3523,41 @@ void LuaHost::callUpdate(float dt)
 void LuaHost::callDraw()
 {
     if (!pushLimeCallback("draw")) return;
+    DrawCommands::Scope deferred;
+    if (FrameScheduler::settings.fixed_step <= 0.0)
+    {
+        pcall(0, 0);
+        return;
+    }
+    lua_pushnumber(L, (lua_Number)FrameScheduler::alpha());
+    pcall(1, 0);
+}
+
+bool LuaHost::hasCallback(const char* name)
+{
+    if (!L || !pushLimeCallback(name)) return false;
+    lua_pop(L, 1);
+    return true;
+}
+
+void LuaHost::callDrawLayer(int index)
+{
+    lua_getfield(L, LUA_REGISTRYINDEX, LAYER_FUNCTIONS);
+    if (!lua_istable(L, -1))
+    {
+        lua_pop(L, 1);
+        return;
+    }
+
+    lua_rawgeti(L, -1, index + 1);
+    lua_remove(L, -2); // remove layer table, keep only the function (or nil)
+
+    if (!lua_isfunction(L, -1))
+    {
+        lua_pop(L, 1);
+        return;
+    }
+    DrawCommands::Scope deferred;
     pcall(0, 0);
 }
 
@@ -1,6 +1,10 @@
 #pragma once
 
+#include "CanvasSnapshots.h"
 #include "Image.h"
+#include "PackedImage.h"
+#include "Tilemap.h"
+#include "WorldBitmap.h"
 
 #include "lua.hpp"
 
@@ -25,10 +29,12 @@ public:
     void callOnSetActive(bool initial);
     void callUpdate(float dt);
     void callDraw();
+    void callDrawLayer(int index); // Draw function given to lime.graphics.setLayer (index is 0-based)
     bool callKeyPressed(int key, int scancode, bool isrepeat);
     bool callKeyReleased(int key, int scancode);
     bool callTextInput(unsigned int c); // Mainly for text input scenarios
     bool callQuit();
+    bool hasCallback(const char* name); // True if lime[name] is a function
 
     bool invokeQuitCallback(); // Invokes lime.quit callback with re-entrancy protection; returns true if quit should be aborted
 
@@ -42,9 +48,16 @@ private:
     {
         Image img;
         std::vector<unsigned char> bytes;
+        unsigned generation = 0; // Changes whenever the pixels may have changed
+        unsigned sourceGeneration = 0; // For cached transforms: generation of the image they were made from
     };
 
     std::unordered_map<std::string, std::unique_ptr<OwnedImage>> images;
+    unsigned imageGeneration = 0; // Last generation handed out
+    std::unordered_map<std::string, std::unique_ptr<Tilemap>> tilemaps;
+    std::unordered_map<std::string, std::unique_ptr<PackedImage>> packedImages; // Separate names from images
+    std::unordered_map<std::string, std::unique_ptr<WorldBitmap>> worlds;
+    CanvasSnapshots snapshots;
     std::filesystem::path mainScriptDir;
     std::vector<std::filesystem::path> argvFiles;
 
@@ -52,6 +65,12 @@ private:
 
     bool quitCallbackActive = false; // Quit callback re-entrancy guard
 
+    bool isTarget(const std::string& name) const; // True if the named image is the current render target
+    const Image* findImage(lua_State* L, int idx) const; // Image named by the string at idx (raises a Lua error if unknown)
+    Tilemap* findTilemap(lua_State* L, int idx) const; // Likewise for tilemaps
+    const PackedImage* findPackedImage(lua_State* L, int idx) const; // And packed images
+    WorldBitmap* findWorld(lua_State* L, int idx) const; // And worlds
+
     // ---- Sandboxed filesystem ----
     std::string appIdentity;
     std::filesystem::path saveDir;
@@ -115,11 +134,11 @@ private:
     static int l_graphics_poff(lua_State* L);   // Pixel off | params: (x,y)
     static int l_graphics_pons(lua_State* L);   // Pixels on | params: ({x1,y1,x2,y2,...})
     static int l_graphics_poffs(lua_State* L);  // Pixels off | params: ({x1,y1,x2,y2,...})
-    static int l_graphics_lset(lua_State* L);   // Line on/off | params: (x1,y1,x2,y2[,on=true])
-    static int l_graphics_lon(lua_State* L);    // Line on | params: (x1,y1,x2,y2)
-    static int l_graphics_loff(lua_State* L);   // Line off | params: (x1,y1,x2,y2)
-    static int l_graphics_lsets(lua_State* L);  // Lines on/off | params: ({x1,y1,x2,y2,...}[,on=true])
-    static int l_graphics_lsetsc(lua_State* L); // Lines (continuous) on/off | params: ({x1,y1,x2,y2,...}[,on=true])
+    static int l_graphics_lset(lua_State* L);   // Line on/off | params: (x1,y1,x2,y2[,on=true[,width=1[,cap="butt"]]]) - cap is "butt", "square" or "round"
+    static int l_graphics_lon(lua_State* L);    // Line on | params: (x1,y1,x2,y2[,width=1[,cap="butt"]])
+    static int l_graphics_loff(lua_State* L);   // Line off | params: (x1,y1,x2,y2[,width=1[,cap="butt"]])
+    static int l_graphics_lsets(lua_State* L);  // Lines on/off | params: ({x1,y1,x2,y2,...}[,on=true[,width=1[,cap="butt"]]])
+    static int l_graphics_lsetsc(lua_State* L); // Lines (continuous) on/off | params: ({x1,y1,x2,y2,...}[,on=true[,width=1[,join="miter"[,cap="butt"]]]]) - join is "miter", "bevel" or "round"
     static int l_graphics_rset(lua_State* L);   // Rect on/off | params: (x,y,w,h[,solid=true[,on=true]])
     static int l_graphics_ron(lua_State* L);    // Rect on | params: (x,y,w,h[,solid=true])
     static int l_graphics_roff(lua_State* L);   // Rect off | params: (x,y,w,h[,solid=true])
@@ -129,6 +148,26 @@ private:
     static int l_graphics_eset(lua_State* L);   // Ellipse on/off | params: (x,y,w,h[,solid=true[,on=true]]) - x,y is top-left of ellipse's bounding box
     static int l_graphics_eon(lua_State* L);    // Ellipse on | params: (x,y,w,h[,solid=true])
     static int l_graphics_eoff(lua_State* L);   // Ellipse off | params: (x,y,w,h[,solid=true])
+    static int l_graphics_polyset(lua_State* L); // Polygon on/off | params: ({x1,y1,x2,y2,...}[,solid=true[,on=true[,rule="evenodd"]]]) - rule is "evenodd" or "nonzero"
+    static int l_graphics_polyon(lua_State* L);  // Polygon on | params: ({x1,y1,x2,y2,...}[,solid=true[,rule="evenodd"]])
+    static int l_graphics_polyoff(lua_State* L); // Polygon off | params: ({x1,y1,x2,y2,...}[,solid=true[,rule="evenodd"]])
+    static int l_graphics_tset(lua_State* L);   // Triangle on/off | params: (x1,y1,x2,y2,x3,y3[,solid=true[,on=true]])
+    static int l_graphics_ton(lua_State* L);    // Triangle on | params: (x1,y1,x2,y2,x3,y3[,solid=true])
+    static int l_graphics_toff(lua_State* L);   // Triangle off | params: (x1,y1,x2,y2,x3,y3[,solid=true])
+    static int l_graphics_fset(lua_State* L);   // Flood fill on/off | params: (x,y[,on=true[,connectivity=4]]) | returns pixels filled - connectivity is 4 or 8
+    static int l_graphics_fon(lua_State* L);    // Flood fill on | params: (x,y[,connectivity=4]) | returns pixels filled
+    static int l_graphics_foff(lua_State* L);   // Flood fill off | params: (x,y[,connectivity=4]) | returns pixels filled
+
+    // Clipping
+    static int l_graphics_pushClip(lua_State* L); // Save clip rect and intersect it with a new one | params: (x,y,w,h)
+    static int l_graphics_popClip(lua_State* L);  // Restore previous clip rect | params: ()
+    static int l_graphics_getClip(lua_State* L);  // Get active clip rect | params: () | returns x,y,w,h
+
+    // Fill pattern
+    static int l_graphics_setPattern(lua_State* L); // Set pattern of solid shapes | params: ([pattern[,anchor="screen"]]) - pattern is a dither level 0-64 or a table of 8 row bytes, none for solid; anchor is "screen" or "shape"
+
+    // Deferred drawing
+    static int l_graphics_setDeferred(lua_State* L); // Record shapes and blits in lime.draw, replayed in parallel when it returns | params: (enabled)
 
     // Text
     static int l_graphics_locate(lua_State* L); // Set next print location | params: (row,col) - 0,0 is origin (top-left-most)
@@ -146,6 +185,52 @@ private:
     // Images
     static int l_graphics_defineImage(lua_State* L); // Define 1-bpp image | params: (handle_as_string,w,h,{bytes}) - width must be a multiple of 8, each byte represents 8 pixels
     static int l_graphics_image(lua_State* L); // Draw image | params: (handle_as_string,row,col[,draw_bg = true[,dy = 0]])
+    static int l_graphics_blit(lua_State* L); // Draw image at any pixel position | params: (handle_as_string,x,y[,mode = "copy"[,mask_handle]]) - mode is "copy", "or", "and", "xor" or "andnot"
+    static int l_graphics_transformImage(lua_State* L); // Flipped, rotated or scaled copy, cached until the source changes | params: (handle,transform[,a[,b]]) | returns handle of the result - transform is "flipx", "flipy", "rot90", "rot180", "rot270", "scale" (a,b = integer factors) or "resize" (a,b = width,height)
+    static int l_graphics_blitRect(lua_State* L); // Copy a rect to x,y on the canvas (overlap-safe) | params: (sx,sy,w,h,x,y[,mode = "copy"[,source_handle]]) - source defaults to the canvas itself
+    static int l_graphics_scroll(lua_State* L); // Scroll the canvas or a rect, filling the exposed edge | params: (dx,dy[,fill_on = false[,x,y,w,h]]) - without a rect, scrolls the clip rect
+
+    // Packed images (run-length coded, kept compressed and decoded while drawing)
+    static int l_graphics_packImage(lua_State* L);         // Encode an image | params: (handle[,base_handle]) | returns binary string - with a base, a delta holding only the bytes that differ from it
+    static int l_graphics_definePackedImage(lua_State* L); // Define a packed image | params: (packed_handle,data) - data is a string returned by packImage
+    static int l_graphics_blitPacked(lua_State* L);        // Draw a packed image at any pixel position | params: (packed_handle,x,y[,mode = "copy"]) - deltas only draw their changed bytes
+    static int l_graphics_unpackImage(lua_State* L);       // Decode into a regular image | params: (packed_handle,handle[,base_handle]) - deltas need the base image
+
+    // Tilemaps (cells are 0-based col,row; tile numbers are 1-based with 0 for an empty cell)
+    static int l_graphics_newTilemap(lua_State* L);  // Define a map of empty cells and its tile set | params: (handle,cols,rows,{tiles}) - tiles are image handles or glyph indices, all the same size
+    static int l_graphics_setTile(lua_State* L);     // Set one cell | params: (handle,col,row,tile)
+    static int l_graphics_getTile(lua_State* L);     // Read one cell | params: (handle,col,row) | returns tile number (0 outside the map)
+    static int l_graphics_setTiles(lua_State* L);    // Set a block of cells | params: (handle,{tiles}[,col=0,row=0[,width=cols]]) - tiles are row-major, width per row
+    static int l_graphics_drawTilemap(lua_State* L); // Draw the map in one call | params: (handle,x,y[,scroll_x=0,scroll_y=0[,w,h[,mode="copy"]]]) - viewport defaults to the canvas size
+
+    // Worlds (sparse bitmaps larger than the canvas, viewed through a camera)
+    static int l_graphics_newWorld(lua_State* L);   // Define a blank world | params: (handle,w,h) - up to 65536 pixels per side
+    static int l_graphics_drawWorld(lua_State* L);  // Draw into a region of the world | params: (handle,x,y,w,h,fn) - fn draws with the region as the render target (0,0 = x,y); w must be a multiple of 8
+    static int l_graphics_blitWorld(lua_State* L);  // Copy a camera view to the canvas | params: (handle,cam_x,cam_y[,x,y,w,h[,mode = "copy"]]) - viewport defaults to the canvas size
+    static int l_graphics_worldTiles(lua_State* L); // Memory in use | params: (handle) | returns allocated tiles, total tiles
+
+    // Snapshots (undo/redo states of the main canvas or an image, sharing unchanged tiles)
+    static int l_graphics_snapshot(lua_State* L);        // Save a canvas | params: ([handle]) | returns snapshot id - without a handle, the current render target
+    static int l_graphics_restoreSnapshot(lua_State* L); // Put a saved state back into the canvas it came from | params: (id)
+    static int l_graphics_discardSnapshot(lua_State* L); // Free a snapshot | params: (id)
+    static int l_graphics_snapshotMemory(lua_State* L);  // Memory in use | params: () | returns bytes held by snapshot tiles, number of snapshots
+
+    // Render targets
+    static int l_graphics_newCanvas(lua_State* L);   // Define blank image usable as a render target | params: (handle_as_string,w,h) - width must be a multiple of 8
+    static int l_graphics_setTarget(lua_State* L);   // Draw to image/canvas | params: (handle_as_string)
+    static int l_graphics_resetTarget(lua_State* L); // Draw to main canvas | params: ()
+
+    // Layers (index 1-MAX_LAYERS, bottom to top over what lime.draw renders)
+    static int l_graphics_setLayer(lua_State* L);    // Add or change a layer and mark it dirty | params: (index,draw_fn[,mode="or"[,mask_handle]]) - mode is "or", "and", "xor", "andnot" or "replace" (pixels under the mask, or all without one)
+    static int l_graphics_removeLayer(lua_State* L); // Remove a layer | params: (index)
+    static int l_graphics_showLayer(lua_State* L);   // Show or hide a layer without redrawing it | params: (index,visible)
+    static int l_graphics_redrawLayer(lua_State* L); // Call the layer's draw function before the next frame | params: (index)
+
+    // Collision queries (images by handle; the canvas is the current render target)
+    static int l_graphics_overlap(lua_State* L);       // Test two images for overlapping set pixels | params: (handle_a,ax,ay,handle_b,bx,by[,count=false]) | returns boolean, or pixel count if count
+    static int l_graphics_overlapCanvas(lua_State* L); // Test an image against the canvas | params: (handle,x,y[,count=false]) | returns boolean, or pixel count if count
+    static int l_graphics_countPixels(lua_State* L);   // Count set pixels in a rect | params: (x,y,w,h[,handle]) | returns integer
+    static int l_graphics_raycast(lua_State* L);       // First set pixel on a line | params: (x1,y1,x2,y2[,handle]) | returns x,y or nil
 
     // ========================================
     // lime.keyboard bindings
@@ -160,6 +245,9 @@ private:
     // ========================================
     static int l_time_sinceStart(lua_State* L); // Get seconds since start of app | params: () | returns number
     static int l_time_sinceEpoch(lua_State* L); // Get seconds since UNIX epoch | params: () | returns integer
+    static int l_time_setIdle(lua_State* L); // Allow blocking for events while nothing updates or draws | params: (enabled)
+    static int l_time_setFixedStep(lua_State* L); // Run lime.update at a fixed rate, passing alpha to lime.draw | params: ([rate]) - updates per second, nil or 0 for one per frame
+    static int l_time_setFrameLimit(lua_State* L); // Hold frames to a rate by sleeping | params: ([fps]) - nil or 0 for no limit
 
     // ========================================
     // lime.filesystem bindings
@@ -0,0 +1,146 @@
+#include "PackedImage.h"
+
+#include <cstring>
+
+static constexpr int MAX_COUNT = 65535;
+static constexpr int MIN_REPEAT = 3; // Shorter runs cost less as part of a literal
+static constexpr int MIN_SKIP = 2;
+
+static void emitToken(std::vector<unsigned char>& out, int kind, int count)
+{
+    if (count < 64)
+        out.push_back((unsigned char)(kind << 6 | count));
+    else
+    {
+        out.push_back((unsigned char)(kind << 6));
+        out.push_back((unsigned char)(count & 0xFF));
+        out.push_back((unsigned char)(count >> 8));
+    }
+}
+
+void PackedImageCodec::pack(const Image& src, const Image* base, PackedImage& out)
+{
+    const int n = src.width / 8 * src.height;
+    const unsigned char* cur = src.pixels;
+    const unsigned char* prev = base ? base->pixels : nullptr;
+
+    out.width = src.width;
+    out.height = src.height;
+    out.delta = base != nullptr;
+    out.tokens.clear();
+
+    int literal = 0; // Length of the pending literal, which ends at i
+    auto flush = [&](int i)
+    {
+        if (literal == 0) return;
+        emitToken(out.tokens, PackedImage::Literal, literal);
+        out.tokens.insert(out.tokens.end(), cur + i - literal, cur + i);
+        literal = 0;
+    };
+
+    int i = 0;
+    while (i < n)
+    {
+        int limit = n - i < MAX_COUNT ? n - i : MAX_COUNT;
+
+        if (prev)
+        {
+            int r = 0;
+            while (r < limit && cur[i + r] == prev[i + r]) r++;
+            if (r >= MIN_SKIP)
+            {
+                flush(i);
+                emitToken(out.tokens, PackedImage::Skip, r);
+                i += r;
+                continue;
+            }
+        }
+
+        int r = 1;
+        while (r < limit && cur[i + r] == cur[i]) r++;
+        if (r >= MIN_REPEAT)
+        {
+            flush(i);
+            emitToken(out.tokens, PackedImage::Repeat, r);
+            out.tokens.push_back(cur[i]);
+            i += r;
+            continue;
+        }
+
+        i++;
+        if (++literal == MAX_COUNT) flush(i);
+    }
+    flush(n);
+}
+
+const char* PackedImageCodec::parse(const unsigned char* data, size_t size, PackedImage& out)
+{
+    if (size < PackedImage::HEADER_SIZE || memcmp(data, "L2R", 3) != 0 || (data[3] != 'L' && data[3] != 'D'))
+        return "not a packed image";
+
+    const int w = data[4] | (data[5] << 8), h = data[6] | (data[7] << 8);
+    if (w <= 0 || h <= 0) return "invalid dimensions";
+    if (w % 8) return "width must be a multiple of 8";
+
+    const bool delta = data[3] == 'D';
+    const long long n = (long long)(w / 8) * h;
+    const unsigned char* p = data + PackedImage::HEADER_SIZE;
+    const unsigned char* end = data + size;
+
+    // Walk the tokens once so that decoding never has to check them
+    long long covered = 0;
+    while (p < end)
+    {
+        if ((*p & 0x3F) == 0 && end - p < 3) return "truncated data";
+        int kind, count;
+        p = token(p, kind, count);
+
+        if (count == 0) return "zero-length run";
+        if (kind == PackedImage::Skip && !delta) return "skip run in a full image";
+        if (kind > PackedImage::Skip) return "invalid run type";
+
+        long long payload = kind == PackedImage::Literal ? count : kind == PackedImage::Repeat ? 1 : 0;
+        if (end - p < payload) return "truncated data";
+        p += payload;
+
+        covered += count;
+        if (covered > n) return "runs extend past the image";
+    }
+    if (covered != n) return "runs do not cover the image";
+
+    out.width = w;
+    out.height = h;
+    out.delta = delta;
+    out.tokens.assign(data + PackedImage::HEADER_SIZE, end);
+    return nullptr;
+}
+
+void PackedImageCodec::serialize(const PackedImage& image, std::vector<unsigned char>& out)
+{
+    const unsigned char header[PackedImage::HEADER_SIZE] = {
+        'L', '2', 'R', (unsigned char)(image.delta ? 'D' : 'L'),
+        (unsigned char)(image.width & 0xFF), (unsigned char)(image.width >> 8),
+        (unsigned char)(image.height & 0xFF), (unsigned char)(image.height >> 8)
+    };
+    out.assign(header, header + PackedImage::HEADER_SIZE);
+    out.insert(out.end(), image.tokens.begin(), image.tokens.end());
+}
+
+void PackedImageCodec::unpack(const PackedImage& image, unsigned char* dst)
+{
+    const unsigned char* p = image.tokens.data();
+    const unsigned char* end = p + image.tokens.size();
+
+    while (p < end)
+    {
+        int kind, count;
+        p = token(p, kind, count);
+        switch (kind)
+        {
+        case PackedImage::Literal: memcpy(dst, p, count); p += count; break;
+        case PackedImage::Repeat: memset(dst, *p, count); p++; break;
+        default: break;
+        }
+        dst += count;
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Image.h"
+
+#include <cstddef>
+#include <vector>
+
+// Run-length coded 1bpp image. The tokens cover the image bytes in row-major order (runs may cross rows):
+// a token byte holds the kind in its top two bits and the count in the low six (0: a 16-bit little-endian
+// count follows)
+//   00 literal: count bytes follow
+//   01 repeat: one byte follows, repeated count times
+//   10 skip: count bytes are left as they are (delta images only: unchanged from the base frame)
+// Serialized form: "L2RL" (full image) or "L2RD" (delta image), u16 width, u16 height (little-endian), tokens
+struct PackedImage
+{
+    int width = 0, height = 0;
+    bool delta = false;
+    std::vector<unsigned char> tokens; // Validated: they cover exactly width / 8 * height bytes
+
+    enum Kind { Literal = 0, Repeat = 1, Skip = 2 };
+    static constexpr int HEADER_SIZE = 8;
+};
+
+namespace PackedImageCodec
+{
+    void pack(const Image& src, const Image* base, PackedImage& out); // Encode src, as a delta against base if given (same size)
+    const char* parse(const unsigned char* data, size_t size, PackedImage& out); // Load a serialized image; returns an error message or nullptr
+    void serialize(const PackedImage& image, std::vector<unsigned char>& out);
+    void unpack(const PackedImage& image, unsigned char* dst); // Decode into dst (for deltas, dst holds the base frame)
+
+    // Reads the token at p: sets kind and count, returns the pointer to its payload
+    inline const unsigned char* token(const unsigned char* p, int& kind, int& count)
+    {
+        kind = *p >> 6;
+        count = *p & 0x3F;
+        p++;
+        if (count == 0)
+        {
+            count = p[0] | (p[1] << 8);
+            p += 2;
+        }
+        return p;
+    }
+}
@@ -2,7 +2,11 @@
 #include "Renderer.h"
 #include "Window.h"
 #include "Screen.h"
+#include <condition_variable>
+#include <cstring>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include "misc.h"
 
 // Project requirement: Code for shaders must be embedded in this file (final distributable must be a single exe)
@@ -43,12 +47,54 @@ void main()
 }
 )glsl";
 
-Renderer::Renderer() : shaderProgram(0), vao(0), vbo(0), ebo(0), ssbo(0) { init(); }
+struct Renderer::Pipeline
+{
+    struct Frame
+    {
+        bool render = false; // Draw the Canvas before swapping
+        bool colors = false; // fg and bg changed
+        bool vsync = false; // Re-enable vsync (after a fullscreen switch)
+        int width = 0, height = 0; // Window size
+        float fg[3] = {}, bg[3] = {};
+    };
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable changed; // Signalled by both threads whenever queued or stopping changes
+    bool queued = false; // A frame is waiting for the thread
+    bool stopping = false;
+    std::vector<std::pair<GLintptr, GLsizeiptr>> runs; // Byte ranges of 'uploaded' to send with the next frame
+    Frame next; // Built up by the main thread until submit
+    Frame frame; // Handed over by submit
+};
+
+Renderer::Renderer() : shaderProgram(0), vao(0), vbo(0), ebo(0), ssbo(0) {}
+Renderer::~Renderer() {}
 
 void Renderer::cleanup()
 {
+    if (!ready) return;
     ready = false;
 
+    if (pipeline)
+    {
+        {
+            std::lock_guard<std::mutex> lock(pipeline->mutex);
+            pipeline->stopping = true;
+        }
+        pipeline->changed.notify_all();
+        pipeline->thread.join();
+        pipeline.reset();
+        glfwMakeContextCurrent(window.window); // Back from the presenting thread, for the deletes below
+    }
+
+    if (software)
+    {
+        presenter.cleanup();
+        cout(" Renderer [ok]");
+        return;
+    }
+
     glDeleteBuffers(1, &ssbo);
     glDeleteVertexArrays(1, &vao);
     glDeleteBuffers(1, &vbo);
@@ -60,6 +106,21 @@ void Renderer::cleanup()
 
 void Renderer::init()
 {
+    if (software)
+    {
+        if (pipelined)
+        {
+            cout(" Pipelined presentation needs OpenGL, presenting on the main thread");
+            pipelined = false;
+        }
+        if (const char* error = presenter.init(window.window)) app.fatal(error);
+        presenter.setColors(fg, bg);
+        Screen::render_frames = 3;
+        ready = true;
+        cout(" Renderer [software]");
+        return;
+    }
+
     setupShaders();
     setupQuad();
 
@@ -67,10 +128,21 @@ void Renderer::init()
     glGenBuffers(1, &ssbo);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
     glBufferData(GL_SHADER_STORAGE_BUFFER, Screen::width * Screen::height / 8, Screen::pixels, GL_DYNAMIC_DRAW);
+    uploaded.assign(Screen::pixels, Screen::pixels + Screen::width * Screen::height / 8);
+    Screen::render_frames = 3;
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ssbo);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
     ready = true;
+
+    if (pipelined)
+    {
+        pipeline = std::make_unique<Pipeline>();
+        glfwMakeContextCurrent(nullptr); // A context can only be current on one thread
+        pipeline->thread = std::thread(&Renderer::presentLoop, this);
+        cout(" Renderer [ready, pipelined]");
+        return;
+    }
     cout(" Renderer [ready]");
 }
 
@@ -120,8 +192,8 @@ void Renderer::setupShaders()
 
     glUseProgram(shaderProgram);
     glUniform2f(glGetUniformLocation(shaderProgram, "canvasSize"), static_cast<GLfloat>(Screen::width), static_cast<GLfloat>(Screen::height));
-    glUniform3f(glGetUniformLocation(shaderProgram, "fgColor"), 220.f / 255, 250.f / 255, 1.0f);
-    glUniform3f(glGetUniformLocation(shaderProgram, "bgColor"), 0.0f, 72.f / 255, 80.f / 255);
+    glUniform3f(glGetUniformLocation(shaderProgram, "fgColor"), fg[0], fg[1], fg[2]);
+    glUniform3f(glGetUniformLocation(shaderProgram, "bgColor"), bg[0], bg[1], bg[2]);
 }
 
 void Renderer::setupQuad()
@@ -156,47 +228,220 @@ void Renderer::setupQuad()
     glBindVertexArray(0);
 }
 
-void Renderer::uploadSSBO()
+// Rows within the dirty band are compared against the last uploaded copy, and runs of changed
+// rows are uploaded with one glBufferSubData each (short unchanged gaps are merged into a run)
+bool Renderer::uploadSSBO()
 {
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
-    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, Screen::width * Screen::height / 8, Screen::pixels);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    const int MAX_GAP = 8; // Unchanged rows worth re-sending to save a call
+
+    if (!ready)
+    {
+        Screen::clearDirty();
+        return false;
+    }
+    if (software) return presenter.update();
+
+    int stride = Screen::width / 8;
+    int top = max(Screen::dirty_top, 0);
+    int bottom = min(Screen::dirty_bottom, Screen::height - 1);
+    Screen::clearDirty();
+
+    int run_top = -1, run_bottom = -1;
+    bool bound = false;
+
+    // Pipelined, 'uploaded' is the presenting thread's copy; it is only written once the last frame is taken
+    std::unique_lock<std::mutex> lock;
+    if (pipeline)
+    {
+        lock = std::unique_lock<std::mutex>(pipeline->mutex);
+        pipeline->changed.wait(lock, [&] { return !pipeline->queued; });
+    }
+
+    auto flush = [&]() {
+        GLintptr offset = (GLintptr)run_top * stride;
+        GLsizeiptr size = (GLsizeiptr)(run_bottom - run_top + 1) * stride;
+        memcpy(uploaded.data() + offset, Screen::pixels + offset, size);
+        app.metrics.ssbo_bytes += size;
+        if (pipeline)
+        {
+            pipeline->runs.emplace_back(offset, size); // Sent by the presenting thread
+            return;
+        }
+        if (!bound) { glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo); bound = true; }
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, size, Screen::pixels + offset);
+    };
+
+    for (int y = top; y <= bottom; y++)
+    {
+        if (!memcmp(Screen::pixels + y * stride, uploaded.data() + y * stride, stride)) continue;
+
+        if (run_top >= 0 && y - run_bottom > MAX_GAP)
+        {
+            flush();
+            run_top = y;
+        }
+        else if (run_top < 0) run_top = y;
+        run_bottom = y;
+    }
+
+    if (run_top < 0) return false;
+
+    flush();
+    if (bound) glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
     app.metrics.ssbo_updates++;
+    return true;
 }
 
 void Renderer::setFgColor(float r, float g, float b)
 {
+    fg[0] = r; fg[1] = g; fg[2] = b;
+    if (!ready) return;
+    if (software)
+    {
+        presenter.setColors(fg, bg);
+        Screen::render_frames = 3;
+        return;
+    }
+    if (pipeline)
+    {
+        pipeline->next.colors = true;
+        Screen::render_frames = 3;
+        return;
+    }
     glUseProgram(shaderProgram);
     glUniform3f(glGetUniformLocation(shaderProgram, "fgColor"), r, g, b);
+    Screen::render_frames = 3;
 }
 
 void Renderer::setBgColor(float r, float g, float b)
 {
+    bg[0] = r; bg[1] = g; bg[2] = b;
+    if (!ready) return;
+    if (software)
+    {
+        presenter.setColors(fg, bg);
+        Screen::render_frames = 3;
+        return;
+    }
+    if (pipeline)
+    {
+        pipeline->next.colors = true;
+        Screen::render_frames = 3;
+        return;
+    }
     glUseProgram(shaderProgram);
     glUniform3f(glGetUniformLocation(shaderProgram, "bgColor"), r, g, b);
+    Screen::render_frames = 3;
 }
 
 // Render frame
 void Renderer::render()
+{
+    if (software)
+    {
+        if (const char* error = presenter.present(window.width, window.height)) app.fatal(error);
+        app.metrics.renders++;
+        if (Screen::render_frames) Screen::render_frames--;
+        return;
+    }
+
+    if (pipeline) pipeline->next.render = true; // Drawn by the presenting thread
+    else draw(window.width, window.height);
+
+    app.metrics.renders++;
+
+    if (Screen::render_frames) Screen::render_frames--;
+}
+
+void Renderer::draw(int window_width, int window_height)
 {
     glClear(GL_COLOR_BUFFER_BIT);
 
     glUseProgram(shaderProgram);
 
     // Scale the canvas by whole integer factors (keep the rendering pixel-perfect)
-    int scaling = min(window.width / Screen::width, window.height / Screen::height);
+    int scaling = min(window_width / Screen::width, window_height / Screen::height);
     // Calculate offsets to center the scaled canvas
-    int dx = (window.width - Screen::width * scaling) / 2;
-    int dy = (window.height - Screen::height * scaling) / 2;
+    int dx = (window_width - Screen::width * scaling) / 2;
+    int dy = (window_height - Screen::height * scaling) / 2;
 
-    glUniform2f(glGetUniformLocation(shaderProgram, "viewport"), (float)window.width, (float)window.height);
+    glUniform2f(glGetUniformLocation(shaderProgram, "viewport"), (float)window_width, (float)window_height);
     glUniform2f(glGetUniformLocation(shaderProgram, "offset"), (float)dx, (float)dy);
     glUniform1f(glGetUniformLocation(shaderProgram, "scale"), (float)scaling);
 
     glBindVertexArray(vao);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+}
 
-    app.metrics.renders++;
+void Renderer::submit()
+{
+    Pipeline& p = *pipeline;
+    p.next.width = window.width;
+    p.next.height = window.height;
+    memcpy(p.next.fg, fg, sizeof(fg));
+    memcpy(p.next.bg, bg, sizeof(bg));
 
-    if (Screen::render_frames) Screen::render_frames--;
+    {
+        std::unique_lock<std::mutex> lock(p.mutex);
+        p.changed.wait(lock, [&] { return !p.queued; });
+        p.frame = p.next;
+        p.queued = true;
+    }
+    p.changed.notify_all();
+    p.next = {};
+}
+
+void Renderer::presentLoop()
+{
+    Pipeline& p = *pipeline;
+    glfwMakeContextCurrent(window.window);
+    int viewport_width = -1, viewport_height = -1;
+
+    while (true)
+    {
+        Pipeline::Frame f;
+        {
+            std::unique_lock<std::mutex> lock(p.mutex);
+            p.changed.wait(lock, [&] { return p.queued || p.stopping; });
+            if (!p.queued) break; // Stopping, with every frame presented
+
+            if (!p.runs.empty())
+            {
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+                for (const auto& [offset, size] : p.runs)
+                    glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, size, uploaded.data() + offset);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+                p.runs.clear();
+            }
+            f = p.frame;
+            p.queued = false;
+        }
+        p.changed.notify_all(); // The main thread may write the next frame's rows now
+
+        if (f.vsync) glfwSwapInterval(1);
+        if (f.colors)
+        {
+            glUseProgram(shaderProgram);
+            glUniform3f(glGetUniformLocation(shaderProgram, "fgColor"), f.fg[0], f.fg[1], f.fg[2]);
+            glUniform3f(glGetUniformLocation(shaderProgram, "bgColor"), f.bg[0], f.bg[1], f.bg[2]);
+        }
+        if (f.width != viewport_width || f.height != viewport_height)
+            glViewport(0, 0, viewport_width = f.width, viewport_height = f.height);
+        if (f.render) draw(f.width, f.height);
+        glfwSwapBuffers(window.window);
+    }
+
+    glfwMakeContextCurrent(nullptr);
+}
+
+void Renderer::enableVsync()
+{
+    if (software) return;
+    if (pipeline) pipeline->next.vsync = true; // The presenting thread has the context
+    else glfwSwapInterval(1);
+}
+
+void Renderer::invalidate()
+{
+    if (software && ready) presenter.invalidate();
 }
\ No newline at end of file
@@ -1,30 +1,55 @@
 #ifndef RENDERER_H
 #define RENDERER_H
 
+#include "SoftwarePresenter.h"
+
 #include <glad/glad.h>
 
+#include <memory>
+#include <vector>
+
 class Renderer
 {
 public:
     inline static bool ready = false;
+    inline static bool software = false; // Present on the CPU (--software, or when OpenGL 4.3 is unavailable)
+    inline static bool pipelined = false; // Upload, render and swap on a thread of its own (--pipeline, OpenGL only)
 
     Renderer();
+    ~Renderer();
 
-    void init();
-    void uploadSSBO();
+    void init(); // Needs the window's GL context (not called in headless mode, where the other functions do no GL work)
+    bool uploadSSBO(); // Uploads the Canvas rows that changed since the last upload; returns false if none did
     void render();
+    void submit(); // Pipelined: hands the frame to the presenting thread (waits while the previous one is untaken)
+    void enableVsync();
+    void invalidate(); // The window contents were lost (software presentation only)
     void cleanup();
 
     void setFgColor(float r, float g, float b);
     void setBgColor(float r, float g, float b);
+    const float* fgColor() const { return fg; } // RGB, 0-1
+    const float* bgColor() const { return bg; }
 
 private:
     GLuint shaderProgram;
     GLuint vao, vbo, ebo;
     GLuint ssbo; // SSBO for monochrome canvas
+    std::vector<unsigned char> uploaded; // Canvas contents as last uploaded to the SSBO
+    float fg[3] = { 220.f / 255, 250.f / 255, 1.0f };
+    float bg[3] = { 0.0f, 72.f / 255, 80.f / 255 };
+    SoftwarePresenter presenter;
+
+    // With --pipeline the Canvas is double-buffered: uploadSSBO copies the rows that changed into 'uploaded' on
+    // the main thread, and the presenting thread, which owns the GL context, sends them to the SSBO, renders
+    // and swaps. The main thread goes on to the next frame meanwhile, blocking only if the one before is untaken.
+    struct Pipeline;
+    std::unique_ptr<Pipeline> pipeline; // Null unless the presenting thread is running
 
     void setupShaders();
     void setupQuad();
+    void draw(int window_width, int window_height); // Draws the Canvas quad with the context current
+    void presentLoop(); // Body of the presenting thread
 };
 
 #endif
\ No newline at end of file
@@ -1,18 +1,34 @@
 #include "App.h"
+#include "CanvasKernels.h"
 #include "Image.h"
 #include "misc.h"
 #include "MonospaceMonochromePixelFont.h"
+#include "PackedImage.h"
 #include "Screen.h"
 #include "Renderer.h"
+#include "Tilemap.h"
+#include "WorldBitmap.h"
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
 
 void Screen::_init(int width, int height)
 {
     if (width % 8) app.fatal("Screen canvas width must be a multiple of 8");
 
-    Screen::width = width;
-    Screen::height = height;
+    Screen::width = canvas_width = width;
+    Screen::height = canvas_height = height;
 
     pixels = new unsigned char[width * height / 8] {};
+    resetClip();
+
+    CanvasKernels::init();
+    cout(" Canvas Kernels [", false);
+    cout(CanvasKernels::isaName(), false);
+    cout("]");
 
     font = new MonospaceMonochromePixelFont(256, 8, 16);
     text_offset_y = (height % font->glyph_height) / 2;
@@ -29,8 +45,75 @@ Screen::~Screen()
     cout("\" [ok]");
 }
 
+// Main Canvas state, saved while an offscreen target is active
+static struct
+{
+    unsigned char* pixels;
+    int width, height;
+    int text_offset_y, rows, cols;
+    Screen::Cursor cursor;
+    Screen::ClipRect clip;
+    Screen::ClipRect clip_stack[Screen::MAX_CLIP_DEPTH];
+    int clip_depth;
+    int dirty_top, dirty_bottom;
+}main_canvas;
+
+void Screen::setTarget(unsigned char* pixels, int width, int height)
+{
+    if (width % 8) APP_FATAL << "Render target width (" << width << ") must be a multiple of 8";
+
+    if (!offscreen)
+    {
+        main_canvas.pixels = Screen::pixels;
+        main_canvas.width = Screen::width;
+        main_canvas.height = Screen::height;
+        main_canvas.text_offset_y = text_offset_y;
+        main_canvas.rows = rows;
+        main_canvas.cols = cols;
+        main_canvas.cursor = cursor;
+        main_canvas.clip = clip;
+        memcpy(main_canvas.clip_stack, clip_stack, sizeof(clip_stack));
+        main_canvas.clip_depth = clip_depth;
+        main_canvas.dirty_top = dirty_top;
+        main_canvas.dirty_bottom = dirty_bottom;
+        offscreen = true;
+    }
+
+    Screen::pixels = pixels;
+    Screen::width = width;
+    Screen::height = height;
+
+    // Same text grid rules as the main Canvas
+    text_offset_y = (height % font->glyph_height) / 2;
+    rows = height / font->glyph_height;
+    cols = width / font->glyph_width;
+    cursor = {};
+
+    resetClip();
+}
+
+void Screen::resetTarget()
+{
+    if (!offscreen) return;
+
+    pixels = main_canvas.pixels;
+    width = main_canvas.width;
+    height = main_canvas.height;
+    text_offset_y = main_canvas.text_offset_y;
+    rows = main_canvas.rows;
+    cols = main_canvas.cols;
+    cursor = main_canvas.cursor;
+    clip = main_canvas.clip;
+    memcpy(clip_stack, main_canvas.clip_stack, sizeof(clip_stack));
+    clip_depth = main_canvas.clip_depth;
+    dirty_top = main_canvas.dirty_top; // Offscreen writes never touch the main Canvas
+    dirty_bottom = main_canvas.dirty_bottom;
+    offscreen = false;
+}
+
 void Screen::_cleanup()
 {
+    resetTarget();
     delete font; font = 0;
     delete[] pixels; pixels = 0;
     cout(" Screen Canvas [ok]");
@@ -41,6 +124,7 @@ void Screen::onSetActive(bool initial) {}
 void Screen::setActive()
 {
     (screen = this)->redraw = true;
+    composite_all = true;
     onSetActive(++set_active_count == 1);
 }
 
@@ -49,129 +133,593 @@ void Screen::update(float dt) {}
 void Screen::clear(bool inverted)
 {
     int num_bytes = width * height / 8;
-    memset(pixels, inverted ? 0xFF : 0, num_bytes);
+    markDirty(0, height - 1);
+    CanvasKernels::fill(pixels, num_bytes, inverted ? 0xFF : 0);
 }
 
-bool Screen::inBounds(int x1, int y1, int x2, int y2)
+// Pixels are packed LSB-first, so on little-endian targets a run of adjacent pixels is a
+// contiguous run of bits. A span is written as a masked leading byte, whole 64-bit and
+// 32-bit words, whole bytes, and a masked trailing byte.
+static inline void fillRowSpan(unsigned char* row, int x1, int x2, bool on)
 {
-    return x1 >= 0 && x1 < width && y1 >= 0 && y1 < height &&
-        x2 >= 0 && x2 < width && y2 >= 0 && y2 < height;
+    unsigned char* p = row + (x1 >> 3);
+    int n = x2 - x1 + 1;
+    int bit = x1 & 7;
+
+    if (bit)
+    {
+        int k = min(8 - bit, n);
+        unsigned char m = (unsigned char)(((1u << k) - 1) << bit);
+        if (on) *p |= m;
+        else *p &= (unsigned char)~m;
+        p++;
+        n -= k;
+    }
+
+    const uint64_t fill = on ? ~0ull : 0ull;
+    for (; n >= 64; n -= 64, p += 8) memcpy(p, &fill, 8);
+    if (n >= 32) { memcpy(p, &fill, 4); p += 4; n -= 32; }
+    for (; n >= 8; n -= 8) *p++ = (unsigned char)fill;
+
+    if (n > 0)
+    {
+        unsigned char m = (unsigned char)((1u << n) - 1);
+        if (on) *p |= m;
+        else *p &= (unsigned char)~m;
+    }
 }
 
-void Screen::pset(int x, int y, bool on)
+// The fill pattern applies to span fills while a solid primitive is drawn (see PatternScope)
+static thread_local bool pattern_active = false;
+static thread_local int pattern_x = 0, pattern_y = 0; // Origin of the pattern
+
+// Pattern bits for the bytes of row y (rotated so bit b applies to every pixel with x & 7 == b)
+static inline unsigned char patternRow(int y)
+{
+    unsigned char p = Screen::pattern[(y - pattern_y) & 7];
+    int r = pattern_x & 7;
+    return r ? (unsigned char)((p << r) | (p >> (8 - r))) : p;
+}
+
+// Span x1..x2 limited to the set bits of pat (0 bits are left unchanged)
+static inline void fillRowSpanPattern(unsigned char* row, int x1, int x2, bool on, unsigned char pat)
 {
-    if (x < 0 || x >= width || y < 0 || y >= height)
-        APP_FATAL << "Out of bounds. "
-        << "Coord: (" << x << "," << y << ") "
-        << "Canvas: " << width << "x" << height;
+    unsigned char* p = row + (x1 >> 3);
+    unsigned char* last = row + (x2 >> 3);
+    unsigned char first_mask = (unsigned char)(0xFF << (x1 & 7));
+    unsigned char last_mask = (unsigned char)(0xFF >> (7 - (x2 & 7)));
 
-    int i = x + y * width;
+    auto apply = [on](unsigned char* b, unsigned char m) {
+        if (on) *b |= m;
+        else *b &= (unsigned char)~m;
+    };
 
-    // LSB first (more efficient)
-    if (on) pixels[i / 8] |= (1 << (i % 8));
-    else pixels[i / 8] &= ~(1 << (i % 8));
+    if (p == last) { apply(p, first_mask & last_mask & pat); return; }
+
+    apply(p++, first_mask & pat);
+
+    const uint64_t pat64 = pat * 0x0101010101010101ull;
+    for (; last - p >= 8; p += 8)
+    {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        v = on ? (v | pat64) : (v & ~pat64);
+        memcpy(p, &v, 8);
+    }
+    for (; p < last; p++) apply(p, pat);
+
+    apply(last, last_mask & pat);
 }
 
-void Screen::pon(int x, int y)
+// Enables the fill pattern while a solid primitive is drawn (ox, oy is the shape's top-left)
+struct PatternScope
 {
-    if (x < 0 || x >= width || y < 0 || y >= height)
-        APP_FATAL << "Out of bounds. "
-            << "Coord: (" << x << "," << y << ") "
-            << "Canvas: " << width << "x" << height;
+    PatternScope(int ox, int oy, bool solid)
+    {
+        if (!solid || Screen::pattern_solid) return;
+        pattern_active = true;
+        bool shape = Screen::pattern_anchor == Screen::PatternAnchor::Shape;
+        pattern_x = shape ? ox : 0;
+        pattern_y = shape ? oy : 0;
+    }
+    ~PatternScope() { pattern_active = false; }
+};
 
-    int i = x + y * width;
-    pixels[i / 8] |= (1 << (i % 8)); // LSB first
+void hspanUnsafe(int x1, int x2, int y, bool on)
+{
+    Screen::markDirty(y, y);
+    unsigned char* row = Screen::pixels + y * (Screen::width >> 3);
+    if (pattern_active) fillRowSpanPattern(row, x1, x2, on, patternRow(y));
+    else fillRowSpan(row, x1, x2, on);
 }
 
-void Screen::poff(int x, int y)
+void vspanUnsafe(int x, int y1, int y2, bool on)
 {
-    if (x < 0 || x >= width || y < 0 || y >= height)
-        APP_FATAL << "Out of bounds. "
-        << "Coord: (" << x << "," << y << ") "
-        << "Canvas: " << width << "x" << height;
+    Screen::markDirty(y1, y2);
+    int stride = Screen::width >> 3;
+    unsigned char* p = Screen::pixels + y1 * stride + (x >> 3);
+    unsigned char m = (unsigned char)(1u << (x & 7));
 
-    int i = x + y * width;
-    pixels[i / 8] &= ~(1 << (i % 8)); // LSB first
+    if (pattern_active)
+    {
+        for (int y = y1; y <= y2; y++, p += stride)
+        {
+            unsigned char pm = m & patternRow(y);
+            if (on) *p |= pm;
+            else *p &= (unsigned char)~pm;
+        }
+    }
+    else if (on)
+        for (int y = y1; y <= y2; y++, p += stride) *p |= m;
+    else
+        for (int y = y1; y <= y2; y++, p += stride) *p &= (unsigned char)~m;
 }
 
-void Screen::lset(int x1, int y1, int x2, int y2, bool on)
+void fillRectUnsafe(int x, int y, int w, int h, bool on)
+{
+    Screen::markDirty(y, y + h - 1);
+    int stride = Screen::width >> 3;
+    unsigned char* row = Screen::pixels + y * stride;
+
+    if (pattern_active)
+    {
+        for (int r = 0; r < h; r++, row += stride)
+            fillRowSpanPattern(row, x, x + w - 1, on, patternRow(y + r));
+        return;
+    }
+
+    if (x == 0 && w == Screen::width) // Full-width rows are contiguous
+    {
+        CanvasKernels::fill(row, (size_t)stride * h, on ? 0xFF : 0);
+        return;
+    }
+
+    for (int r = 0; r < h; r++, row += stride)
+        fillRowSpan(row, x, x + w - 1, on);
+}
+
+void Screen::pushClip(int x, int y, int w, int h)
+{
+    if (clip_depth == MAX_CLIP_DEPTH)
+        APP_FATAL << "Clip stack overflow (max depth " << MAX_CLIP_DEPTH << ")";
+
+    if (w < 0) x -= (w = -w);
+    if (h < 0) y -= (h = -h);
+
+    clip_stack[clip_depth++] = clip;
+
+    // Intersect in 64 bits so that huge rectangles cannot overflow (an empty result has x1 > x2 or y1 > y2)
+    clip.x1 = (int)max((long long)clip.x1, (long long)x);
+    clip.y1 = (int)max((long long)clip.y1, (long long)y);
+    clip.x2 = (int)min((long long)clip.x2, (long long)x + w - 1);
+    clip.y2 = (int)min((long long)clip.y2, (long long)y + h - 1);
+}
+
+void Screen::popClip()
+{
+    if (!clip_depth) APP_FATAL << "Clip stack underflow (popClip without pushClip)";
+    clip = clip_stack[--clip_depth];
+}
+
+void Screen::resetClip()
+{
+    clip = { 0, 0, width - 1, height - 1 };
+    clip_depth = 0;
+}
+
+void Screen::setPattern(const unsigned char rows[8], PatternAnchor anchor)
+{
+    pattern_solid = true;
+    for (int i = 0; i < 8; i++)
+    {
+        pattern[i] = rows[i];
+        if (rows[i] != 0xFF) pattern_solid = false;
+    }
+    pattern_anchor = anchor;
+}
+
+void Screen::setDither(int level, PatternAnchor anchor)
+{
+    // 8x8 Bayer matrix: a pixel is set when its threshold is below the level
+    static const unsigned char bayer[8][8] = {
+        {  0, 32,  8, 40,  2, 34, 10, 42 },
+        { 48, 16, 56, 24, 50, 18, 58, 26 },
+        { 12, 44,  4, 36, 14, 46,  6, 38 },
+        { 60, 28, 52, 20, 62, 30, 54, 22 },
+        {  3, 35, 11, 43,  1, 33,  9, 41 },
+        { 51, 19, 59, 27, 49, 17, 57, 25 },
+        { 15, 47,  7, 39, 13, 45,  5, 37 },
+        { 63, 31, 55, 23, 61, 29, 53, 21 },
+    };
+
+    level = max(0, min(level, DITHER_LEVELS));
+    unsigned char rows[8];
+    for (int y = 0; y < 8; y++)
+    {
+        rows[y] = 0;
+        for (int x = 0; x < 8; x++)
+            if (bayer[y][x] < level) rows[y] |= (unsigned char)(1u << x);
+    }
+    setPattern(rows, anchor);
+}
+
+void Screen::resetPattern()
+{
+    static const unsigned char solid[8] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    setPattern(solid, PatternAnchor::Screen);
+}
+
+void hspanClipped(int x1, int x2, int y, bool on)
+{
+    const Screen::ClipRect& c = Screen::clip;
+    if (y < c.y1 || y > c.y2) return;
+    x1 = max(x1, c.x1);
+    x2 = min(x2, c.x2);
+    if (x1 <= x2) hspanUnsafe(x1, x2, y, on);
+}
+
+void vspanClipped(int x, int y1, int y2, bool on)
+{
+    const Screen::ClipRect& c = Screen::clip;
+    if (x < c.x1 || x > c.x2) return;
+    y1 = max(y1, c.y1);
+    y2 = min(y2, c.y2);
+    if (y1 <= y2) vspanUnsafe(x, y1, y2, on);
+}
+
+// Intersects the rectangle (x, y, w, h) with the clip rect; returns false if nothing is visible
+static bool clipRect(int& x, int& y, int& w, int& h)
+{
+    const Screen::ClipRect& c = Screen::clip;
+    if (w <= 0 || h <= 0) return false;
+
+    long long x1 = max((long long)x, (long long)c.x1);
+    long long y1 = max((long long)y, (long long)c.y1);
+    long long x2 = min((long long)x + w - 1, (long long)c.x2);
+    long long y2 = min((long long)y + h - 1, (long long)c.y2);
+    if (x1 > x2 || y1 > y2) return false;
+
+    x = (int)x1; y = (int)y1;
+    w = (int)(x2 - x1 + 1); h = (int)(y2 - y1 + 1);
+    return true;
+}
+
+void fillRectClipped(int x, int y, int w, int h, bool on)
+{
+    if (clipRect(x, y, w, h)) fillRectUnsafe(x, y, w, h, on);
+}
+
+// Loads/stores up to 8 bytes as one LSB-first 64-bit word (bytes past n read as zero)
+static inline uint64_t loadBytes(const unsigned char* p, int n)
+{
+    uint64_t v = 0;
+    if (n >= 8) memcpy(&v, p, 8);
+    else memcpy(&v, p, n);
+    return v;
+}
+
+static inline void storeBytes(unsigned char* p, uint64_t v, int n)
+{
+    if (n >= 8) memcpy(p, &v, 8);
+    else memcpy(p, &v, n);
+}
+
+// 64 bits of a source row starting at bit b (zero outside the row's row_bytes)
+static inline uint64_t rowBits(const unsigned char* row, int row_bytes, int b)
+{
+    int bi = b >> 3; // Arithmetic shift: floors for negative b
+    int shift = b & 7;
+
+    if (bi >= 0 && bi + 9 <= row_bytes)
+    {
+        uint64_t v;
+        memcpy(&v, row + bi, 8);
+        return shift ? (v >> shift) | ((uint64_t)row[bi + 8] << (64 - shift)) : v;
+    }
+
+    // Near the row ends, gather the bytes that exist into a zeroed copy
+    unsigned char tmp[9] = {};
+    int k0 = max(0, -bi), k1 = min(9, row_bytes - bi);
+    if (k0 < k1) memcpy(tmp + k0, row + bi + k0, k1 - k0);
+
+    uint64_t v;
+    memcpy(&v, tmp, 8);
+    return shift ? (v >> shift) | ((uint64_t)tmp[8] << (64 - shift)) : v;
+}
+
+// count whole destination words d = combine(d, 64 source bits starting at bit shift of s), advancing both by step bytes
+template <typename Combine>
+static inline void shiftedWords(unsigned char* d, const unsigned char* s, int shift, int count, int step, Combine combine)
+{
+    for (int k = 0; k < count; k++, d += step, s += step)
+    {
+        uint64_t v, u;
+        memcpy(&v, s, 8);
+        if (shift) v = (v >> shift) | ((uint64_t)s[8] << (64 - shift));
+        memcpy(&u, d, 8);
+        u = combine(u, v);
+        memcpy(d, &u, 8);
+    }
+}
+
+void blitUnsafe(unsigned char* dst, int dst_stride, int dx, int dy,
+    const unsigned char* src, int src_stride, int sx, int sy, int w, int h,
+    CanvasKernels::Op op, const unsigned char* mask)
 {
-    if (x1 < 0 || x1 >= width || y1 < 0 || y1 >= height ||
-        x2 < 0 || x2 >= width || y2 < 0 || y2 >= height)
-        APP_FATAL << "Out of bounds. "
-        << "Coord: (" << x1 << "," << y1 << ")-(" << x2 << "," << y2 << ") "
-        << "Canvas: " << width << "x" << height;
+    using Op = CanvasKernels::Op;
 
-    int dx = std::abs(x2 - x1);
-    int sx = (x1 < x2) ? 1 : -1;
-    int dy = -std::abs(y2 - y1);
-    int sy = (y1 < y2) ? 1 : -1;
-    int err = dx + dy;
+    if (w <= 0 || h <= 0) return;
 
-    if (on)
+    // Overlapping blocks of one buffer are handled like memmove: rows run bottom-up when moving
+    // down, and words right-to-left when moving right within the same rows
+    const bool overlap = dst == src && dx < sx + w && sx < dx + w && dy < sy + h && sy < dy + h;
+    const bool bottom_up = overlap && dy > sy;
+    const bool right_to_left = overlap && dy == sy && dx > sx;
+
+    // Byte-aligned unmasked blocks are plain byte-range operations
+    if (!mask && !(dx & 7) && !(sx & 7) && !(w & 7))
     {
-        for (;;)
+        if (!overlap)
+        {
+            CanvasKernels::combineRect(dst + dy * dst_stride + (dx >> 3), dst_stride,
+                src + sy * src_stride + (sx >> 3), src_stride, w >> 3, h, op);
+            return;
+        }
+        if (op == CanvasKernels::Op::Copy)
         {
-            ponUnsafe(x1, y1);
-            if (x1 == x2 && y1 == y2) break;
-            int e2 = err << 1;
-            if (e2 >= dy) { err += dy; x1 += sx; }
-            if (e2 <= dx) { err += dx; y1 += sy; }
+            for (int i = 0; i < h; i++)
+            {
+                int r = bottom_up ? h - 1 - i : i;
+                memmove(dst + (dy + r) * dst_stride + (dx >> 3), src + (sy + r) * src_stride + (sx >> 3), w >> 3);
+            }
+            return;
         }
     }
-    else
+
+    const int first = dx >> 3; // First and last destination bytes touched
+    const int last = (dx + w - 1) >> 3;
+    const int words = (last - first) / 8 + 1;
+
+    // Unmasked words fully inside [dx, dx + w) whose source bits lie inside the row (k_lo..k_hi)
+    // take a tight loop without per-word masks or bounds checks
+    int k_lo = words, k_hi = -1;
+    for (int k = 0; k < words && !mask; k++)
     {
-        for (;;)
+        int b = first + k * 8, sb = b * 8 - dx + sx;
+        if (b * 8 >= dx && b * 8 + 64 <= dx + w && sb >= 0 && (sb >> 3) + 9 <= src_stride)
         {
-            poffUnsafe(x1, y1);
-            if (x1 == x2 && y1 == y2) break;
-            int e2 = err << 1;
-            if (e2 >= dy) { err += dy; x1 += sx; }
-            if (e2 <= dx) { err += dx; y1 += sy; }
+            k_lo = min(k_lo, k);
+            k_hi = k;
+        }
+    }
+
+    for (int i = 0; i < h; i++)
+    {
+        int r = bottom_up ? h - 1 - i : i;
+        unsigned char* drow = dst + (dy + r) * dst_stride;
+        const unsigned char* srow = src + (sy + r) * src_stride;
+        const unsigned char* mrow = mask ? mask + (sy + r) * src_stride : nullptr;
+
+        auto word = [&](int k)
+        {
+            int b = first + k * 8;
+            int n = min(8, last - b + 1);
+
+            // Destination pixels of this word that lie inside [dx, dx + w)
+            int lo = max(dx - b * 8, 0);
+            int hi = min(dx + w - b * 8, 64);
+            uint64_t m = (hi - lo == 64) ? ~0ull : (((1ull << (hi - lo)) - 1) << lo);
+
+            int sb = b * 8 - dx + sx; // Source bit aligned with the word's first pixel
+            uint64_t s = rowBits(srow, src_stride, sb);
+            uint64_t d = loadBytes(drow + b, n);
+
+            if (mrow)
+            {
+                m &= rowBits(mrow, src_stride, sb);
+                d = (d & ~m) | (s & m);
+            }
+            else
+            {
+                switch (op)
+                {
+                case Op::Copy: d = (d & ~m) | (s & m); break;
+                case Op::Or: d |= s & m; break;
+                case Op::And: d &= s | ~m; break;
+                case Op::Xor: d ^= s & m; break;
+                case Op::AndNot: d &= ~(s & m); break;
+                }
+            }
+
+            storeBytes(drow + b, d, n);
+        };
+
+        auto interior = [&]
+        {
+            int b = first + (right_to_left ? k_hi : k_lo) * 8;
+            unsigned char* d = drow + b;
+            const unsigned char* s = srow + ((b * 8 - dx + sx) >> 3);
+            const int count = k_hi - k_lo + 1, step = right_to_left ? -8 : 8, shift = (sx - dx) & 7;
+            switch (op)
+            {
+            case Op::Copy: shiftedWords(d, s, shift, count, step, [](uint64_t, uint64_t v) { return v; }); break;
+            case Op::Or: shiftedWords(d, s, shift, count, step, [](uint64_t u, uint64_t v) { return u | v; }); break;
+            case Op::And: shiftedWords(d, s, shift, count, step, [](uint64_t u, uint64_t v) { return u & v; }); break;
+            case Op::Xor: shiftedWords(d, s, shift, count, step, [](uint64_t u, uint64_t v) { return u ^ v; }); break;
+            case Op::AndNot: shiftedWords(d, s, shift, count, step, [](uint64_t u, uint64_t v) { return u & ~v; }); break;
+            }
+        };
+
+        if (right_to_left)
+        {
+            for (int k = words - 1; k > k_hi; k--) word(k);
+            if (k_lo <= k_hi) interior();
+            for (int k = min(k_lo, k_hi + 1) - 1; k >= 0; k--) word(k);
+        }
+        else
+        {
+            for (int k = 0; k < k_lo; k++) word(k);
+            if (k_lo <= k_hi) interior();
+            for (int k = max(k_hi + 1, k_lo); k < words; k++) word(k);
         }
     }
 }
 
-void Screen::lon(int x1, int y1, int x2, int y2)
+// Blits the visible part of an image placed at (x, y), offsetting into the source
+static void blitClipped(const Image* image, int x, int y, CanvasKernels::Op op, const Image* mask)
 {
-    if (!inBounds(x1, y1, x2, y2))
-        APP_FATAL << "Out of bounds. "
-        << "Coord: (" << x1 << "," << y1 << ")-(" << x2 << "," << y2 << ") "
-        << "Canvas: " << width << "x" << height;
+    int cx = x, cy = y, w = image->width, h = image->height;
+    if (!clipRect(cx, cy, w, h)) return;
 
-    int dx{ std::abs(x2 - x1) }, dy{ -std::abs(y2 - y1) };
-    int sx{ (x1 < x2) ? 1 : -1 }, sy{ (y1 < y2) ? 1 : -1 };
-    int err = dx + dy;
+    Screen::markDirty(cy, cy + h - 1);
+    blitUnsafe(Screen::pixels, Screen::width / 8, cx, cy, image->pixels, image->width / 8, cx - x, cy - y, w, h,
+        op, mask ? mask->pixels : nullptr);
+}
+
+// Integer line rasterizer limited to a clip rect
+// Along the major axis, step i (0..n) of a line with major/minor extents n/k has minor offset
+//   j(i) = floor((2*i*k + n) / (2*n))
+// which is exactly the pixel the unclipped Bresenham loop visits. j never decreases, so the
+// clip bounds on both axes become a single range of steps (as in Liang-Barsky), computed up
+// front; only the visible steps are visited.
+// The visible pixels are passed to run(x_major, from, to, minor) as runs along the major axis
+// in the order the line travels (from may be greater than to); run returns true to stop early.
+template <typename Run>
+static void lineRuns(int x1, int y1, int x2, int y2, const Screen::ClipRect& c, Run run)
+{
+    // Axis-aligned lines are single runs
+    if (y1 == y2)
+    {
+        if (y1 < c.y1 || y1 > c.y2) return;
+        int a = x1 < x2 ? max(x1, c.x1) : min(x1, c.x2);
+        int b = x1 < x2 ? min(x2, c.x2) : max(x2, c.x1);
+        if (x1 < x2 ? a <= b : a >= b) run(true, a, b, y1);
+        return;
+    }
+    if (x1 == x2)
+    {
+        if (x1 < c.x1 || x1 > c.x2) return;
+        int a = y1 < y2 ? max(y1, c.y1) : min(y1, c.y2);
+        int b = y1 < y2 ? min(y2, c.y2) : max(y2, c.y1);
+        if (y1 < y2 ? a <= b : a >= b) run(false, a, b, x1);
+        return;
+    }
+
+    // Trivial reject (both ends beyond the same clip edge)
+    if ((x1 < c.x1 && x2 < c.x1) || (x1 > c.x2 && x2 > c.x2) ||
+        (y1 < c.y1 && y2 < c.y1) || (y1 > c.y2 && y2 > c.y2)) return;
+
+    const bool x_major = std::abs((long long)x2 - x1) >= std::abs((long long)y2 - y1);
+
+    // Major (m) and minor (n) axis terms
+    const long long m1 = x_major ? x1 : y1, m2 = x_major ? x2 : y2;
+    const long long n1 = x_major ? y1 : x1, n2 = x_major ? y2 : x2;
+    const long long mlo = x_major ? c.x1 : c.y1, mhi = x_major ? c.x2 : c.y2;
+    const long long nlo = x_major ? c.y1 : c.x1, nhi = x_major ? c.y2 : c.x2;
+    const int sm = (m1 < m2) ? 1 : -1;
+    const int sn = (n1 < n2) ? 1 : -1;
+    const long long n = std::abs(m2 - m1);
+    const long long k = std::abs(n2 - n1);
+
+    // Steps whose major coordinate is inside the clip
+    long long i0 = max(0ll, sm > 0 ? mlo - m1 : m1 - mhi);
+    long long i1 = min(n, sm > 0 ? mhi - m1 : m1 - mlo);
+
+    // Minor offsets inside the clip, converted to steps
+    long long j0 = sn > 0 ? nlo - n1 : n1 - nhi;
+    long long j1 = sn > 0 ? nhi - n1 : n1 - nlo;
+    if (j1 < 0) return;
+    if (j0 > 0) i0 = max(i0, ((2 * j0 - 1) * n + 2 * k - 1) / (2 * k)); // First i with j(i) >= j0
+    if (j1 < k) i1 = min(i1, ((2 * j1 + 1) * n + 2 * k - 1) / (2 * k) - 1); // Last i with j(i) <= j1
+    if (i0 > i1) return;
+
+    const long long den = 2 * n;
+    const long long k2 = 2 * k;
+    const long long num = 2 * i0 * k + n;
+    long long rem = i0 ? num % den : n;
+    long long i = i0;
+    int minor = (int)(n1 + sn * (i0 ? num / den : 0));
+
+    // Run-slice: consecutive steps sharing a minor coordinate form one run.
+    // A run starting at remainder r lasts ceil((den - r) / 2k) steps and leaves remainder
+    // r + steps * 2k - den, so after the first (clipped) run every run is base or base + 1 steps.
+    const long long base = den / k2, extra = den % k2;
+    long long steps = (den - rem + k2 - 1) / k2;
+    rem += steps * k2 - den;
 
     for (;;)
     {
-        ponUnsafe(x1, y1);
-        if (x1 == x2 && y1 == y2) break;
-        int e2 = err << 1;
-        if (e2 >= dy) { err += dy; x1 += sx; }
-        if (e2 <= dx) { err += dx; y1 += sy; }
+        long long end = min(i + steps - 1, i1);
+        if (run(x_major, (int)(m1 + sm * i), (int)(m1 + sm * end), minor)) return;
+
+        if (end == i1) break;
+        i = end + 1;
+        minor += sn;
+
+        if (rem < extra) { steps = base + 1; rem += k2 - extra; }
+        else { steps = base; rem -= extra; }
     }
 }
 
-void Screen::loff(int x1, int y1, int x2, int y2)
+static void lineClipped(int x1, int y1, int x2, int y2, bool on)
+{
+    lineRuns(x1, y1, x2, y2, Screen::clip, [on](bool x_major, int a, int b, int minor) {
+        if (a > b) std::swap(a, b);
+        if (x_major) hspanUnsafe(a, b, minor, on);
+        else vspanUnsafe(minor, a, b, on);
+        return false;
+    });
+}
+
+bool Screen::inBounds(int x1, int y1, int x2, int y2)
+{
+    return x1 >= 0 && x1 < width && y1 >= 0 && y1 < height &&
+        x2 >= 0 && x2 < width && y2 >= 0 && y2 < height;
+}
+
+void Screen::pset(int x, int y, bool on)
 {
-    if (!inBounds(x1, y1, x2, y2))
-        APP_FATAL << "Out of bounds. "
-        << "Coord: (" << x1 << "," << y1 << ")-(" << x2 << "," << y2 << ") "
-        << "Canvas: " << width << "x" << height;
+    if (!inClip(x, y)) return;
 
-    int dx{ std::abs(x2 - x1) }, dy{ -std::abs(y2 - y1) };
-    int sx{ (x1 < x2) ? 1 : -1 }, sy{ (y1 < y2) ? 1 : -1 };
-    int err = dx + dy;
+    markDirty(y, y);
+    int i = x + y * width;
 
-    for (;;)
-    {
-        poffUnsafe(x1, y1);
-        if (x1 == x2 && y1 == y2) break;
-        int e2 = err << 1;
-        if (e2 >= dy) { err += dy; x1 += sx; }
-        if (e2 <= dx) { err += dx; y1 += sy; }
-    }
+    // LSB first (more efficient)
+    if (on) pixels[i / 8] |= (1 << (i % 8));
+    else pixels[i / 8] &= ~(1 << (i % 8));
+}
+
+void Screen::pon(int x, int y)
+{
+    if (!inClip(x, y)) return;
+
+    markDirty(y, y);
+    int i = x + y * width;
+    pixels[i / 8] |= (1 << (i % 8)); // LSB first
+}
+
+void Screen::poff(int x, int y)
+{
+    if (!inClip(x, y)) return;
+
+    markDirty(y, y);
+    int i = x + y * width;
+    pixels[i / 8] &= ~(1 << (i % 8)); // LSB first
+}
+
+void Screen::lset(int x1, int y1, int x2, int y2, bool on)
+{
+    lineClipped(x1, y1, x2, y2, on);
+}
+
+void Screen::lon(int x1, int y1, int x2, int y2)
+{
+    lineClipped(x1, y1, x2, y2, true);
+}
+
+void Screen::loff(int x1, int y1, int x2, int y2)
+{
+    lineClipped(x1, y1, x2, y2, false);
 }
 
 void Screen::rset(int x, int y, int w, int h, bool solid, bool on)
@@ -180,67 +728,173 @@ void Screen::rset(int x, int y, int w, int h, bool solid, bool on)
     else roff(x, y, w, h, solid);
 }
 
+// Rectangle outline as four clipped spans
+static void rectOutline(int x, int y, int w, int h, bool on)
+{
+    hspanClipped(x, x + w - 1, y, on);
+    hspanClipped(x, x + w - 1, y + h - 1, on);
+
+    if (h > 2)
+    {
+        vspanClipped(x, y + 1, y + h - 2, on);
+        vspanClipped(x + w - 1, y + 1, y + h - 2, on);
+    }
+}
+
 void Screen::ron(int x, int y, int w, int h, bool solid)
 {
     if (w < 0) x -= (w = -w);
     if (h < 0) y -= (h = -h);
 
-    if (!inBounds(x, y, x + w - 1, y + h - 1))
-        APP_FATAL << "Out of bounds. "
-        << "Coord: (" << x << "," << y << ")-(" << (x + w - 1) << "," << (y + h - 1) << ") "
-        << "Canvas: " << width << "x" << height;
+    if (!w || !h) return;
 
-    if (solid)
-    {
-        for (int i = x; i < x + w; ++i)
-            for (int j = y; j < y + h; ++j)
-                ponUnsafe(i, j);
-    }
-    else
+    PatternScope pattern(x, y, solid);
+    if (solid) fillRectClipped(x, y, w, h, true);
+    else rectOutline(x, y, w, h, true);
+}
+
+void Screen::roff(int x, int y, int w, int h, bool solid)
+{
+    if (w < 0) x -= (w = -w);
+    if (h < 0) y -= (h = -h);
+
+    if (!w || !h) return;
+
+    PatternScope pattern(x, y, solid);
+    if (solid) fillRectClipped(x, y, w, h, false);
+    else rectOutline(x, y, w, h, false);
+}
+
+// a * b <= c * d, with the products taken in 128 bits
+static bool productLessEqual(uint64_t a, uint64_t b, uint64_t c, uint64_t d)
+{
+    auto mul = [](uint64_t u, uint64_t v, uint64_t& hi) {
+        uint64_t u0 = u & 0xFFFFFFFF, u1 = u >> 32, v0 = v & 0xFFFFFFFF, v1 = v >> 32;
+        uint64_t lo = u0 * v0, mid1 = u1 * v0, mid2 = u0 * v1;
+        uint64_t carry = ((lo >> 32) + (mid1 & 0xFFFFFFFF) + (mid2 & 0xFFFFFFFF)) >> 32;
+        hi = u1 * v1 + (mid1 >> 32) + (mid2 >> 32) + carry;
+        return u * v;
+    };
+    uint64_t hi1, hi2;
+    uint64_t lo1 = mul(a, b, hi1), lo2 = mul(c, d, hi2);
+    return hi1 < hi2 || (hi1 == hi2 && lo1 <= lo2);
+}
+
+// Ellipses whose w^2 * h^2 does not fit in 64 bits: each visible row finds its first inside column on its
+// own (a square root estimate, corrected with the exact test in 128 bits), so off-canvas rows cost nothing
+static void largeEllipseSpans(int x, int y, long long w, long long h, bool solid, bool on)
+{
+    const Screen::ClipRect& c = Screen::clip;
+    const long long half_w = (w + 1) / 2;
+    const uint64_t ww = (uint64_t)(w * w), hh = (uint64_t)(h * h);
+
+    // Exact inside test for the pixel centers of column px in a row with dy = 2py+1-h
+    auto inside = [&](long long px, long long dy) {
+        uint64_t dx = (uint64_t)std::llabs(2 * px + 1 - w);
+        return productLessEqual(dx * dx, hh, ww, (uint64_t)(h - dy) * (uint64_t)(h + dy));
+    };
+
+    // First inside column of the row py of the top half (half_w if the row is empty)
+    auto firstInside = [&](long long py) {
+        long long dy = 2 * py + 1 - h;
+        double t = (double)dy / (double)h;
+        double r = (double)w * std::sqrt(std::fmax(0.0, 1.0 - t * t)); // Largest |2px+1-w| inside
+        long long px = min(max((long long)std::ceil(((double)w - 1 - r) / 2), 0LL), half_w);
+        while (px > 0 && inside(px - 1, dy)) px--;
+        while (px < half_w && !inside(px, dy)) px++;
+        return px;
+    };
+
+    auto span = [&](long long a, long long b, int row) {
+        a = max(a, (long long)c.x1);
+        b = min(b, (long long)c.x2);
+        if (a <= b) hspanUnsafe((int)a, (int)b, row, on);
+    };
+
+    const int row1 = (int)max((long long)y, (long long)c.y1);
+    const int row2 = (int)min((long long)y + h - 1, (long long)c.y2);
+    for (int row = row1; row <= row2; row++)
     {
-        for (int i = x; i < x + w; ++i)
-        {
-            ponUnsafe(i, y);
-            ponUnsafe(i, y + h - 1);
-        }
+        long long py = min(row - (long long)y, y + h - 1 - (long long)row); // Mirrored into the top half
+        long long left = firstInside(py);
+        if (left >= half_w) continue;
 
-        for (int j = y + 1; j < y + h - 1; ++j)
+        if (solid) span(x + left, x + w - 1 - left, row);
+        else
         {
-            ponUnsafe(x, j);
-            ponUnsafe(x + w - 1, j);
-        }            
+            long long next = py ? firstInside(py - 1) : half_w;
+            long long right = min(max(left, next - 1), half_w - 1);
+            span(x + left, x + right, row);
+            span(x + w - 1 - right, x + w - 1 - left, row);
+        }
     }
 }
 
-void Screen::roff(int x, int y, int w, int h, bool solid)
+// Scanline rasterizer shared by circles and ellipses (x, y, w, and h define the bounding box)
+// A pixel (px,py) of the box is inside when its center lies within the inscribed ellipse:
+//   (2px+1-w)^2 * h^2 + (2py+1-h)^2 * w^2 <= w^2 * h^2
+// Walking rows from the middle outward, the first inside column only ever moves right, so
+// each row costs a few integer adds. Every row emits its spans mirrored into all four quadrants.
+static void ellipseSpans(int x, int y, int w, int h, bool solid, bool on)
 {
-    if (w < 0) x -= (w = -w);
-    if (h < 0) y -= (h = -h);
+    const Screen::ClipRect& c = Screen::clip;
+
+    if (w <= 0 || h <= 0) return;
+    if ((long long)x + w <= c.x1 || x > c.x2 || (long long)y + h <= c.y1 || y > c.y2) return;
 
-    if (!inBounds(x, y, x + w - 1, y + h - 1))
-        APP_FATAL << "Out of bounds. "
-        << "Coord: (" << x << "," << y << ")-(" << (x + w - 1) << "," << (y + h - 1) << ") "
-        << "Canvas: " << width << "x" << height;
+    PatternScope pattern(x, y, solid);
 
-    if (solid)
+    // Keeps w^2 * h^2 within 64 bits
+    if (w > 46340 || h > 46340)
     {
-        for (int i = x; i < x + w; ++i)
-            for (int j = y; j < y + h; ++j)
-                poffUnsafe(i, j);
+        largeEllipseSpans(x, y, w, h, solid, on);
+        return;
     }
-    else
+
+    const int half_w = (w + 1) / 2;
+    const int half_h = (h + 1) / 2;
+    const int64_t ww = (int64_t)w * w;
+    const int64_t hh = (int64_t)h * h;
+    const int64_t wwhh = ww * hh;
+
+    int px = 0;
+    int64_t dx = 1 - w; // 2px+1-w
+
+    // First inside column of row py (half_w if the row is empty)
+    auto firstInside = [&](int py) {
+        int64_t dy = 2 * py + 1 - h;
+        int64_t limit = wwhh - dy * dy * ww;
+        while (px < half_w && dx * dx * hh > limit) { px++; dx += 2; }
+        return px;
+    };
+
+    int left = firstInside(half_h - 1);
+
+    for (int py = half_h - 1; py >= 0 && left < half_w; py--)
     {
-        for (int i = x; i < x + w; ++i)
+        int next = py ? firstInside(py - 1) : half_w;
+        int top = y + py;
+        int bottom = y + h - 1 - py;
+
+        if (solid)
         {
-            poffUnsafe(i, y);
-            poffUnsafe(i, y + h - 1);
+            hspanClipped(x + left, x + w - 1 - left, top, on);
+            if (bottom != top) hspanClipped(x + left, x + w - 1 - left, bottom, on);
         }
-
-        for (int j = y + 1; j < y + h - 1; ++j)
+        else
         {
-            poffUnsafe(x, j);
-            poffUnsafe(x + w - 1, j);
-        }            
+            // Extend each outline run until it meets the next row's run (the topmost row is a flat cap)
+            int right = min(max(left, next - 1), half_w - 1);
+            hspanClipped(x + left, x + right, top, on);
+            hspanClipped(x + w - 1 - right, x + w - 1 - left, top, on);
+            if (bottom != top)
+            {
+                hspanClipped(x + left, x + right, bottom, on);
+                hspanClipped(x + w - 1 - right, x + w - 1 - left, bottom, on);
+            }
+        }
+
+        left = next;
     }
 }
 
@@ -261,65 +915,7 @@ void Screen::con(int x, int y, int size, bool solid)
     }
 
     // The (x,y) params specify the top-left of the circle's bounding box
-    if (!inBounds(x, y, x + size - 1, y + size - 1))
-        APP_FATAL << "Out of bounds. "
-        << "Coord: (" << x << "," << y << ")-(" << (x + size - 1) << "," << (y + size - 1) << ") "
-        << "Canvas: " << width << "x" << height;
-
-    // This algorithm has been heavily optimized
-    float r = size / 2.0f;
-    float rsq = r * r;
-
-    // Use quadrant-mirroring technique
-    int size_plus_1_by_2 = (size + 1) / 2;
-    int size_minus_1 = size - 1;
-    float point_5_minus_r = 0.5f - r;
-    int start_x = 0;
-    for (int py = size_plus_1_by_2 - 1; py >= 0 ; py--) {
-        float dy = py + point_5_minus_r;
-        float dy_sq = dy * dy;
-        float rsq_minus_dy_sq = rsq - dy_sq;
-        int y_plus_py = y + py;
-        int y_minus_py_plus_size_minus_1 = y - py + size_minus_1;
-        for (int px = start_x; px < size_plus_1_by_2; px++) {
-            float dx = px + point_5_minus_r;
-            if (dx * dx <= rsq_minus_dy_sq)
-            {
-                start_x = px;
-
-                ponUnsafe(x + px, y_plus_py);
-                ponUnsafe(x + px, y_minus_py_plus_size_minus_1);
-                ponUnsafe(x - px + size_minus_1, y_plus_py);
-                ponUnsafe(x - px + size_minus_1, y_minus_py_plus_size_minus_1);
-
-                if (solid)
-                {
-                    while (++px < size_plus_1_by_2)
-                    {
-                        ponUnsafe(x + px, y_plus_py);
-                        ponUnsafe(x + px, y_minus_py_plus_size_minus_1);
-                        ponUnsafe(x - px + size_minus_1, y_plus_py);
-                        ponUnsafe(x - px + size_minus_1, y_minus_py_plus_size_minus_1);
-                    }
-                    break;
-                }
-                else if (py)
-                {
-                    int test_py = py - 1;
-                    int test_px = px + 1;
-
-                    float test_dy = test_py + point_5_minus_r;
-                    float test_dy_sq = test_dy * test_dy;
-                    float rsq_minus_test_dy_sq = rsq - test_dy_sq;
-
-                    float test_dx = test_px + point_5_minus_r;
-
-                    if (test_dx * test_dx <= rsq_minus_test_dy_sq)
-                        break;
-                }
-            }
-        }
-    }
+    ellipseSpans(x, y, size, size, solid, true);
 }
 
 // Clear circle (x, y, and size define the logical square in which the circle sits)
@@ -333,65 +929,7 @@ void Screen::coff(int x, int y, int size, bool solid)
     }
 
     // The (x,y) params specify the top-left of the circle's bounding box
-    if (!inBounds(x, y, x + size - 1, y + size - 1))
-        APP_FATAL << "Out of bounds. "
-        << "Coord: (" << x << "," << y << ")-(" << (x + size - 1) << "," << (y + size - 1) << ") "
-        << "Canvas: " << width << "x" << height;
-
-    // This algorithm has been heavily optimized
-    float r = size / 2.0f;
-    float rsq = r * r;
-
-    // Use quadrant-mirroring technique
-    int size_plus_1_by_2 = (size + 1) / 2;
-    int size_minus_1 = size - 1;
-    float point_5_minus_r = 0.5f - r;
-    int start_x = 0;
-    for (int py = size_plus_1_by_2 - 1; py >= 0; py--) {
-        float dy = py + point_5_minus_r;
-        float dy_sq = dy * dy;
-        float rsq_minus_dy_sq = rsq - dy_sq;
-        int y_plus_py = y + py;
-        int y_minus_py_plus_size_minus_1 = y - py + size_minus_1;
-        for (int px = start_x; px < size_plus_1_by_2; px++) {
-            float dx = px + point_5_minus_r;
-            if (dx * dx <= rsq_minus_dy_sq)
-            {
-                start_x = px;
-
-                poffUnsafe(x + px, y_plus_py);
-                poffUnsafe(x + px, y_minus_py_plus_size_minus_1);
-                poffUnsafe(x - px + size_minus_1, y_plus_py);
-                poffUnsafe(x - px + size_minus_1, y_minus_py_plus_size_minus_1);
-
-                if (solid)
-                {
-                    while (++px < size_plus_1_by_2)
-                    {
-                        poffUnsafe(x + px, y_plus_py);
-                        poffUnsafe(x + px, y_minus_py_plus_size_minus_1);
-                        poffUnsafe(x - px + size_minus_1, y_plus_py);
-                        poffUnsafe(x - px + size_minus_1, y_minus_py_plus_size_minus_1);
-                    }
-                    break;
-                }
-                else if (py)
-                {
-                    int test_py = py - 1;
-                    int test_px = px + 1;
-
-                    float test_dy = test_py + point_5_minus_r;
-                    float test_dy_sq = test_dy * test_dy;
-                    float rsq_minus_test_dy_sq = rsq - test_dy_sq;
-
-                    float test_dx = test_px + point_5_minus_r;
-
-                    if (test_dx * test_dx <= rsq_minus_test_dy_sq)
-                        break;
-                }
-            }
-        }
-    }
+    ellipseSpans(x, y, size, size, solid, false);
 }
 
 void Screen::eset(int x, int y, int w, int h, bool solid, bool on)
@@ -406,164 +944,581 @@ void Screen::eon(int x, int y, int w, int h, bool solid)
     if (w < 0) x -= (w = -w);
     if (h < 0) y -= (h = -h);
 
-    if (!inBounds(x, y, x + w - 1, y + h - 1))
-        APP_FATAL << "Out of bounds. "
-        << "Coord: (" << x << "," << y << ")-(" << (x + w - 1) << "," << (y + h - 1) << ") "
-        << "Canvas: " << width << "x" << height;
+    ellipseSpans(x, y, w, h, solid, true);
+}
+
+// Clear an ellipse (x, y, w, and h define the logical rectangle in which the ellipse sits)
+void Screen::eoff(int x, int y, int w, int h, bool solid)
+{
+    if (w < 0) x -= (w = -w);
+    if (h < 0) y -= (h = -h);
 
-    float a = w / 2.0f;
-    float b = h / 2.0f;
+    ellipseSpans(x, y, w, h, solid, false);
+}
 
-    float a_sq = a * a;
-    float b_sq = b * b;
+// Scanline polygon fill. Vertices sit on pixel centers; a pixel is filled when its center is
+// inside the polygon or on its boundary. Each edge covers the rows y1 <= y < y2 (so shared
+// vertices are counted once) and its crossing with row y is the exact fraction
+//   x1 + (y - y1) * (x2 - x1) / (y2 - y1)
+// A y-monotone polygon (every convex polygon and triangle) has exactly two crossings per row,
+// so it is walked as two chains of edges. Other polygons use an active edge list sorted per
+// row, filled between crossings by the even-odd or nonzero winding rule.
+// With shift > 0 the vertices are in 1/(1 << shift) pixel units (rows and pixel centers sit on
+// multiples of 1 << shift) and pixels whose centers lie on a right edge are left out, so shapes
+// that share an edge (the pieces of a thick line) have exactly the width of their geometry.
+struct PolyEdge
+{
+    int x1, y1, y2;
+    long long dx, dy; // dy > 0
+    int winding; // +1 if the edge points down, -1 if up
+};
 
-    int half_w = (w + 1) / 2;
-    int half_h = (h + 1) / 2;
+struct PolyCrossing
+{
+    long long fl, rem, dy; // Crossing = fl + rem / dy, 0 <= rem < dy
+    int winding;
 
-    int w_minus_1 = w - 1;
-    int h_minus_1 = h - 1;
+    bool operator<(const PolyCrossing& o) const { return fl != o.fl ? fl < o.fl : rem * o.dy < o.rem * dy; }
+    int left() const { return (int)(fl + (rem ? 1 : 0)); } // First pixel center at or after the crossing
+    int right() const { return (int)fl; } // Last pixel center at or before the crossing
+    int rightOpen() const { return (int)(fl - (rem ? 0 : 1)); } // Last pixel center before the crossing
+};
 
-    float x_offset = 0.5f - a;
-    float y_offset = 0.5f - b;
+// Crossing of an edge with the row whose center is at sub-row y (in pixels)
+static inline PolyCrossing crossing(const PolyEdge& e, int y, int shift)
+{
+    long long den = e.dy << shift;
+    long long num = (long long)e.x1 * e.dy + (long long)(y - e.y1) * e.dx;
+    long long fl = num / den;
+    long long rem = num % den;
+    if (rem < 0) { fl--; rem += den; }
+    return { fl, rem, den, e.winding };
+}
 
-    int start_x = 0;
+static inline int ceilShift(int v, int shift) { return -((-v) >> shift); }
 
-    for (int py = half_h - 1; py >= 0; py--)
+// Crossings of one chain of a y-monotone polygon with successive rows (top to bottom).
+// Within an edge the crossing moves by the constant fraction dx / dy per row, so only the
+// first row of each edge divides.
+struct ChainWalk
+{
+    PolyEdge** edge; // Current edge (the chain is sorted by y1)
+    int y2 = -0x7FFFFFFF - 1; // Bottom of the current edge
+    PolyCrossing pc{};
+    long long step_fl = 0, step_rem = 0; // Change of the crossing per row (0 <= step_rem < pc.dy)
+
+    const PolyCrossing& at(int sy, int shift)
+    {
+        if (sy < y2)
+        {
+            pc.fl += step_fl;
+            pc.rem += step_rem;
+            if (pc.rem >= pc.dy) { pc.rem -= pc.dy; pc.fl++; }
+            return pc;
+        }
+
+        while ((*edge)->y2 <= sy) edge++;
+        const PolyEdge& e = **edge;
+        y2 = e.y2;
+        pc = crossing(e, sy, shift);
+        long long step = e.dx << shift; // Numerator change per row (1 << shift sub-rows)
+        step_fl = step / pc.dy;
+        step_rem = step % pc.dy;
+        if (step_rem < 0) { step_fl--; step_rem += pc.dy; }
+        return pc;
+    }
+};
+
+static thread_local std::vector<PolyEdge> poly_edges; // Reused between calls
+
+static void polygonSpans(const int* xy, int n, int shift, bool on, Screen::FillRule rule)
+{
+    const Screen::ClipRect& c = Screen::clip;
+
+    poly_edges.clear();
+    int ymin = xy[1], ymax = xy[1];
+    int direction_changes = 0, last_winding = 0, first_winding = 0;
+
+    for (int i = 0; i < n; i++)
     {
-        float dy = py + y_offset;
-        float dy_sq_over_b_sq = (dy * dy) / b_sq;
+        int j = (i + 1) % n;
+        int xa = xy[i * 2], ya = xy[i * 2 + 1];
+        int xb = xy[j * 2], yb = xy[j * 2 + 1];
+        ymin = min(ymin, ya);
+        ymax = max(ymax, ya);
+        if (ya == yb) continue; // Horizontal edges only matter to the outline
+
+        PolyEdge e;
+        e.winding = ya < yb ? 1 : -1;
+        if (ya > yb) { std::swap(xa, xb); std::swap(ya, yb); }
+        e.x1 = xa; e.y1 = ya; e.y2 = yb;
+        e.dx = (long long)xb - xa;
+        e.dy = (long long)yb - ya;
+        poly_edges.push_back(e);
+
+        if (!first_winding) first_winding = e.winding;
+        else if (e.winding != last_winding) direction_changes++;
+        last_winding = e.winding;
+    }
+    if (last_winding != first_winding) direction_changes++; // Closing turn
+
+    // Rows whose centers are in ymin <= y < ymax
+    int y_first = max(ceilShift(ymin, shift), c.y1);
+    int y_last = min(ceilShift(ymax, shift) - 1, c.y2);
+    if (poly_edges.empty() || y_first > y_last) return;
 
-        float one_minus_dy_term = 1.0f - dy_sq_over_b_sq;
+    auto right = [shift](const PolyCrossing& pc) { return shift ? pc.rightOpen() : pc.right(); };
 
-        int y_top = y + py;
-        int y_bottom = y - py + h_minus_1;
+    if (direction_changes == 2 && poly_edges.size() <= 64) // y-monotone: one chain going down, one going up
+    {
+        PolyEdge* down[64];
+        PolyEdge* up[64];
+        int nd = 0, nu = 0;
 
-        for (int px = start_x; px < half_w; px++)
+        for (PolyEdge& e : poly_edges)
         {
-            float dx = px + x_offset;
-            float dx_sq_over_a_sq = (dx * dx) / a_sq;
+            if (e.winding > 0) down[nd++] = &e;
+            else up[nu++] = &e;
+        }
 
-            if (dx_sq_over_a_sq <= one_minus_dy_term)
-            {
-                start_x = px;
+        // A chain's edges cover consecutive row ranges but may wrap around the vertex list
+        auto sortChain = [](PolyEdge** chain, int count) {
+            for (int i = 1; i < count; i++)
+                for (int k = i; k > 0 && chain[k]->y1 < chain[k - 1]->y1; k--)
+                    std::swap(chain[k], chain[k - 1]);
+        };
+        sortChain(down, nd);
+        sortChain(up, nu);
+
+        ChainWalk wd{ down }, wu{ up };
+        for (int y = y_first; y <= y_last; y++)
+        {
+            int sy = y << shift;
+            const PolyCrossing& a = wd.at(sy, shift);
+            const PolyCrossing& b = wu.at(sy, shift);
+            int x1 = min(a.left(), b.left()), x2 = max(right(a), right(b));
+            if (x1 <= x2) hspanClipped(x1, x2, y, on);
+        }
+        return;
+    }
 
-                ponUnsafe(x + px, y_top);
-                ponUnsafe(x + px, y_bottom);
-                ponUnsafe(x - px + w_minus_1, y_top);
-                ponUnsafe(x - px + w_minus_1, y_bottom);
+    // General case: edges sorted by top row feed an active edge list, whose crossings are sorted each row
+    for (size_t i = 1; i < poly_edges.size(); i++)
+        for (size_t k = i; k > 0 && poly_edges[k].y1 < poly_edges[k - 1].y1; k--)
+            std::swap(poly_edges[k], poly_edges[k - 1]);
 
-                if (solid)
-                {
-                    while (++px < half_w)
-                    {
-                        ponUnsafe(x + px, y_top);
-                        ponUnsafe(x + px, y_bottom);
-                        ponUnsafe(x - px + w_minus_1, y_top);
-                        ponUnsafe(x - px + w_minus_1, y_bottom);
-                    }
-                    break;
-                }
-                else if (py)
-                {
-                    int test_py = py - 1;
-                    int test_px = px + 1;
+    static thread_local std::vector<const PolyEdge*> active;
+    static thread_local std::vector<PolyCrossing> crossings;
+    active.clear();
+    size_t next = 0;
 
-                    float test_dy = test_py + y_offset;
-                    float test_dy_sq_over_b_sq = (test_dy * test_dy) / b_sq;
-                    float test_one_minus = 1.0f - test_dy_sq_over_b_sq;
+    for (int y = y_first; y <= y_last; y++)
+    {
+        int sy = y << shift;
+        for (; next < poly_edges.size() && poly_edges[next].y1 <= sy; next++)
+            active.push_back(&poly_edges[next]);
 
-                    float test_dx = test_px + x_offset;
-                    float test_dx_sq_over_a_sq = (test_dx * test_dx) / a_sq;
+        crossings.clear();
+        size_t kept = 0;
+        for (const PolyEdge* e : active)
+        {
+            if (e->y2 <= sy) continue; // Finished
+            active[kept++] = e;
+            crossings.push_back(crossing(*e, sy, shift));
+        }
+        active.resize(kept);
 
-                    if (test_dx_sq_over_a_sq <= test_one_minus)
-                        break;
-                }
+        for (size_t i = 1; i < crossings.size(); i++)
+            for (size_t k = i; k > 0 && crossings[k] < crossings[k - 1]; k--)
+                std::swap(crossings[k], crossings[k - 1]);
+
+        if (rule == Screen::FillRule::EvenOdd)
+        {
+            for (size_t i = 0; i + 1 < crossings.size(); i += 2)
+            {
+                int x1 = crossings[i].left(), x2 = right(crossings[i + 1]);
+                if (x1 <= x2) hspanClipped(x1, x2, y, on);
+            }
+        }
+        else
+        {
+            int winding = 0;
+            int start = 0;
+            for (const PolyCrossing& pc : crossings)
+            {
+                if (!winding) start = pc.left();
+                winding += pc.winding;
+                if (!winding && start <= right(pc)) hspanClipped(start, right(pc), y, on);
             }
         }
     }
 }
 
-// Clear an ellipse (x, y, w, and h define the logical rectangle in which the ellipse sits)
-void Screen::eoff(int x, int y, int w, int h, bool solid)
+void Screen::polyset(const int* xy, int n, bool solid, bool on, FillRule rule)
+{
+    if (on) polyon(xy, n, solid, rule);
+    else polyoff(xy, n, solid, rule);
+}
+
+static void polygon(const int* xy, int n, bool solid, bool on, Screen::FillRule rule)
+{
+    if (n <= 0) return;
+
+    for (int i = 0; i < n * 2; i++)
+        if (xy[i] < -Screen::MAX_POLY_COORD || xy[i] > Screen::MAX_POLY_COORD)
+            APP_FATAL << "Polygon coordinate out of range (" << xy[i] << ")";
+
+    int left = xy[0], top = xy[1];
+    for (int i = 1; i < n; i++)
+    {
+        left = min(left, xy[i * 2]);
+        top = min(top, xy[i * 2 + 1]);
+    }
+    PatternScope pattern(left, top, solid);
+
+    if (solid && n >= 3) polygonSpans(xy, n, 0, on, rule);
+
+    // Filled polygons include their outline (it covers the bottom row and slivers thinner than a pixel)
+    for (int i = 0; i < n; i++)
+    {
+        int j = (i + 1) % n;
+        lineClipped(xy[i * 2], xy[i * 2 + 1], xy[j * 2], xy[j * 2 + 1], on);
+    }
+}
+
+void Screen::polyon(const int* xy, int n, bool solid, FillRule rule)
+{
+    polygon(xy, n, solid, true, rule);
+}
+
+void Screen::polyoff(const int* xy, int n, bool solid, FillRule rule)
+{
+    polygon(xy, n, solid, false, rule);
+}
+
+void Screen::tset(int x1, int y1, int x2, int y2, int x3, int y3, bool solid, bool on)
+{
+    int xy[6] = { x1, y1, x2, y2, x3, y3 };
+    polygon(xy, 3, solid, on, FillRule::EvenOdd);
+}
+
+void Screen::ton(int x1, int y1, int x2, int y2, int x3, int y3, bool solid)
+{
+    tset(x1, y1, x2, y2, x3, y3, solid, true);
+}
+
+void Screen::toff(int x1, int y1, int x2, int y2, int x3, int y3, bool solid)
+{
+    tset(x1, y1, x2, y2, x3, y3, solid, false);
+}
+
+// Thick lines are built from convex pieces filled by polygonSpans with vertices in 1/16 pixels:
+// a quad for each line body, quads or triangles for square caps and miter/bevel joins, and
+// polygonal discs for round caps and joins. Pieces of the same line overlap but never leave
+// gaps. Pieces out of the clip rect's reach are skipped, and bodies are clipped (Liang-Barsky)
+// to a fixed square that keeps their sub-pixel vertices within MAX_POLY_COORD.
+static constexpr int LINE_SUBPIXEL_SHIFT = 4;
+static constexpr double LINE_COORD_LIMIT = (Screen::MAX_POLY_COORD >> LINE_SUBPIXEL_SHIFT) - Screen::MAX_LINE_WIDTH;
+static constexpr double MITER_LIMIT = 4.0; // Longest miter, center to tip, in half widths (SVG's default)
+
+struct LinePoint { double x, y; };
+
+static void fillLinePiece(const LinePoint* p, int n, bool on)
+{
+    static thread_local std::vector<int> xy; // Reused between calls
+    xy.resize(n * 2);
+    for (int i = 0; i < n; i++)
+    {
+        xy[i * 2] = (int)std::lround(p[i].x * (1 << LINE_SUBPIXEL_SHIFT));
+        xy[i * 2 + 1] = (int)std::lround(p[i].y * (1 << LINE_SUBPIXEL_SHIFT));
+    }
+    polygonSpans(xy.data(), n, LINE_SUBPIXEL_SHIFT, on, Screen::FillRule::NonZero);
+}
+
+// True if p is within margin pixels of the clip rect
+static bool nearClip(LinePoint p, double margin)
+{
+    const Screen::ClipRect& c = Screen::clip;
+    return p.x >= c.x1 - margin && p.x <= c.x2 + margin && p.y >= c.y1 - margin && p.y <= c.y2 + margin;
+}
+
+static void lineDisc(LinePoint center, double radius, bool on)
+{
+    if (!nearClip(center, radius + 1)) return;
+
+    // Enough vertices to keep the polygon within 1/8 pixel of the circle
+    static thread_local std::vector<LinePoint> p;
+    int n = max(8, (int)std::ceil(6.2832 * std::sqrt(radius)));
+    p.resize(n);
+    for (int i = 0; i < n; i++)
+    {
+        double a = 6.283185307179586 * i / n;
+        p[i] = { center.x + radius * std::cos(a), center.y + radius * std::sin(a) };
+    }
+    fillLinePiece(p.data(), n, on);
+}
+
+// Body of a line from a to b (distinct points); square caps extend it by half the width
+static void lineBody(LinePoint a, LinePoint b, double half, bool square_a, bool square_b, bool on)
+{
+    const Screen::ClipRect& c = Screen::clip;
+
+    double len = std::hypot(b.x - a.x, b.y - a.y);
+    double ux = (b.x - a.x) / len, uy = (b.y - a.y) / len;
+    if (square_a) { a.x -= ux * half; a.y -= uy * half; }
+    if (square_b) { b.x += ux * half; b.y += uy * half; }
+
+    // Trivial reject (both ends further than half the width beyond the same clip edge)
+    if (max(a.x, b.x) < c.x1 - half - 1 || min(a.x, b.x) > c.x2 + half + 1 ||
+        max(a.y, b.y) < c.y1 - half - 1 || min(a.y, b.y) > c.y2 + half + 1) return;
+
+    // Liang-Barsky (the same square whatever the clip rect, so clipping never moves a pixel)
+    const double lim = LINE_COORD_LIMIT;
+    const double dx = b.x - a.x, dy = b.y - a.y;
+    const double p[4] = { -dx, dx, -dy, dy };
+    const double q[4] = { a.x + lim, lim - a.x, a.y + lim, lim - a.y };
+    double t0 = 0, t1 = 1;
+    for (int i = 0; i < 4; i++)
+    {
+        if (p[i] == 0)
+        {
+            if (q[i] < 0) return;
+            continue;
+        }
+        double t = q[i] / p[i];
+        if (p[i] < 0) t0 = std::fmax(t0, t);
+        else t1 = std::fmin(t1, t);
+        if (t0 > t1) return;
+    }
+
+    const double nx = -uy * half, ny = ux * half;
+    const LinePoint s = { a.x + dx * t0, a.y + dy * t0 }, e = { a.x + dx * t1, a.y + dy * t1 };
+    const LinePoint quad[4] = { { s.x + nx, s.y + ny }, { e.x + nx, e.y + ny }, { e.x - nx, e.y - ny }, { s.x - nx, s.y - ny } };
+    fillLinePiece(quad, 4, on);
+}
+
+// A zero-length line: a disc for round caps, otherwise a square
+static void lineDot(LinePoint p, double half, Screen::LineCap cap, bool on)
+{
+    if (cap == Screen::LineCap::Round) { lineDisc(p, half, on); return; }
+    if (!nearClip(p, half + 1)) return;
+
+    const LinePoint quad[4] = { { p.x - half, p.y - half }, { p.x + half, p.y - half }, { p.x + half, p.y + half }, { p.x - half, p.y + half } };
+    fillLinePiece(quad, 4, on);
+}
+
+static void thickLine(LinePoint a, LinePoint b, double half, Screen::LineCap cap_a, Screen::LineCap cap_b, bool on)
+{
+    lineBody(a, b, half, cap_a == Screen::LineCap::Square, cap_b == Screen::LineCap::Square, on);
+    if (cap_a == Screen::LineCap::Round) lineDisc(a, half, on);
+    if (cap_b == Screen::LineCap::Round) lineDisc(b, half, on);
+}
+
+// Fills the outside of the corner at p between lines a->p and p->b (all distinct)
+static void lineJoin(LinePoint a, LinePoint p, LinePoint b, double half, Screen::LineJoin join, bool on)
+{
+    if (join == Screen::LineJoin::Round) { lineDisc(p, half, on); return; }
+    if (!nearClip(p, half * MITER_LIMIT + 1)) return;
+
+    double la = std::hypot(p.x - a.x, p.y - a.y), lb = std::hypot(b.x - p.x, b.y - p.y);
+    double uax = (p.x - a.x) / la, uay = (p.y - a.y) / la;
+    double ubx = (b.x - p.x) / lb, uby = (b.y - p.y) / lb;
+    double cross = uax * uby - uay * ubx;
+    if (std::fabs(cross) < 1e-9) return; // Straight on, or turning back (no outside to fill)
+
+    // Unit normals on the outside of the turn
+    double side = cross > 0 ? -1 : 1;
+    double nax = -uay * side, nay = uax * side;
+    double nbx = -uby * side, nby = ubx * side;
+    const LinePoint oa = { p.x + nax * half, p.y + nay * half }, ob = { p.x + nbx * half, p.y + nby * half };
+
+    // The miter tip is half / cos(theta / 2) from p along the bisector of the normals
+    double d = 1 + nax * nbx + nay * nby;
+    if (join == Screen::LineJoin::Miter && d * MITER_LIMIT * MITER_LIMIT >= 2)
+    {
+        const LinePoint quad[4] = { p, oa, { p.x + (nax + nbx) * half / d, p.y + (nay + nby) * half / d }, ob };
+        fillLinePiece(quad, 4, on);
+    }
+    else
+    {
+        const LinePoint tri[3] = { p, oa, ob };
+        fillLinePiece(tri, 3, on);
+    }
+}
+
+static void checkLineWidth(int width)
+{
+    if (width > Screen::MAX_LINE_WIDTH)
+        APP_FATAL << "Line too wide (" << width << ")";
+}
+
+void Screen::lset(int x1, int y1, int x2, int y2, bool on, int width, LineCap cap)
+{
+    checkLineWidth(width);
+    if (width <= 1) { lineClipped(x1, y1, x2, y2, on); return; }
+
+    const LinePoint a = { (double)x1, (double)y1 }, b = { (double)x2, (double)y2 };
+    if (x1 == x2 && y1 == y2) lineDot(a, width * 0.5, cap, on);
+    else thickLine(a, b, width * 0.5, cap, cap, on);
+}
+
+void Screen::lon(int x1, int y1, int x2, int y2, int width, LineCap cap)
+{
+    lset(x1, y1, x2, y2, true, width, cap);
+}
+
+void Screen::loff(int x1, int y1, int x2, int y2, int width, LineCap cap)
+{
+    lset(x1, y1, x2, y2, false, width, cap);
+}
+
+void Screen::lsets(const int* xy, int n, bool on, int width, LineCap cap)
+{
+    for (int i = 0; i < n; i++, xy += 4)
+        lset(xy[0], xy[1], xy[2], xy[3], on, width, cap);
+}
+
+void Screen::lsetsc(const int* xy, int n, bool on, int width, LineJoin join, LineCap cap)
+{
+    checkLineWidth(width);
+    if (n <= 0) return;
+
+    if (width <= 1)
+    {
+        for (int i = 1; i < n; i++, xy += 2)
+            lineClipped(xy[0], xy[1], xy[2], xy[3], on);
+        return;
+    }
+
+    // Repeated points would have no direction
+    static thread_local std::vector<LinePoint> p;
+    p.clear();
+    for (int i = 0; i < n; i++)
+    {
+        LinePoint q = { (double)xy[i * 2], (double)xy[i * 2 + 1] };
+        if (p.empty() || q.x != p.back().x || q.y != p.back().y) p.push_back(q);
+    }
+
+    const double half = width * 0.5;
+    const int last = (int)p.size() - 1;
+    if (!last) { lineDot(p[0], half, cap, on); return; }
+
+    for (int i = 0; i < last; i++)
+        thickLine(p[i], p[i + 1], half, i == 0 ? cap : LineCap::Butt, i == last - 1 ? cap : LineCap::Butt, on);
+
+    for (int i = 1; i < last; i++)
+        lineJoin(p[i - 1], p[i], p[i + 1], half, join, on);
+}
+
+// Scanline flood fill. Every span of target pixels (those not yet in the fill state) is found
+// with 64-pixel word scans (count trailing/leading zeros), filled at once, and pushed so that
+// the rows above and below it are searched for touching spans. Filled pixels are no longer
+// targets, so each span is visited once. The fill never leaves the clip rect.
+struct FillSpan
+{
+    int x1, x2, y;
+    int dy; // Row to search next: y + dy
+};
+
+// Last pixel of the run of target pixels starting at x (which must be one), limited to xmax
+static int fillRunRight(const unsigned char* row, int stride, int x, int xmax, bool target)
+{
+    for (;;)
+    {
+        uint64_t w = rowBits(row, stride, x);
+        uint64_t stop = target ? ~w : w; // Bits that end the run
+        if (stop) return min(x + std::countr_zero(stop) - 1, xmax);
+        x += 64;
+        if (x > xmax) return xmax;
+    }
+}
+
+// First pixel of the run of target pixels ending at x (which must be one), limited to xmin
+static int fillRunLeft(const unsigned char* row, int stride, int x, int xmin, bool target)
 {
-    if (w < 0) x -= (w = -w);
-    if (h < 0) y -= (h = -h);
+    for (;;)
+    {
+        uint64_t w = rowBits(row, stride, x - 63);
+        uint64_t stop = target ? ~w : w;
+        if (stop) return max(x - std::countl_zero(stop) + 1, xmin);
+        x -= 64;
+        if (x < xmin) return xmin;
+    }
+}
+
+static std::vector<FillSpan> fill_stack; // Reused between calls
 
-    if (!inBounds(x, y, x + w - 1, y + h - 1))
-        APP_FATAL << "Out of bounds. "
-        << "Coord: (" << x << "," << y << ")-(" << (x + w - 1) << "," << (y + h - 1) << ") "
-        << "Canvas: " << width << "x" << height;
+int Screen::fset(int x, int y, bool on, int connectivity)
+{
+    if (connectivity != 4 && connectivity != 8)
+        APP_FATAL << "Fill connectivity must be 4 or 8 (" << connectivity << ")";
 
-    float a = w / 2.0f;
-    float b = h / 2.0f;
+    if (!inClip(x, y)) return 0;
 
-    float a_sq = a * a;
-    float b_sq = b * b;
+    const int stride = width >> 3;
+    const bool target = !on;
+    const int d = connectivity == 8 ? 1 : 0; // Diagonal neighbors widen the search by a pixel
 
-    int half_w = (w + 1) / 2;
-    int half_h = (h + 1) / 2;
+    const unsigned char* row = pixels + y * stride;
+    if ((((row[x >> 3] >> (x & 7)) & 1) != 0) != target) return 0;
 
-    int w_minus_1 = w - 1;
-    int h_minus_1 = h - 1;
+    int count = 0;
+    auto fillRun = [&](int x1, int x2, int y) {
+        hspanUnsafe(x1, x2, y, on);
+        count += x2 - x1 + 1;
+    };
 
-    float x_offset = 0.5f - a;
-    float y_offset = 0.5f - b;
+    int x1 = fillRunLeft(row, stride, x, clip.x1, target);
+    int x2 = fillRunRight(row, stride, x, clip.x2, target);
+    fillRun(x1, x2, y);
 
-    int start_x = 0;
+    fill_stack.clear();
+    fill_stack.push_back({ x1, x2, y, -1 });
+    fill_stack.push_back({ x1, x2, y, 1 });
 
-    for (int py = half_h - 1; py >= 0; py--)
+    while (!fill_stack.empty())
     {
-        float dy = py + y_offset;
-        float dy_sq_over_b_sq = (dy * dy) / b_sq;
-
-        float one_minus_dy_term = 1.0f - dy_sq_over_b_sq;
+        FillSpan s = fill_stack.back();
+        fill_stack.pop_back();
 
-        int y_top = y + py;
-        int y_bottom = y - py + h_minus_1;
+        int ny = s.y + s.dy;
+        if (ny < clip.y1 || ny > clip.y2) continue;
+        row = pixels + ny * stride;
 
-        for (int px = start_x; px < half_w; px++)
+        // Runs of row ny touching the span
+        int lo = s.x1 - d, hi = s.x2 + d;
+        int sx = max(lo, clip.x1), end = min(hi, clip.x2);
+        while (sx <= end)
         {
-            float dx = px + x_offset;
-            float dx_sq_over_a_sq = (dx * dx) / a_sq;
-
-            if (dx_sq_over_a_sq <= one_minus_dy_term)
+            if ((((row[sx >> 3] >> (sx & 7)) & 1) != 0) != target)
             {
-                start_x = px;
-
-                poffUnsafe(x + px, y_top);
-                poffUnsafe(x + px, y_bottom);
-                poffUnsafe(x - px + w_minus_1, y_top);
-                poffUnsafe(x - px + w_minus_1, y_bottom);
-
-                if (solid)
-                {
-                    while (++px < half_w)
-                    {
-                        poffUnsafe(x + px, y_top);
-                        poffUnsafe(x + px, y_bottom);
-                        poffUnsafe(x - px + w_minus_1, y_top);
-                        poffUnsafe(x - px + w_minus_1, y_bottom);
-                    }
-                    break;
-                }
-                else if (py)
-                {
-                    int test_py = py - 1;
-                    int test_px = px + 1;
+                sx = fillRunRight(row, stride, sx, end, !target) + 1; // Skip to the next target pixel
+                continue;
+            }
 
-                    float test_dy = test_py + y_offset;
-                    float test_dy_sq_over_b_sq = (test_dy * test_dy) / b_sq;
-                    float test_one_minus = 1.0f - test_dy_sq_over_b_sq;
+            int r1 = fillRunLeft(row, stride, sx, clip.x1, target);
+            int r2 = fillRunRight(row, stride, sx, clip.x2, target);
+            fillRun(r1, r2, ny);
 
-                    float test_dx = test_px + x_offset;
-                    float test_dx_sq_over_a_sq = (test_dx * test_dx) / a_sq;
+            // Keep going the same way; where the run overhangs the span, also look back
+            fill_stack.push_back({ r1, r2, ny, s.dy });
+            if (r1 < s.x1 || r2 > s.x2) fill_stack.push_back({ r1, r2, ny, -s.dy });
 
-                    if (test_dx_sq_over_a_sq <= test_one_minus)
-                        break;
-                }
-            }
+            sx = r2 + 2;
         }
     }
+
+    return count;
+}
+
+int Screen::fon(int x, int y, int connectivity)
+{
+    return fset(x, y, true, connectivity);
+}
+
+int Screen::foff(int x, int y, int connectivity)
+{
+    return fset(x, y, false, connectivity);
 }
 
 void Screen::locate(int row, int col)
@@ -584,30 +1539,50 @@ void Screen::locate(int row, int col)
     cursor.row = row; cursor.col = col;
 }
 
-void Screen::print(int index, bool inverted)
+// Draw a glyph into the cell at (row, col), keeping only the rows and bits inside the clip rect
+// The cell may lie partly or entirely outside the canvas
+void Screen::glyphAt(int index, int row, int col, bool inverted)
 {
     MonospaceMonochromePixelFont& font = *Screen::font;
-    if (index < 0 || index >= font.num_glyphs) app.fatal("Glyph index out of range.");
-
     int glyph_height = font.glyph_height;
     int cols_per_row = width / font.glyph_width;
-    int byte_index = cursor.col + cursor.row * cols_per_row * glyph_height;
-    byte_index += text_offset_y * cols_per_row;
+    long long x = (long long)col * font.glyph_width;
+    long long y = (long long)row * glyph_height + text_offset_y;
+
+    if (x + 7 < clip.x1 || x > clip.x2 || y + glyph_height - 1 < clip.y1 || y > clip.y2) return;
+
+    int r0 = (int)max(0ll, clip.y1 - y);
+    int r1 = (int)min((long long)glyph_height - 1, clip.y2 - y);
+
+    unsigned char m = 0xFF; // Visible bits of the cell's byte
+    if (x < clip.x1) m &= (unsigned char)(0xFF << (clip.x1 - x));
+    if (x + 7 > clip.x2) m &= (unsigned char)(0xFF >> (x + 7 - clip.x2));
+
+    markDirty((int)y + r0, (int)y + r1);
 
-    Glyph glyph = font.glyphs[index];
-    unsigned char* row = glyph.row;
-    unsigned char* pixels = Screen::pixels + byte_index;
+    const unsigned char* glyph_row = font.glyphs[index].row;
+    unsigned char* pixels = Screen::pixels + (y + r0) * cols_per_row + col;
+    unsigned char flip = inverted ? 0xFF : 0;
 
-    if (inverted)
-        for (int r = 0; r < glyph_height; r++)
-            pixels[r * cols_per_row] = ~row[r];
+    if (m == 0xFF)
+        for (int r = r0; r <= r1; r++, pixels += cols_per_row)
+            *pixels = glyph_row[r] ^ flip;
     else
-        for (int r = 0; r < glyph_height; r++)
-            pixels[r * cols_per_row] = row[r];
+        for (int r = r0; r <= r1; r++, pixels += cols_per_row)
+            *pixels = (*pixels & ~m) | ((glyph_row[r] ^ flip) & m);
+}
+
+void Screen::print(int index, bool inverted)
+{
+    MonospaceMonochromePixelFont& font = *Screen::font;
+    if (index < 0 || index >= font.num_glyphs) app.fatal("Glyph index out of range.");
 
+    glyphAt(index, cursor.row, cursor.col, inverted);
+
+    int cols_per_row = width / font.glyph_width;
     if (++cursor.col == cols_per_row)
     {
-        int rows = height / glyph_height;
+        int rows = height / font.glyph_height;
         if (++cursor.row >= rows) cursor.row -= rows;
         cursor.col -= cols_per_row;
     }
@@ -803,23 +1778,35 @@ void Screen::printInt(int n, bool inverted)
     print("(Out of range)", inverted);
 }
 
+// Range of text cells that overlap the clip rect (may extend one cell past the text grid)
+static void visibleCells(int& row1, int& col1, int& row2, int& col2)
+{
+    const Screen::ClipRect& c = Screen::clip;
+    MonospaceMonochromePixelFont& font = *Screen::font;
+
+    auto floorDiv = [](int a, int b) { return a / b - (a % b < 0 ? 1 : 0); };
+    row1 = floorDiv(c.y1 - Screen::text_offset_y, font.glyph_height);
+    row2 = floorDiv(c.y2 - Screen::text_offset_y, font.glyph_height);
+    col1 = c.x1 / font.glyph_width;
+    col2 = c.x2 / font.glyph_width;
+}
+
 void Screen::textFill(int row, int col, int rows, int cols, int glyph, bool inverted)
 {
     if (rows < 1 || cols < 1)
         APP_FATAL << "invalid size [" << rows << "x" << cols << "]";
 
-    int erow = row + rows - 1;
-    int ecol = col + cols - 1;
+    if (glyph < 0 || glyph >= font->num_glyphs) app.fatal("Glyph index out of range.");
 
-    if (row < 0 || col < 0 || erow >= Screen::rows || ecol >= Screen::cols)
-        APP_FATAL << "out of bounds [" << row << "," << col << "]-[" << erow << "," << ecol << "]";
+    int vrow1, vcol1, vrow2, vcol2;
+    visibleCells(vrow1, vcol1, vrow2, vcol2);
 
-    for (int r = row; r <= erow; r++)
-    {
-        locate(r, col);
-        int l = cols + 1;
-        while (--l) print(glyph, inverted);
-    }
+    int erow = min(row + rows - 1, vrow2);
+    int ecol = min(col + cols - 1, vcol2);
+
+    for (int r = max(row, vrow1); r <= erow; r++)
+        for (int c = max(col, vcol1); c <= ecol; c++)
+            glyphAt(glyph, r, c, inverted);
 }
 
 void Screen::textBox(int row, int col, int rows, int cols, int border_style, int fill_glyph, bool inverted)
@@ -830,12 +1817,11 @@ void Screen::textBox(int row, int col, int rows, int cols, int border_style, int
     if (border_style < 0 || border_style > 3)
         APP_FATAL << "invalid border style (" << border_style << ")";
 
+    if (fill_glyph < 0 || fill_glyph >= font->num_glyphs) app.fatal("Glyph index out of range.");
+
     int erow = row + rows - 1;
     int ecol = col + cols - 1;
 
-    if (row < 0 || col < 0 || erow >= Screen::rows || ecol >= Screen::cols)
-        APP_FATAL << "out of bounds [" << row << "," << col << "]-[" << erow << "," << ecol << "]";
-
     int topleft;
     int topright;
     int bottomleft;
@@ -866,30 +1852,25 @@ void Screen::textBox(int row, int col, int rows, int cols, int border_style, int
         topleft = topright = bottomleft = bottomright = horizontal = vertical = fill_glyph;
     }
 
-    locate(row, col);
-    print(topleft, inverted);
-    locate(row, ecol);
-    print(topright, inverted);
-    locate(erow, col);
-    print(bottomleft, inverted);
-    locate(erow, ecol);
-    print(bottomright, inverted);
+    glyphAt(topleft, row, col, inverted);
+    glyphAt(topright, row, ecol, inverted);
+    glyphAt(bottomleft, erow, col, inverted);
+    glyphAt(bottomright, erow, ecol, inverted);
 
-    locate(row, col + 1);
-    int c = col;
-    while (++c < ecol) print(horizontal, inverted);
+    // Edges (only the cells that can be visible are visited)
+    int vrow1, vcol1, vrow2, vcol2;
+    visibleCells(vrow1, vcol1, vrow2, vcol2);
 
-    locate(erow, col + 1);
-    c = col;
-    while (++c < ecol) print(horizontal, inverted);
+    for (int c = max(col + 1, vcol1), c2 = min(ecol - 1, vcol2); c <= c2; c++)
+    {
+        glyphAt(horizontal, row, c, inverted);
+        glyphAt(horizontal, erow, c, inverted);
+    }
 
-    int r = row;
-    while (++r < erow)
+    for (int r = max(row + 1, vrow1), r2 = min(erow - 1, vrow2); r <= r2; r++)
     {
-        locate(r, col);
-        print(vertical, inverted);
-        locate(r, ecol);
-        print(vertical, inverted);
+        glyphAt(vertical, r, col, inverted);
+        glyphAt(vertical, r, ecol, inverted);
     }
 
     if (fill_glyph && rows > 2 && cols > 2) textFill(row + 1, col + 1, rows - 2, cols - 2, fill_glyph, inverted);
@@ -903,15 +1884,9 @@ void Screen::scrollbarV(int row, int col, int length, int current_scroll, int ma
     if (length <= 0 || max_scroll <= 0 || visible_rows <= 0)
         APP_FATAL << "invalid params (length=" << length << ", max_scroll=" << max_scroll << ", visible_rows=" << visible_rows << ")";
 
-    if (row < 0 || row + length - 1 >= rows || col < 0 || col >= cols)
-        APP_FATAL << "out of bounds [" << row << "," << col << "]-[" << row + length - 1 << "," << col << "]";
-
     // Draw track
     for (int r = 0; r < length; r++)
-    {
-        locate(row + r, col);
-        print(176);
-    }
+        glyphAt(176, row + r, col, false);
 
     // Thumb size proportional to the visible/total ratio
     int total_lines = visible_rows + max_scroll;
@@ -925,10 +1900,7 @@ void Screen::scrollbarV(int row, int col, int length, int current_scroll, int ma
 
     // Draw thumb
     for (int i = 0; i < thumb_height; i++)
-    {
-        locate(row + thumb_offset + i, col);
-        print(219);
-    }
+        glyphAt(219, row + thumb_offset + i, col, false);
 }
 
 void Screen::scrollbarH(int row, int col, int length, int current_scroll, int max_scroll, int visible_cols)
@@ -936,12 +1908,9 @@ void Screen::scrollbarH(int row, int col, int length, int current_scroll, int ma
     if (length <= 0 || max_scroll <= 0 || visible_cols <= 0)
         APP_FATAL << "invalid params (length=" << length << ", max_scroll=" << max_scroll << ", visible_cols=" << visible_cols << ")";
 
-    if (row < 0 || row >= rows || col < 0 || col + length - 1 >= cols)
-        APP_FATAL << "out of bounds [" << row << "," << col << "]-[" << row << "," << col + length - 1 << "]";
-
     // Draw track
-    locate(row, col);
-    repeat(176, length);
+    for (int c = 0; c < length; c++)
+        glyphAt(176, row, col + c, false);
 
     // Thumb size proportional to the visible/total ratio
     int total_cols = visible_cols + max_scroll;
@@ -954,8 +1923,8 @@ void Screen::scrollbarH(int row, int col, int length, int current_scroll, int ma
         : 0;
 
     // Draw thumb
-    locate(row, col + thumb_offset);
-    repeat(219, thumb_width);
+    for (int i = 0; i < thumb_width; i++)
+        glyphAt(219, row, col + thumb_offset + i, false);
 }
 
 void Screen::image(Image* image, int row, int col, bool draw_bg, int dy)
@@ -966,49 +1935,549 @@ void Screen::image(Image* image, int row, int col, bool draw_bg, int dy)
 
     if (x % 8) app.fatal("Image x not a multiple of 8");
 
-    const int image_width = image->width;
-    const int image_height = image->height;
+    blitClipped(image, x, y, draw_bg ? CanvasKernels::Op::Copy : CanvasKernels::Op::Or, nullptr);
+}
+
+void Screen::blit(const Image* image, int x, int y, CanvasKernels::Op op, const Image* mask)
+{
+    if (mask && (mask->width != image->width || mask->height != image->height))
+        APP_FATAL << "Mask size " << mask->width << "x" << mask->height
+        << " does not match image size " << image->width << "x" << image->height;
+
+    blitClipped(image, x, y, op, mask);
+}
+
+void Screen::blitRect(const Image* source, int sx, int sy, int w, int h, int x, int y, CanvasKernels::Op op)
+{
+    if (w <= 0 || h <= 0) return;
+
+    // Limit the rect to the source, then its destination to the clip
+    long long x1 = max((long long)sx, 0LL), x2 = min((long long)sx + w, (long long)source->width);
+    long long y1 = max((long long)sy, 0LL), y2 = min((long long)sy + h, (long long)source->height);
+    if (x1 >= x2 || y1 >= y2) return;
 
-    if (x < 0 || y < 0 || x + image_width > width || y + image_height > height)
-        APP_FATAL << "Out of bounds. "
-        << "Coord: (" << x << "," << y << ")-(" << (x + image_width - 1) << "," << (y + image_height - 1) << ") "
-        << "Canvas: " << width << "x" << height;
+    long long dx = x + (x1 - sx), dy = y + (y1 - sy);
+    long long cx1 = max(dx, (long long)clip.x1), cx2 = min(dx + (x2 - x1) - 1, (long long)clip.x2);
+    long long cy1 = max(dy, (long long)clip.y1), cy2 = min(dy + (y2 - y1) - 1, (long long)clip.y2);
+    if (cx1 > cx2 || cy1 > cy2) return;
+
+    markDirty((int)cy1, (int)cy2);
+    blitUnsafe(pixels, width / 8, (int)cx1, (int)cy1, source->pixels, source->width / 8,
+        (int)(x1 + cx1 - dx), (int)(y1 + cy1 - dy), (int)(cx2 - cx1 + 1), (int)(cy2 - cy1 + 1), op);
+}
+
+// Writes n decoded image bytes (lit, or rep repeated when lit is null) whose first pixel is canvas column px,
+// limited to columns cx1..cx2 of the row. combine(d, s, m) applies op to the pixels of mask m.
+template <typename Combine>
+static inline void packedSpan(unsigned char* drow, int px, const unsigned char* lit, unsigned char rep, int n,
+    int cx1, int cx2, CanvasKernels::Op op, Combine combine)
+{
+    const int x1 = max(px, cx1), x2 = min(px + 8 * n - 1, cx2);
+    if (x1 > x2) return;
 
-    int byte_index = (x + y * width) / 8;
+    if (!(px & 7) && x1 == px && x2 == px + 8 * n - 1) // Whole bytes: the common case for aligned blits
+    {
+        unsigned char* d = drow + (px >> 3);
+        if (n >= 16 && lit) CanvasKernels::combine(d, lit, n, op); // Long spans are worth a kernel call
+        else if (n >= 16 && op == CanvasKernels::Op::Copy) CanvasKernels::fill(d, n, rep);
+        else if (lit) for (int i = 0; i < n; i++) d[i] = combine(d[i], lit[i], 0xFF);
+        else for (int i = 0; i < n; i++) d[i] = combine(d[i], rep, 0xFF);
+        return;
+    }
 
-    const unsigned char* image_pixels = image->pixels;
+    const int s = px & 7, pb = px >> 3; // Canvas byte j takes bits from image bytes k - 1 and k, where k = j - pb
+    const int j1 = x1 >> 3, j2 = x2 >> 3;
+    auto at = [&](int k) -> unsigned { return k < 0 || k >= n ? 0u : lit ? lit[k] : rep; };
+    auto edge = [&](int j)
+    {
+        int lo = max(x1 - 8 * j, 0), hi = min(x2 - 8 * j, 7);
+        unsigned char m = (unsigned char)((0xFF >> (7 - hi + lo)) << lo);
+        unsigned char v = (unsigned char)((at(j - pb - 1) >> (8 - s)) | (at(j - pb) << s));
+        drow[j] = combine(drow[j], v, m);
+    };
+
+    edge(j1);
+    if (j2 == j1) return;
+
+    unsigned char* d = drow + j1 + 1;
+    const int count = j2 - j1 - 1;
+    if (!lit)
+    {
+        const unsigned char v = (unsigned char)((rep >> (8 - s)) | (rep << s));
+        for (int i = 0; i < count; i++) d[i] = combine(d[i], v, 0xFF);
+    }
+    else if (s == 0)
+    {
+        const unsigned char* p = lit + (j1 + 1 - pb);
+        for (int i = 0; i < count; i++) d[i] = combine(d[i], p[i], 0xFF);
+    }
+    else
+    {
+        const unsigned char* p = lit + (j1 + 1 - pb);
+        for (int i = 0; i < count; i++) d[i] = combine(d[i], (unsigned char)((p[i - 1] >> (8 - s)) | (p[i] << s)), 0xFF);
+    }
+    edge(j2);
+}
 
-    int canvas_width_by_8 = width / 8;
-    int image_width_by_8 = image_width / 8;
+template <typename Combine>
+static void packedBlit(const PackedImage& image, int x, int y, int y1, int y2, CanvasKernels::Op op, Combine combine)
+{
+    const int row_bytes = image.width / 8, stride = Screen::width / 8;
+    const int cx1 = Screen::clip.x1, cx2 = Screen::clip.x2;
+    const unsigned char* p = image.tokens.data();
+    const unsigned char* end = p + image.tokens.size();
 
-    if (draw_bg)
+    int row = 0, col = 0; // Image byte the next token starts at
+    while (p < end && y + row <= y2)
     {
-        for (int r = 0; r < image_height; r++)
+        int kind, count;
+        p = PackedImageCodec::token(p, kind, count);
+        const unsigned char* lit = kind == PackedImage::Literal ? p : nullptr;
+        const unsigned char rep = kind == PackedImage::Repeat ? *p : 0;
+        p += kind == PackedImage::Literal ? count : kind == PackedImage::Repeat ? 1 : 0;
+
+        // Split the run at row ends; rows above the clip are only counted past
+        while (count > 0)
         {
-            unsigned char* cpp = pixels + byte_index + r * canvas_width_by_8;
-            const unsigned char* ipp = image_pixels + r * image_width_by_8;
-            for (int c = 0; c < image_width_by_8; c++) cpp[c] = ipp[c];
+            int n = min(count, row_bytes - col);
+            if (kind != PackedImage::Skip && y + row >= y1 && y + row <= y2)
+                packedSpan(Screen::pixels + (y + row) * stride, x + 8 * col, lit, rep, n, cx1, cx2, op, combine);
+
+            if (lit) lit += n;
+            count -= n;
+            col += n;
+            if (col == row_bytes)
+            {
+                col = 0;
+                row++;
+            }
         }
     }
-    else
+}
+
+void Screen::blitPacked(const PackedImage& image, int x, int y, CanvasKernels::Op op)
+{
+    using Op = CanvasKernels::Op;
+
+    int cx = x, cy = y, w = image.width, h = image.height;
+    if (!clipRect(cx, cy, w, h)) return;
+
+    markDirty(cy, cy + h - 1);
+    switch (op)
+    {
+    case Op::Copy: packedBlit(image, x, y, cy, cy + h - 1, op, [](unsigned char d, unsigned char s, unsigned char m) { return (unsigned char)((d & ~m) | (s & m)); }); break;
+    case Op::Or: packedBlit(image, x, y, cy, cy + h - 1, op, [](unsigned char d, unsigned char s, unsigned char m) { return (unsigned char)(d | (s & m)); }); break;
+    case Op::And: packedBlit(image, x, y, cy, cy + h - 1, op, [](unsigned char d, unsigned char s, unsigned char m) { return (unsigned char)(d & (s | ~m)); }); break;
+    case Op::Xor: packedBlit(image, x, y, cy, cy + h - 1, op, [](unsigned char d, unsigned char s, unsigned char m) { return (unsigned char)(d ^ (s & m)); }); break;
+    case Op::AndNot: packedBlit(image, x, y, cy, cy + h - 1, op, [](unsigned char d, unsigned char s, unsigned char m) { return (unsigned char)(d & ~(s & m)); }); break;
+    }
+}
+
+// Each band of tile rows in view is gathered into a strip (tile rows are too narrow to be worth a transfer
+// each), then copied with one shifted block transfer; blank tiles and the area outside the world read as off
+void Screen::blitWorld(const WorldBitmap& world, int cam_x, int cam_y, int x, int y, int w, int h, CanvasKernels::Op op)
+{
+    int vx = x, vy = y, vw = w, vh = h;
+    if (!clipRect(vx, vy, vw, vh)) return;
+    markDirty(vy, vy + vh - 1);
+
+    const int S = WorldBitmap::TILE_SIZE, TS = WorldBitmap::TILE_STRIDE;
+    const long long ox = (long long)cam_x - x, oy = (long long)cam_y - y; // World pixel = canvas pixel + offset
+
+    auto floorDiv = [](long long a, long long b) { return a / b - (a % b < 0 ? 1 : 0); };
+    const long long t1 = floorDiv(vx + ox, S), t2 = floorDiv(vx + vw - 1 + ox, S);
+    const int strip_stride = (int)(t2 - t1 + 1) * TS;
+
+    static std::vector<unsigned char> strip;
+    strip.resize((size_t)strip_stride * S);
+
+    for (long long ty = floorDiv(vy + oy, S); ty <= floorDiv(vy + vh - 1 + oy, S); ty++)
+    {
+        const int y1 = (int)max((long long)vy, ty * S - oy), y2 = (int)min((long long)vy + vh - 1, ty * S + S - 1 - oy);
+        const int sy = (int)(y1 + oy - ty * S), rows = y2 - y1 + 1;
+
+        for (long long tx = t1; tx <= t2; tx++)
+        {
+            const bool inside = tx >= 0 && tx < world.tilesX() && ty >= 0 && ty < world.tilesY();
+            const unsigned char* tile = inside ? world.tile((int)tx, (int)ty) : nullptr;
+            unsigned char* d = strip.data() + (tx - t1) * TS;
+
+            if (tile)
+            {
+                const unsigned char* s = tile + sy * TS;
+                for (int i = 0; i < rows; i++, d += strip_stride, s += TS) memcpy(d, s, TS);
+            }
+            else
+                for (int i = 0; i < rows; i++, d += strip_stride) memset(d, 0, TS);
+        }
+
+        blitUnsafe(pixels, width / 8, vx, y1, strip.data(), strip_stride, (int)(vx + ox - t1 * S), 0, vw, rows, op);
+    }
+}
+
+// Tiles on byte boundaries are combined a byte at a time (rows are a few bytes wide, so a kernel call per row would cost more)
+template <typename Combine>
+static inline void tileBytes(unsigned char* d, int d_stride, const unsigned char* s, int s_stride, int n, int rows, Combine combine)
+{
+    for (int r = 0; r < rows; r++, d += d_stride, s += s_stride)
+        for (int b = 0; b < n; b++) d[b] = combine(d[b], s[b]);
+}
+
+// Tile columns land on byte boundaries when the scroll offset is a multiple of 8: every tile is then written
+// directly (tiles cut by the viewport take the shifted blit). Otherwise each band of tile rows is first
+// gathered into a byte-aligned strip, then blitted with one shifted transfer; empty cells are masked out
+// for copies and made neutral (0, or 1 for "and") for the other ops.
+void Screen::tilemap(const Tilemap& map, int x, int y, int w, int h, int scroll_x, int scroll_y, CanvasKernels::Op op)
+{
+    using Op = CanvasKernels::Op;
+
+    int vx = x, vy = y, vw = w, vh = h;
+    if (map.tile_count <= 0 || !clipRect(vx, vy, vw, vh)) return;
+
+    const int tw = map.tile_width, th = map.tile_height;
+    const int tile_stride = tw / 8, stride = width / 8;
+    const long long ox = (long long)scroll_x - x, oy = (long long)scroll_y - y; // Map pixel = canvas pixel + offset
+
+    auto floorDiv = [](long long a, long long b) { return a / b - (a % b < 0 ? 1 : 0); };
+    const long long c1 = max(floorDiv(vx + ox, tw), 0LL), c2 = min(floorDiv(vx + vw - 1 + ox, tw), (long long)map.cols - 1);
+    const long long r1 = max(floorDiv(vy + oy, th), 0LL), r2 = min(floorDiv(vy + vh - 1 + oy, th), (long long)map.rows - 1);
+    if (c1 > c2 || r1 > r2) return;
+
+    // Canvas columns covered by the map
+    const int x1 = (int)max((long long)vx, c1 * tw - ox), x2 = (int)min((long long)vx + vw - 1, (c2 + 1) * tw - 1 - ox);
+    const bool aligned = !(ox & 7);
+
+    static std::vector<unsigned char> strip, strip_mask; // Band of tile rows, byte-aligned to the tile grid
+    const int strip_stride = (int)(c2 - c1 + 1) * tile_stride;
+    if (!aligned)
+    {
+        strip.resize((size_t)strip_stride * th);
+        if (op == Op::Copy) strip_mask.resize(strip.size());
+    }
+
+    for (long long r = r1; r <= r2; r++)
+    {
+        const long long ty = r * th - oy; // Canvas row of the tile's top
+        const int y1 = (int)max(ty, (long long)vy), y2 = (int)min(ty + th - 1, (long long)vy + vh - 1);
+        const int sy = (int)(y1 - ty), rows = y2 - y1 + 1;
+        const uint16_t* cells = map.cells.data() + r * map.cols;
+
+        markDirty(y1, y2);
+
+        if (aligned)
+        {
+            for (long long c = c1; c <= c2; c++)
+            {
+                int n = cells[c];
+                if (n == 0 || n > map.tile_count) continue;
+
+                const long long tx = c * tw - ox;
+                const int cx1 = (int)max(tx, (long long)x1), cx2 = (int)min(tx + tw - 1, (long long)x2);
+                const int sx = (int)(cx1 - tx), cw = cx2 - cx1 + 1;
+                const unsigned char* tile = map.tiles.data() + (size_t)(n - 1) * map.tileBytes();
+
+                if ((cx1 | cw) & 7) // Cut by the viewport
+                {
+                    blitUnsafe(pixels, stride, cx1, y1, tile, tile_stride, sx, sy, cw, rows, op);
+                    continue;
+                }
+
+                unsigned char* d = pixels + y1 * stride + (cx1 >> 3);
+                const unsigned char* s = tile + sy * tile_stride + (sx >> 3);
+                const int nb = cw >> 3;
+                switch (op)
+                {
+                case Op::Copy: tileBytes(d, stride, s, tile_stride, nb, rows, [](unsigned char, unsigned char v) { return v; }); break;
+                case Op::Or: tileBytes(d, stride, s, tile_stride, nb, rows, [](unsigned char u, unsigned char v) { return (unsigned char)(u | v); }); break;
+                case Op::And: tileBytes(d, stride, s, tile_stride, nb, rows, [](unsigned char u, unsigned char v) { return (unsigned char)(u & v); }); break;
+                case Op::Xor: tileBytes(d, stride, s, tile_stride, nb, rows, [](unsigned char u, unsigned char v) { return (unsigned char)(u ^ v); }); break;
+                case Op::AndNot: tileBytes(d, stride, s, tile_stride, nb, rows, [](unsigned char u, unsigned char v) { return (unsigned char)(u & ~v); }); break;
+                }
+            }
+            continue;
+        }
+
+        // Gather the band's visible tile rows (tile rows are a few bytes, copied inline)
+        bool any_empty = false;
+        for (long long c = c1; c <= c2; c++) any_empty |= cells[c] == 0 || cells[c] > map.tile_count;
+        const bool masked = op == Op::Copy && any_empty;
+        const unsigned char neutral = op == Op::And ? 0xFF : 0;
+
+        for (long long c = c1; c <= c2; c++)
+        {
+            int n = cells[c];
+            bool empty = n == 0 || n > map.tile_count;
+            unsigned char* d = strip.data() + (c - c1) * tile_stride;
+            const unsigned char* s = map.tiles.data() + (empty ? 0 : (size_t)(n - 1) * map.tileBytes() + sy * tile_stride);
+
+            for (int i = 0; i < rows; i++, d += strip_stride, s += tile_stride)
+                for (int k = 0; k < tile_stride; k++) d[k] = empty ? neutral : s[k];
+
+            if (masked)
+            {
+                unsigned char* mk = strip_mask.data() + (c - c1) * tile_stride;
+                for (int i = 0; i < rows; i++, mk += strip_stride)
+                    for (int k = 0; k < tile_stride; k++) mk[k] = empty ? 0 : 0xFF;
+            }
+        }
+
+        blitUnsafe(pixels, stride, x1, y1, strip.data(), strip_stride, (int)(x1 + ox - c1 * tw), 0, x2 - x1 + 1, rows,
+            op, masked ? strip_mask.data() : nullptr);
+    }
+}
+
+void Screen::scroll(int dx, int dy, bool fill_on)
+{
+    scroll(clip.x1, clip.y1, clip.x2 - clip.x1 + 1, clip.y2 - clip.y1 + 1, dx, dy, fill_on);
+}
+
+void Screen::scroll(int x, int y, int w, int h, int dx, int dy, bool fill_on)
+{
+    if ((dx == 0 && dy == 0) || !clipRect(x, y, w, h)) return;
+
+    if (std::abs((long long)dx) >= w || std::abs((long long)dy) >= h)
+    {
+        fillRectUnsafe(x, y, w, h, fill_on);
+        return;
+    }
+
+    // Move the part that stays inside the rect, then fill the rows and columns it left behind
+    int keep_w = w - std::abs(dx), keep_h = h - std::abs(dy);
+    markDirty(y, y + h - 1);
+    blitUnsafe(pixels, width / 8, x + max(dx, 0), y + max(dy, 0),
+        pixels, width / 8, x - min(dx, 0), y - min(dy, 0), keep_w, keep_h, CanvasKernels::Op::Copy);
+
+    if (dy) fillRectUnsafe(x, dy > 0 ? y : y + keep_h, w, std::abs(dy), fill_on);
+    if (dx) fillRectUnsafe(dx > 0 ? x : x + keep_w, y + max(dy, 0), std::abs(dx), keep_h, fill_on);
+}
+
+// Collision queries work on 64 pixels at a time: rows are read as shifted 64-bit words
+// (rowBits), combined, masked to the columns in range and counted with popcount
+static inline uint64_t lowBits(int n) { return n >= 64 ? ~0ull : (1ull << n) - 1; } // Mask of the first n pixels of a word
+
+long long bitmapOverlap(const Image* a, int ax, int ay, const Image* b, int bx, int by, bool count_all)
+{
+    // Overlap of the two rectangles, in the shared coordinate space
+    long long x1 = max((long long)ax, (long long)bx), y1 = max((long long)ay, (long long)by);
+    long long x2 = min((long long)ax + a->width, (long long)bx + b->width) - 1;
+    long long y2 = min((long long)ay + a->height, (long long)by + b->height) - 1;
+    if (x1 > x2 || y1 > y2) return 0;
+
+    const int a_stride = a->width / 8, b_stride = b->width / 8;
+    long long count = 0;
+
+    for (long long y = y1; y <= y2; y++)
+    {
+        const unsigned char* arow = a->pixels + (y - ay) * a_stride;
+        const unsigned char* brow = b->pixels + (y - by) * b_stride;
+
+        for (long long x = x1; x <= x2; x += 64)
+        {
+            uint64_t w = rowBits(arow, a_stride, (int)(x - ax)) & rowBits(brow, b_stride, (int)(x - bx));
+            w &= lowBits((int)min(x2 - x + 1, 64ll));
+            if (!w) continue;
+            if (!count_all) return 1;
+            count += std::popcount(w);
+        }
+    }
+    return count;
+}
+
+long long bitmapCount(const Image* image, int x, int y, int w, int h)
+{
+    if (w < 0) x -= (w = -w);
+    if (h < 0) y -= (h = -h);
+
+    long long x1 = max((long long)x, 0ll), y1 = max((long long)y, 0ll);
+    long long x2 = min((long long)x + w, (long long)image->width) - 1;
+    long long y2 = min((long long)y + h, (long long)image->height) - 1;
+    if (x1 > x2 || y1 > y2) return 0;
+
+    const int stride = image->width / 8;
+    long long count = 0;
+
+    for (long long r = y1; r <= y2; r++)
     {
-        for (int r = 0; r < image_height; r++)
+        const unsigned char* row = image->pixels + r * stride;
+        for (long long c = x1; c <= x2; c += 64)
+            count += std::popcount(rowBits(row, stride, (int)c) & lowBits((int)min(x2 - c + 1, 64ll)));
+    }
+    return count;
+}
+
+bool bitmapRaycast(const Image* image, int x1, int y1, int x2, int y2, int& hit_x, int& hit_y)
+{
+    const Screen::ClipRect bounds = { 0, 0, image->width - 1, image->height - 1 };
+    const int stride = image->width / 8;
+    bool hit = false;
+
+    lineRuns(x1, y1, x2, y2, bounds, [&](bool x_major, int from, int to, int minor) {
+        if (x_major)
         {
-            unsigned char* cpp = pixels + byte_index + r * canvas_width_by_8;
-            const unsigned char* ipp = image_pixels + r * image_width_by_8;
-            for (int c = 0; c < image_width_by_8; c++) cpp[c] |= ipp[c];
+            // Horizontal run: first set bit in the direction of travel
+            const unsigned char* row = image->pixels + (long long)minor * stride;
+            if (from <= to)
+            {
+                for (int x = from; x <= to; x += 64)
+                {
+                    uint64_t w = rowBits(row, stride, x) & lowBits(to - x + 1);
+                    if (w) { hit_x = x + std::countr_zero(w); hit = true; break; }
+                }
+            }
+            else
+            {
+                for (int x = from; x >= to; x -= 64)
+                {
+                    uint64_t w = rowBits(row, stride, x - 63) & ~lowBits(max(to - (x - 63), 0));
+                    if (w) { hit_x = x - std::countl_zero(w); hit = true; break; }
+                }
+            }
+            if (hit) hit_y = minor;
+        }
+        else
+        {
+            // Vertical run: one pixel per row
+            const unsigned char* p = image->pixels + (minor >> 3);
+            unsigned char m = (unsigned char)(1u << (minor & 7));
+            int step = from <= to ? 1 : -1;
+            for (int y = from; ; y += step)
+            {
+                if (p[(long long)y * stride] & m) { hit_x = minor; hit_y = y; hit = true; break; }
+                if (y == to) break;
+            }
         }
+        return hit;
+    });
+
+    return hit;
+}
+
+Screen::Layer& Screen::layerAt(int index)
+{
+    if (index < 0 || index >= MAX_LAYERS) APP_FATAL << "Layer index " << index << " is out of range (0-" << MAX_LAYERS - 1 << ")";
+    return layers[index];
+}
+
+void Screen::setLayer(int index, CanvasKernels::Op op, const Image* mask)
+{
+    Layer& layer = layerAt(index);
+    if (mask && (mask->width != canvas_width || mask->height != canvas_height))
+        APP_FATAL << "Layer mask size " << mask->width << "x" << mask->height
+        << " does not match canvas size " << canvas_width << "x" << canvas_height;
+
+    if (!layer.used) // New layers start blank and visible
+    {
+        layer.pixels.assign((size_t)canvas_width * canvas_height / 8, 0);
+        layer.visible = true;
+        layer.used = true;
+    }
+    layer.op = op;
+    if (mask) layer.mask.assign(mask->pixels, mask->pixels + layer.pixels.size());
+    else layer.mask.clear();
+
+    layer.dirty = layers_pending = composite_all = true;
+}
+
+void Screen::removeLayer(int index)
+{
+    Layer& layer = layerAt(index);
+    layer.used = layer.dirty = false;
+    composite_all = layers_pending = true; // Draw again so the Canvas loses the layer
+}
+
+void Screen::showLayer(int index, bool visible)
+{
+    Layer& layer = layerAt(index);
+    if (layer.visible == visible) return;
+    layer.visible = visible;
+    composite_all = layers_pending = true;
+}
+
+void Screen::redrawLayer(int index)
+{
+    Layer& layer = layerAt(index);
+    if (layer.used) layer.dirty = layers_pending = true;
+}
+
+bool Screen::hasLayer(int index) const
+{
+    return index >= 0 && index < MAX_LAYERS && layers[index].used;
+}
+
+void Screen::drawInto(unsigned char* buffer, int layer)
+{
+    unsigned char* canvas = pixels;
+    pixels = buffer; // resetTarget returns here
+
+    cursor.row = cursor.col = 0;
+    resetClip();
+    resetPattern();
+    if (layer < 0) draw();
+    else drawLayer(layer);
+    resetTarget();
+
+    pixels = canvas;
+}
+
+void Screen::composite(int y1, int y2)
+{
+    size_t stride = width / 8;
+    size_t offset = y1 * stride, n = (y2 - y1 + 1) * stride;
+
+    CanvasKernels::copy(pixels + offset, base.data() + offset, n);
+    for (const Layer& layer : layers)
+    {
+        if (!layer.used || !layer.visible) continue;
+        if (layer.mask.empty()) CanvasKernels::combine(pixels + offset, layer.pixels.data() + offset, n, layer.op);
+        else CanvasKernels::select(pixels + offset, layer.pixels.data() + offset, layer.mask.data() + offset, n);
     }
 }
 
 void Screen::_draw()
 {
-    redraw = false; // Clear redraw flag
+    // Flags are cleared first so that drawing code can request another draw
+    bool draw_base = redraw;
+    redraw = layers_pending = false;
     app.metrics.draws++;
-    cursor.row = cursor.col = 0;
-    draw();
-    renderer.uploadSSBO();
-    render_frames = 3;
+    resetTarget();
+
+    bool layered = false;
+    for (const Layer& layer : layers) layered |= layer.used;
+
+    if (!layered)
+    {
+        if (!base.empty()) // The last layer was removed: the base is the whole picture again
+        {
+            CanvasKernels::copy(pixels, base.data(), base.size());
+            markDirty(0, height - 1);
+            std::vector<unsigned char>().swap(base);
+        }
+        if (draw_base) drawInto(pixels, -1);
+    }
+    else
+    {
+        if (base.empty()) // The first layer goes over what the Canvas shows now
+        {
+            base.assign(pixels, pixels + (size_t)width * height / 8);
+            composite_all = true;
+        }
+
+        if (draw_base) drawInto(base.data(), -1);
+        for (int i = 0; i < MAX_LAYERS; i++)
+        {
+            if (!layers[i].used || !layers[i].dirty) continue;
+            layers[i].dirty = false;
+            drawInto(layers[i].pixels.data(), i);
+        }
+
+        // Rows written by any of the draws above (the dirty band) are rebuilt from the stack
+        if (composite_all) markDirty(0, height - 1);
+        composite_all = false;
+        int top = max(dirty_top, 0), bottom = min(dirty_bottom, height - 1);
+        if (top <= bottom) composite(top, bottom);
+    }
+
+    if (renderer.uploadSSBO()) render_frames = 3; // Nothing to re-render if the Canvas is unchanged
 }
 
 bool Screen::char_event(unsigned int c) { return false; }
\ No newline at end of file
@@ -1,7 +1,14 @@
 #ifndef SCREEN_H
 #define SCREEN_H
 
+#include "CanvasKernels.h"
+
+#include <vector>
+
 struct Image;
+struct PackedImage;
+struct Tilemap;
+class WorldBitmap;
 
 // The static width, height, and pixel buffer of the Screen class define a "Canvas"
 // The Canvas is a logical rectangle of pixels and is a key feature of this application
@@ -16,6 +23,7 @@ public:
 
     /* Data fields for the Canvas (all instances of Screen use the same Canvas for drawing) */
     inline static int width = 0, height = 0; // Logical width and height
+    inline static int canvas_width = 0, canvas_height = 0; // Size of the main Canvas (width and height follow the current render target)
     inline static unsigned char* pixels = 0; // Monochrome 1-bit-per-pixel buffer
     inline static int text_offset_y = 0; // Vertical offset of text grid for centering
     inline static int rows = 0, cols = 0; // Number of glyph rows and columns
@@ -26,13 +34,55 @@ public:
     }cursor{};
 
     bool redraw = false; // If set true then draw() will be called
+    bool needsDraw() const { return redraw || layers_pending; } // draw() or a dirty layer's drawLayer() is due
 
     inline static class MonospaceMonochromePixelFont* font = 0;
     inline static int render_frames = 0;
 
+    /* Dirty rows (every write to the Canvas widens this band; the Renderer uploads only changed rows within it) */
+    // The dirty band, clip rect and fill pattern are per thread, so DrawCommands can replay on several threads at once
+    inline static thread_local int dirty_top = 0x7FFFFFFF, dirty_bottom = -1; // Empty when top > bottom
+    static void markDirty(int y1, int y2)
+    {
+        if (y1 < dirty_top) dirty_top = y1;
+        if (y2 > dirty_bottom) dirty_bottom = y2;
+    }
+    static void clearDirty() { dirty_top = 0x7FFFFFFF; dirty_bottom = -1; }
+
+    /* Clipping (all drawing is limited to the active clip rectangle, which is reset before each draw) */
+    inline static thread_local struct ClipRect // Inclusive pixel bounds
+    {
+        int x1, y1;
+        int x2, y2;
+    }clip{};
+    static constexpr int MAX_CLIP_DEPTH = 32;
+    inline static ClipRect clip_stack[MAX_CLIP_DEPTH]{}; // Saved clip rectangles
+    inline static int clip_depth = 0;
+
+    static void pushClip(int x, int y, int w, int h); // Save current clip, then intersect it with the given rect
+    static void popClip(); // Restore the previously saved clip
+    static void resetClip(); // Clip to the whole canvas and empty the stack
+    static bool inClip(int x, int y) { return x >= clip.x1 && x <= clip.x2 && y >= clip.y1 && y <= clip.y2; }
+
+    /* Fill pattern (an 8x8 bit mask applied by solid rects, circles, ellipses, polygons and triangles; reset before each draw) */
+    enum class PatternAnchor { Screen, Shape }; // Pattern origin: canvas 0,0 or the top-left of each shape
+    inline static thread_local unsigned char pattern[8] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF }; // Rows, LSB = leftmost pixel; 0 bits leave pixels unchanged
+    inline static thread_local bool pattern_solid = true; // All bits set (fills take the plain path)
+    inline static thread_local PatternAnchor pattern_anchor = PatternAnchor::Screen;
+    static constexpr int DITHER_LEVELS = 64;
+
+    static void setPattern(const unsigned char rows[8], PatternAnchor anchor = PatternAnchor::Screen);
+    static void setDither(int level, PatternAnchor anchor = PatternAnchor::Screen); // Ordered (Bayer) dither covering level/64 of the pixels (0-64)
+    static void resetPattern(); // Solid fills
+
     static void _init(int width, int height); // Set logical width and height of canvas
     static void _cleanup();
 
+    /* Render targets (the fields above describe the current target; the main Canvas is restored by resetTarget) */
+    inline static bool offscreen = false; // True while drawing to a buffer other than the main Canvas
+    static void setTarget(unsigned char* pixels, int width, int height); // Draw to another packed 1bpp buffer (width must be a multiple of 8)
+    static void resetTarget(); // Draw to the main Canvas again
+
     int set_active_count = 0;
 
     Screen(const char* label);
@@ -42,6 +92,7 @@ public:
     void setActive();
 
     virtual void update(float dt);
+    virtual bool animated() const { return false; } // update() can change what is drawn (so the loop must keep running)
 
     void clear(bool inverted = false);
 
@@ -64,6 +115,30 @@ public:
     void eon(int x, int y, int w, int h, bool solid = true); // Ellipse on
     void eoff(int x, int y, int w, int h, bool solid = true); // Ellipse off
 
+    enum class FillRule { EvenOdd, NonZero }; // Inside test for self-intersecting polygons
+    static constexpr int MAX_POLY_COORD = 1 << 24; // Polygon coordinates must be within +/- this value
+    void polyset(const int* xy, int n, bool solid = true, bool on = true, FillRule rule = FillRule::EvenOdd); // Polygon on/off (n points as x,y pairs, closed automatically)
+    void polyon(const int* xy, int n, bool solid = true, FillRule rule = FillRule::EvenOdd); // Polygon on
+    void polyoff(const int* xy, int n, bool solid = true, FillRule rule = FillRule::EvenOdd); // Polygon off
+    void tset(int x1, int y1, int x2, int y2, int x3, int y3, bool solid = true, bool on = true); // Triangle on/off
+    void ton(int x1, int y1, int x2, int y2, int x3, int y3, bool solid = true); // Triangle on
+    void toff(int x1, int y1, int x2, int y2, int x3, int y3, bool solid = true); // Triangle off
+
+    /* Thick lines (width 1 is the thin line above; wider lines are filled shapes clipped like everything else) */
+    enum class LineCap { Butt, Square, Round }; // Line ends: flush with the endpoint, extended by half the width, or rounded
+    enum class LineJoin { Miter, Bevel, Round }; // Corners of joined lines (miters longer than 4x the width become bevels)
+    static constexpr int MAX_LINE_WIDTH = 4096;
+    void lset(int x1, int y1, int x2, int y2, bool on, int width, LineCap cap = LineCap::Butt); // Thick line on/off
+    void lon(int x1, int y1, int x2, int y2, int width, LineCap cap = LineCap::Butt); // Thick line on
+    void loff(int x1, int y1, int x2, int y2, int width, LineCap cap = LineCap::Butt); // Thick line off
+    void lsets(const int* xy, int n, bool on = true, int width = 1, LineCap cap = LineCap::Butt); // n separate lines as x1,y1,x2,y2 quads
+    void lsetsc(const int* xy, int n, bool on = true, int width = 1, LineJoin join = LineJoin::Miter, LineCap cap = LineCap::Butt); // Joined lines through n points as x,y pairs
+
+    /* Flood fill (the region of pixels connected to x,y that differ from the fill state; returns the number of pixels filled) */
+    int fset(int x, int y, bool on = true, int connectivity = 4); // Fill on/off (connectivity is 4 or 8)
+    int fon(int x, int y, int connectivity = 4); // Fill on
+    int foff(int x, int y, int connectivity = 4); // Fill off
+
     /* Glyph drawing */
     void locate(int row, int col); // Set position of cursor (top-left is [0,0])
     void print(int index, bool inverted = false); // Print a single glyph at cursor
@@ -79,10 +154,51 @@ public:
 
     /* 1-bit image drawing */
     void image(Image* image, int row, int col, bool draw_bg = true, int dy = 0);
+    void blit(const Image* image, int x, int y, CanvasKernels::Op op = CanvasKernels::Op::Copy, const Image* mask = nullptr); // Any pixel position; with a mask, only mask pixels are copied
+    void blitRect(const Image* source, int sx, int sy, int w, int h, int x, int y, CanvasKernels::Op op = CanvasKernels::Op::Copy); // Copy a rect of source to x,y (source may be the current target; overlap is handled)
+    void blitPacked(const PackedImage& image, int x, int y, CanvasKernels::Op op = CanvasKernels::Op::Copy); // Decode straight onto the canvas (delta images only touch their changed bytes)
+    void blitWorld(const WorldBitmap& world, int cam_x, int cam_y, int x, int y, int w, int h, CanvasKernels::Op op = CanvasKernels::Op::Copy); // Copy the world at cam_x,cam_y into the w x h viewport at x,y (off outside the world)
+
+    /* Tilemaps (the map pixel at scroll_x, scroll_y is drawn at x, y; empty cells leave the canvas unchanged) */
+    void tilemap(const Tilemap& map, int x, int y, int w, int h, int scroll_x = 0, int scroll_y = 0,
+        CanvasKernels::Op op = CanvasKernels::Op::Copy); // Draw the part of the map visible in the w x h viewport at x, y
+
+    /* Scrolling (content moves by dx,dy; pixels moved out are lost and the exposed edge is filled) */
+    void scroll(int dx, int dy, bool fill_on = false); // Scroll everything inside the clip rect
+    void scroll(int x, int y, int w, int h, int dx, int dy, bool fill_on = false); // Scroll a rect (limited to the clip rect)
+
+    /* Layers (a fixed stack of canvas-sized buffers composited bottom to top over what draw() renders;
+       drawLayer() runs only for layers marked dirty, so unchanged layers just take part in compositing) */
+    static constexpr int MAX_LAYERS = 8;
+    void setLayer(int index, CanvasKernels::Op op = CanvasKernels::Op::Or, const Image* mask = nullptr); // Add or reconfigure a layer and mark it dirty; with a canvas-sized mask (copied), the layer replaces the pixels below where the mask is set and op is ignored
+    void removeLayer(int index);
+    void showLayer(int index, bool visible); // Hidden layers keep their contents
+    void redrawLayer(int index); // drawLayer(index) is called on the next draw
+    bool hasLayer(int index) const;
 
     void _draw();
 private:
+    struct Layer
+    {
+        bool used = false;
+        bool visible = true;
+        bool dirty = false;
+        CanvasKernels::Op op = CanvasKernels::Op::Or;
+        std::vector<unsigned char> pixels; // Kept when the layer is removed
+        std::vector<unsigned char> mask; // Empty without a replace mask
+    };
+    Layer layers[MAX_LAYERS];
+    std::vector<unsigned char> base; // What draw() renders while any layer is in use
+    bool layers_pending = false; // Some layer is dirty
+    bool composite_all = false; // The stack changed or another Screen used the Canvas: composite every row
+
+    Layer& layerAt(int index);
+    void drawInto(unsigned char* buffer, int layer); // Draw with buffer standing in for the main Canvas (layer -1 is draw())
+    void composite(int y1, int y2); // Rebuild Canvas rows from the base and the visible layers
+    virtual void drawLayer(int index) {} // Like draw(), for one layer
+
     int _wrap(const char* text, int max_rows, int max_cols, int& scrolling, bool convert_newline_chars, bool test);
+    void glyphAt(int index, int row, int col, bool inverted); // Any cell, clipped (index must be valid)
     virtual void draw() = 0; // For drawing operations only! Doesn't necessarily get called every frame (only as needed)
 public:
     virtual bool key_event(int key, int scancode, int action, int mods) = 0; // Returns true if event was handled
@@ -91,6 +207,7 @@ public:
 
 inline void ponUnsafe(int x, int y)
 {
+    Screen::markDirty(y, y);
     int i = x + y * Screen::width;
     unsigned char& b = Screen::pixels[i >> 3];
     b |= (unsigned char)(1u << (i & 7));
@@ -98,9 +215,32 @@ inline void ponUnsafe(int x, int y)
 
 inline void poffUnsafe(int x, int y)
 {
+    Screen::markDirty(y, y);
     int i = x + y * Screen::width;
     unsigned char& b = Screen::pixels[i >> 3];
     b &= (unsigned char)~(unsigned char)(1u << (i & 7));
 }
 
+/* Span filling (no bounds checks, callers must clip; rows are marked dirty) */
+void hspanUnsafe(int x1, int x2, int y, bool on); // Horizontal run x1..x2 on row y (requires x1 <= x2)
+void vspanUnsafe(int x, int y1, int y2, bool on); // Vertical run y1..y2 in column x (requires y1 <= y2)
+void fillRectUnsafe(int x, int y, int w, int h, bool on); // Solid rectangle (requires w, h > 0)
+
+/* Span filling limited to Screen::clip (any coordinates) */
+void hspanClipped(int x1, int x2, int y, bool on); // Requires x1 <= x2
+void vspanClipped(int x, int y1, int y2, bool on); // Requires y1 <= y2
+void fillRectClipped(int x, int y, int w, int h, bool on); // Zero or negative sizes draw nothing
+
+// Bit-shifted block transfer of a w x h pixel block between packed 1bpp buffers (strides in bytes)
+// With a mask (same layout and stride as src), dst = (dst & ~mask) | (src & mask) and op is ignored
+// Overlapping blocks of the same buffer (dst == src) behave like memmove
+void blitUnsafe(unsigned char* dst, int dst_stride, int dx, int dy,
+    const unsigned char* src, int src_stride, int sx, int sy, int w, int h,
+    CanvasKernels::Op op, const unsigned char* mask = nullptr);
+
+/* Pixel-exact collision queries over packed 1bpp images (pass the current target as an Image to query the Canvas) */
+long long bitmapOverlap(const Image* a, int ax, int ay, const Image* b, int bx, int by, bool count_all = true); // Pixels set in both images placed at ax,ay and bx,by (without count_all, 1 on the first one)
+long long bitmapCount(const Image* image, int x, int y, int w, int h); // Pixels set within a rect (clamped to the image)
+bool bitmapRaycast(const Image* image, int x1, int y1, int x2, int y2, int& hit_x, int& hit_y); // First set pixel on the line from x1,y1 to x2,y2 (the pixels lset draws)
+
 #endif
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "App.h"
+#include "FrameScheduler.h"
 #include "gl.h"
 #include "LuaHost.h"
 #include "ScreenInfo.h"
@@ -13,7 +14,21 @@ void ScreenLua::onSetActive(bool initial)
 
 void ScreenLua::update(float dt)
 {
-    lua.callUpdate(dt);
+    const double step = FrameScheduler::settings.fixed_step;
+    if (step <= 0.0)
+    {
+        lua.callUpdate(dt);
+        return;
+    }
+
+    for (int n = FrameScheduler::steps(dt); n > 0; n--)
+        lua.callUpdate((float)step);
+    if (animated()) redraw = true; // Draw at the new alpha
+}
+
+bool ScreenLua::animated() const
+{
+    return lua.hasCallback("update");
 }
 
 void ScreenLua::draw()
@@ -21,6 +36,11 @@ void ScreenLua::draw()
     lua.callDraw();
 }
 
+void ScreenLua::drawLayer(int index)
+{
+    lua.callDrawLayer(index);
+}
+
 void ScreenLua::showSystemInfoScreen()
 {
     info_screen.prev = this;
@@ -10,11 +10,13 @@ public:
 
     void onSetActive(bool initial) override;
     void update(float dt) override;
+    bool animated() const override;
     bool key_event(int key, int scancode, int action, int mods) override;
     bool char_event(unsigned int c) override;
 
 private:
     void draw() override;
+    void drawLayer(int index) override;
     void showSystemInfoScreen();
 };
 
@@ -0,0 +1,101 @@
+#include "SoftwarePresenter.h"
+#include "CanvasKernels.h"
+#include "misc.h"
+#include "Screen.h"
+
+#include <cstring>
+
+SoftwarePresenter::SoftwarePresenter() : lut(), pending_top(0x7FFFFFFF), pending_bottom(-1), full(true) {}
+
+const char* SoftwarePresenter::init(GLFWwindow* window)
+{
+    presented.assign(Screen::pixels, Screen::pixels + Screen::width * Screen::height / 8);
+    full = true;
+    return surface.open(window);
+}
+
+bool SoftwarePresenter::update()
+{
+    const int stride = Screen::width / 8;
+    const int top = max(Screen::dirty_top, 0);
+    const int bottom = min(Screen::dirty_bottom, Screen::height - 1);
+    Screen::clearDirty();
+
+    bool changed = false;
+    for (int y = top; y <= bottom; y++)
+    {
+        const unsigned char* row = Screen::pixels + y * stride;
+        if (!memcmp(row, presented.data() + y * stride, stride)) continue;
+
+        memcpy(presented.data() + y * stride, row, stride);
+        if (y < pending_top) pending_top = y;
+        pending_bottom = y;
+        changed = true;
+    }
+    return changed;
+}
+
+const char* SoftwarePresenter::present(int window_width, int window_height)
+{
+    if (!surface.isOpen() || window_width <= 0 || window_height <= 0) return nullptr; // Minimized
+    SoftwareSurface& s = surface;
+
+    if (window_width != s.width || window_height != s.height)
+    {
+        if (const char* error = s.resize(window_width, window_height)) return error;
+        full = true;
+    }
+
+    // Same integer scaling and centering as Renderer::render
+    const int w = Screen::width, h = Screen::height;
+    const int scaling = min(window_width / w, window_height / h);
+    const int dx = (window_width - w * scaling) / 2;
+    const int dy = (window_height - h * scaling) / 2;
+
+    if (full)
+    {
+        memset(s.pixels, 0, (size_t)s.stride * s.height * 4); // Black borders
+        if (scaling > 0) expandRows(s.pixels, s.stride, presented.data(), w, 0, h - 1, scaling, dx, dy, lut);
+        s.show(0, 0, window_width, window_height);
+    }
+    else if (pending_top <= pending_bottom && scaling > 0)
+    {
+        expandRows(s.pixels, s.stride, presented.data(), w, pending_top, pending_bottom, scaling, dx, dy, lut);
+        s.show(dx, dy + pending_top * scaling, w * scaling, (pending_bottom - pending_top + 1) * scaling);
+    }
+
+    full = false;
+    pending_top = 0x7FFFFFFF;
+    pending_bottom = -1;
+    return nullptr;
+}
+
+void SoftwarePresenter::setColors(const float fg[3], const float bg[3])
+{
+    auto pack = [](const float* c) {
+        return 0xFF000000u | (uint32_t)(c[0] * 255 + 0.5f) << 16 | (uint32_t)(c[1] * 255 + 0.5f) << 8 | (uint32_t)(c[2] * 255 + 0.5f);
+    };
+    const uint32_t on = pack(fg), off = pack(bg);
+
+    for (int b = 0; b < 256; b++)
+        for (int k = 0; k < 8; k++)
+            lut[b][k] = (b >> k) & 1 ? on : off;
+    full = true;
+}
+
+void SoftwarePresenter::cleanup()
+{
+    surface.close();
+}
+
+void SoftwarePresenter::expandRows(uint32_t* dst, int dst_stride, const unsigned char* pixels, int w, int y1, int y2,
+    int scale, int dx, int dy, const uint32_t (*lut)[8])
+{
+    const int stride = w / 8;
+    for (int y = y1; y <= y2; y++)
+    {
+        uint32_t* row = dst + (size_t)(dy + y * scale) * dst_stride + dx;
+        CanvasKernels::expand(row, pixels + y * stride, stride, scale, lut);
+        for (int r = 1; r < scale; r++) memcpy(row + (size_t)r * dst_stride, row, (size_t)w * scale * 4);
+    }
+}
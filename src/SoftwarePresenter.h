@@ -0,0 +1,38 @@
+#ifndef SOFTWARE_PRESENTER_H
+#define SOFTWARE_PRESENTER_H
+
+#include "SoftwareSurface.h"
+
+#include <cstdint>
+#include <vector>
+
+// CPU presentation path, for machines without OpenGL 4.3 and for profiling presentation on the CPU.
+// The 1bpp Canvas is expanded to 32-bit pixels at the window's integer scale (centered, as in Renderer::render)
+// straight into a SoftwareSurface. Only Canvas rows that changed are expanded and sent.
+class SoftwarePresenter
+{
+public:
+    SoftwarePresenter();
+
+    // init and present return an error message, or nullptr on success
+    const char* init(GLFWwindow* window); // The window must have no client API (GLFW_NO_API)
+    bool update(); // Takes the Canvas rows that changed since the last update; returns false if none did
+    const char* present(int window_width, int window_height);
+    void invalidate() { full = true; } // Repaint the whole window on the next present (e.g. after an expose)
+    void setColors(const float fg[3], const float bg[3]); // RGB, 0-1
+    void cleanup();
+
+    // Expands canvas rows y1..y2 of a w-pixel wide canvas into dst (dst_stride pixels per row) at the given
+    // integer scale, with the canvas origin at dx, dy
+    static void expandRows(uint32_t* dst, int dst_stride, const unsigned char* pixels, int w, int y1, int y2,
+        int scale, int dx, int dy, const uint32_t (*lut)[8]);
+
+private:
+    SoftwareSurface surface;
+    std::vector<unsigned char> presented; // Canvas contents as last taken by update
+    uint32_t lut[256][8]; // Canvas byte -> its 8 pixels
+    int pending_top, pending_bottom; // Canvas rows taken but not yet presented
+    bool full;
+};
+
+#endif
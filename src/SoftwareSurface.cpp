@@ -0,0 +1,254 @@
+#include "SoftwareSurface.h"
+
+#include <cstdlib>
+
+#define GLFW_INCLUDE_NONE
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define GLFW_EXPOSE_NATIVE_WIN32
+#elif defined(__linux__)
+#define GLFW_EXPOSE_NATIVE_X11
+#endif
+#include <glfw/glfw3.h>
+#include <glfw/glfw3native.h>
+
+#if defined(__linux__)
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#endif
+
+#if defined(_WIN32)
+
+struct SoftwareSurface::Native
+{
+    HWND hwnd = 0;
+    HDC dc = 0; // Memory DC holding the DIB section
+    HBITMAP bitmap = 0;
+    HGDIOBJ old_bitmap = 0;
+};
+
+const char* SoftwareSurface::open(GLFWwindow* window)
+{
+    native = std::make_unique<Native>();
+    native->hwnd = glfwGetWin32Window(window);
+    native->dc = CreateCompatibleDC(nullptr);
+    if (native->hwnd && native->dc) return nullptr;
+
+    close();
+    return "Failed to create a device context for the software presenter";
+}
+
+void SoftwareSurface::destroyImage()
+{
+    if (native->bitmap)
+    {
+        SelectObject(native->dc, native->old_bitmap);
+        DeleteObject(native->bitmap);
+        native->bitmap = 0;
+    }
+    pixels = nullptr;
+    width = height = stride = 0;
+}
+
+const char* SoftwareSurface::resize(int w, int h)
+{
+    destroyImage();
+
+    BITMAPINFO info = {};
+    info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    info.bmiHeader.biWidth = w;
+    info.bmiHeader.biHeight = -h; // Top-down
+    info.bmiHeader.biPlanes = 1;
+    info.bmiHeader.biBitCount = 32;
+    info.bmiHeader.biCompression = BI_RGB;
+
+    void* bits = nullptr;
+    native->bitmap = CreateDIBSection(native->dc, &info, DIB_RGB_COLORS, &bits, nullptr, 0);
+    if (!native->bitmap) return "Failed to create a DIB section for the software presenter";
+    native->old_bitmap = SelectObject(native->dc, native->bitmap);
+
+    pixels = (uint32_t*)bits;
+    width = w;
+    height = h;
+    stride = w;
+    return nullptr;
+}
+
+void SoftwareSurface::show(int x, int y, int w, int h)
+{
+    HDC dc = GetDC(native->hwnd);
+    BitBlt(dc, x, y, w, h, native->dc, x, y, SRCCOPY);
+    ReleaseDC(native->hwnd, dc);
+    GdiFlush(); // GDI must be done with the DIB before it is written again
+}
+
+void SoftwareSurface::close()
+{
+    if (!native) return;
+    destroyImage();
+    if (native->dc) DeleteDC(native->dc);
+    native.reset();
+}
+
+#elif defined(__linux__)
+
+struct SoftwareSurface::Native
+{
+    Display* display = nullptr;
+    ::Window window = 0;
+    Visual* visual = nullptr;
+    int depth = 0;
+    GC gc = 0;
+    XImage* image = nullptr;
+    XShmSegmentInfo shm = {};
+    bool shared = false; // False when the server can't attach the segment (e.g. a remote display)
+};
+
+static bool x_error = false;
+
+static int trapError(Display*, XErrorEvent*)
+{
+    x_error = true;
+    return 0;
+}
+
+const char* SoftwareSurface::open(GLFWwindow* window)
+{
+    native = std::make_unique<Native>();
+    Native& n = *native;
+    n.display = glfwGetX11Display();
+    n.window = glfwGetX11Window(window);
+    if (!n.display || !n.window)
+    {
+        close();
+        return "The software presenter needs an X11 window";
+    }
+
+    XWindowAttributes attrs;
+    XGetWindowAttributes(n.display, n.window, &attrs);
+    n.visual = attrs.visual;
+    n.depth = attrs.depth;
+    if (n.visual->red_mask != 0xFF0000 || n.visual->green_mask != 0xFF00 || n.visual->blue_mask != 0xFF)
+    {
+        close();
+        return "The software presenter needs a 24-bit TrueColor X11 visual";
+    }
+
+    n.gc = XCreateGC(n.display, n.window, 0, nullptr);
+    return nullptr;
+}
+
+void SoftwareSurface::destroyImage()
+{
+    Native& n = *native;
+    if (n.image && n.shared)
+    {
+        XShmDetach(n.display, &n.shm);
+        XSync(n.display, False);
+        n.image->data = nullptr; // Not ours to free
+        XDestroyImage(n.image);
+        shmdt(n.shm.shmaddr);
+    }
+    else if (n.image) XDestroyImage(n.image); // Frees the pixels too
+
+    n.image = nullptr;
+    n.shared = false;
+    pixels = nullptr;
+    width = height = stride = 0;
+}
+
+// The segment is marked for removal as soon as it is attached, so it can't outlive the process
+static bool createSharedImage(SoftwareSurface::Native& n, int w, int h)
+{
+    if (!XShmQueryExtension(n.display)) return false;
+
+    n.image = XShmCreateImage(n.display, n.visual, n.depth, ZPixmap, nullptr, &n.shm, w, h);
+    if (!n.image) return false;
+
+    n.shm.shmid = shmget(IPC_PRIVATE, (size_t)n.image->bytes_per_line * h, IPC_CREAT | 0600);
+    if (n.shm.shmid >= 0)
+    {
+        n.shm.shmaddr = n.image->data = (char*)shmat(n.shm.shmid, nullptr, 0);
+        n.shm.readOnly = False;
+        if (n.shm.shmaddr != (char*)-1)
+        {
+            x_error = false;
+            XErrorHandler previous = XSetErrorHandler(trapError);
+            XShmAttach(n.display, &n.shm);
+            XSync(n.display, False);
+            XSetErrorHandler(previous);
+            n.shared = !x_error;
+            if (!n.shared) shmdt(n.shm.shmaddr);
+        }
+        shmctl(n.shm.shmid, IPC_RMID, nullptr);
+    }
+
+    if (n.shared) return true;
+    n.image->data = nullptr;
+    XDestroyImage(n.image);
+    n.image = nullptr;
+    return false;
+}
+
+const char* SoftwareSurface::resize(int w, int h)
+{
+    destroyImage();
+    Native& n = *native;
+
+    if (!createSharedImage(n, w, h))
+    {
+        char* data = (char*)malloc((size_t)w * h * 4);
+        if (!data) return "Out of memory for the software presenter image";
+        n.image = XCreateImage(n.display, n.visual, n.depth, ZPixmap, 0, data, w, h, 32, 0);
+        if (!n.image)
+        {
+            free(data);
+            return "Failed to create an X11 image for the software presenter";
+        }
+    }
+    if (n.image->bits_per_pixel != 32)
+    {
+        destroyImage();
+        return "The software presenter needs 32-bit X11 pixels";
+    }
+
+    pixels = (uint32_t*)n.image->data;
+    width = w;
+    height = h;
+    stride = n.image->bytes_per_line / 4;
+    return nullptr;
+}
+
+void SoftwareSurface::show(int x, int y, int w, int h)
+{
+    Native& n = *native;
+    if (n.shared) XShmPutImage(n.display, n.window, n.gc, n.image, x, y, x, y, w, h, False);
+    else XPutImage(n.display, n.window, n.gc, n.image, x, y, x, y, w, h);
+    XSync(n.display, False); // The server has read the image once this returns
+}
+
+void SoftwareSurface::close()
+{
+    if (!native) return;
+    destroyImage();
+    if (native->gc) XFreeGC(native->display, native->gc);
+    native.reset();
+}
+
+#else
+
+struct SoftwareSurface::Native {};
+
+const char* SoftwareSurface::open(GLFWwindow*) { return "The software presenter is not available on this platform"; }
+const char* SoftwareSurface::resize(int, int) { return "The software presenter is not available on this platform"; }
+void SoftwareSurface::show(int, int, int, int) {}
+void SoftwareSurface::destroyImage() {}
+void SoftwareSurface::close() { native.reset(); }
+
+#endif
+
+SoftwareSurface::SoftwareSurface() {}
+SoftwareSurface::~SoftwareSurface() { close(); }
@@ -0,0 +1,39 @@
+#ifndef SOFTWARE_SURFACE_H
+#define SOFTWARE_SURFACE_H
+
+#include <cstdint>
+#include <memory>
+
+struct GLFWwindow;
+
+// A 32-bit image that is shown in a GLFW window without a client API (GLFW_NO_API), with no copy on
+// our side: an X11 MIT-SHM image on Linux (plain XPutImage if the server can't share memory), a DIB
+// section on Windows. The platform headers stay in SoftwareSurface.cpp, since X11 names (Screen,
+// Window...) clash with the engine's.
+class SoftwareSurface
+{
+public:
+    uint32_t* pixels = nullptr; // Top-down rows of 0x00RRGGBB
+    int width = 0, height = 0;
+    int stride = 0; // Pixels per row
+
+    struct Native; // Platform handles
+
+    SoftwareSurface();
+    ~SoftwareSurface();
+
+    // These return an error message, or nullptr on success
+    const char* open(GLFWwindow* window);
+    const char* resize(int width, int height); // Contents are undefined afterwards
+
+    void show(int x, int y, int w, int h); // Copies a rectangle to the window; pixels may be written again on return
+    void close();
+    bool isOpen() const { return native != nullptr; }
+
+private:
+    std::unique_ptr<Native> native;
+
+    void destroyImage();
+};
+
+#endif
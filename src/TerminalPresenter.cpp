@@ -0,0 +1,587 @@
+#include "TerminalPresenter.h"
+#include "App.h"
+#include "Headless.h"
+#include "keyboard.h"
+#include "misc.h"
+#include "Renderer.h"
+#include "Screen.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <csignal>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+using Glyphs = TerminalPresenter::Glyphs;
+
+static bool on = false; // --terminal given
+static bool active = false; // Between init and restore
+static Glyphs glyphs = Glyphs::Braille;
+
+static int cols = 0, rows = 0; // Terminal size in cells
+static int grid_w = 0, grid_h = 0, grid_x = 0, grid_y = 0; // Cells showing the Canvas, and where
+static int factor = 1; // Canvas pixels per dot, each way
+static std::vector<unsigned char> cells; // Codes as last written (braille dot bits, or 1 top | 2 bottom)
+static std::vector<unsigned char> next_cells;
+static std::vector<unsigned char> shown; // Canvas as of the last present
+static unsigned char colors[6]; // Foreground and background RGB as last written
+static int cur_row = -1, cur_col = -1; // Cursor position (-1 when unknown)
+static std::string out; // The frame's output
+
+// ============================================================================
+// Platform I/O
+// ============================================================================
+
+#if defined(_WIN32)
+
+static HANDLE in_handle = INVALID_HANDLE_VALUE, out_handle = INVALID_HANDLE_VALUE;
+static DWORD in_mode = 0, out_mode = 0;
+static UINT out_cp = 0;
+static bool down[GLFW_KEY_LAST + 1]; // Keys held, to tell repeats from presses
+
+static bool openTerminal()
+{
+    // Release builds are GUI programs, so borrow the console they were started from (or make one)
+    if (!GetConsoleWindow() && !AttachConsole(ATTACH_PARENT_PROCESS)) AllocConsole();
+
+    in_handle = CreateFileA("CONIN$", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+    out_handle = CreateFileA("CONOUT$", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+    if (in_handle == INVALID_HANDLE_VALUE || out_handle == INVALID_HANDLE_VALUE) return false;
+
+    GetConsoleMode(in_handle, &in_mode);
+    GetConsoleMode(out_handle, &out_mode);
+    out_cp = GetConsoleOutputCP();
+    SetConsoleMode(in_handle, ENABLE_WINDOW_INPUT); // No line editing, echo or Ctrl+C handling
+    SetConsoleMode(out_handle, ENABLE_PROCESSED_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING | DISABLE_NEWLINE_AUTO_RETURN);
+    SetConsoleOutputCP(CP_UTF8);
+    return true;
+}
+
+static void closeTerminal()
+{
+    SetConsoleMode(in_handle, in_mode);
+    SetConsoleMode(out_handle, out_mode);
+    SetConsoleOutputCP(out_cp);
+    CloseHandle(in_handle);
+    CloseHandle(out_handle);
+    in_handle = out_handle = INVALID_HANDLE_VALUE;
+}
+
+static void writeAll(const char* data, size_t size)
+{
+    DWORD written = 0;
+    while (size && WriteFile(out_handle, data, (DWORD)size, &written, nullptr) && written)
+    {
+        data += written;
+        size -= written;
+    }
+}
+
+static bool terminalSize(int& c, int& r)
+{
+    CONSOLE_SCREEN_BUFFER_INFO info;
+    if (!GetConsoleScreenBufferInfo(out_handle, &info)) return false;
+    c = info.srWindow.Right - info.srWindow.Left + 1;
+    r = info.srWindow.Bottom - info.srWindow.Top + 1;
+    return true;
+}
+
+static int glfwKey(WORD vk)
+{
+    if ((vk >= 'A' && vk <= 'Z') || (vk >= '0' && vk <= '9') || vk == VK_SPACE) return vk; // Same codes
+    if (vk >= VK_F1 && vk <= VK_F12) return GLFW_KEY_F1 + (vk - VK_F1);
+    switch (vk)
+    {
+    case VK_ESCAPE: return GLFW_KEY_ESCAPE;
+    case VK_RETURN: return GLFW_KEY_ENTER;
+    case VK_TAB: return GLFW_KEY_TAB;
+    case VK_BACK: return GLFW_KEY_BACKSPACE;
+    case VK_INSERT: return GLFW_KEY_INSERT;
+    case VK_DELETE: return GLFW_KEY_DELETE;
+    case VK_RIGHT: return GLFW_KEY_RIGHT;
+    case VK_LEFT: return GLFW_KEY_LEFT;
+    case VK_DOWN: return GLFW_KEY_DOWN;
+    case VK_UP: return GLFW_KEY_UP;
+    case VK_PRIOR: return GLFW_KEY_PAGE_UP;
+    case VK_NEXT: return GLFW_KEY_PAGE_DOWN;
+    case VK_HOME: return GLFW_KEY_HOME;
+    case VK_END: return GLFW_KEY_END;
+    case VK_SHIFT: return GLFW_KEY_LEFT_SHIFT;
+    case VK_CONTROL: return GLFW_KEY_LEFT_CONTROL;
+    case VK_MENU: return GLFW_KEY_LEFT_ALT;
+    case VK_OEM_MINUS: return GLFW_KEY_MINUS;
+    case VK_OEM_PLUS: return GLFW_KEY_EQUAL;
+    case VK_OEM_COMMA: return GLFW_KEY_COMMA;
+    case VK_OEM_PERIOD: return GLFW_KEY_PERIOD;
+    case VK_OEM_1: return GLFW_KEY_SEMICOLON;
+    case VK_OEM_2: return GLFW_KEY_SLASH;
+    case VK_OEM_3: return GLFW_KEY_GRAVE_ACCENT;
+    case VK_OEM_4: return GLFW_KEY_LEFT_BRACKET;
+    case VK_OEM_5: return GLFW_KEY_BACKSLASH;
+    case VK_OEM_6: return GLFW_KEY_RIGHT_BRACKET;
+    case VK_OEM_7: return GLFW_KEY_APOSTROPHE;
+    default: return GLFW_KEY_UNKNOWN;
+    }
+}
+
+// The console reports real key releases, so keys are passed on as they happen
+void TerminalPresenter::pollInput()
+{
+    if (!active) return;
+
+    DWORD count = 0;
+    INPUT_RECORD records[64];
+    while (GetNumberOfConsoleInputEvents(in_handle, &count) && count &&
+        ReadConsoleInputW(in_handle, records, 64, &count))
+    {
+        for (DWORD i = 0; i < count; i++)
+        {
+            if (records[i].EventType != KEY_EVENT) continue;
+            const KEY_EVENT_RECORD& e = records[i].Event.KeyEvent;
+
+            const DWORD state = e.dwControlKeyState;
+            int mods = 0;
+            if (state & SHIFT_PRESSED) mods |= GLFW_MOD_SHIFT;
+            if (state & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED)) mods |= GLFW_MOD_CONTROL;
+            if (state & (LEFT_ALT_PRESSED | RIGHT_ALT_PRESSED)) mods |= GLFW_MOD_ALT;
+
+            const int key = glfwKey(e.wVirtualKeyCode);
+            if (key != GLFW_KEY_UNKNOWN)
+            {
+                const int action = !e.bKeyDown ? GLFW_RELEASE : down[key] ? GLFW_REPEAT : GLFW_PRESS;
+                down[key] = e.bKeyDown;
+                key_callback(nullptr, key, e.wVirtualScanCode, action, mods);
+            }
+            if (e.bKeyDown && e.uChar.UnicodeChar >= 32 && !(mods & GLFW_MOD_CONTROL))
+                char_callback(nullptr, e.uChar.UnicodeChar);
+        }
+    }
+}
+
+#else
+
+static termios saved_termios;
+static bool raw_input = false; // stdin is a terminal in raw mode
+
+static void restoreOnSignal(int sig)
+{
+    TerminalPresenter::restore();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static bool openTerminal()
+{
+    if (isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &saved_termios) == 0)
+    {
+        // Keys arrive one by one, unechoed and without blocking; Ctrl+C still interrupts
+        termios raw = saved_termios;
+        raw.c_iflag &= ~(ICRNL | IXON);
+        raw.c_lflag &= ~(ICANON | ECHO | IEXTEN);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        raw_input = tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0;
+    }
+
+    signal(SIGINT, restoreOnSignal);
+    signal(SIGTERM, restoreOnSignal);
+    signal(SIGHUP, restoreOnSignal);
+    return true;
+}
+
+static void closeTerminal()
+{
+    if (raw_input) tcsetattr(STDIN_FILENO, TCSANOW, &saved_termios);
+    raw_input = false;
+}
+
+static void writeAll(const char* data, size_t size)
+{
+    while (size)
+    {
+        ssize_t n = write(STDOUT_FILENO, data, size);
+        if (n <= 0) return;
+        data += n;
+        size -= (size_t)n;
+    }
+}
+
+static bool terminalSize(int& c, int& r)
+{
+    winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0 || !ws.ws_col || !ws.ws_row) return false;
+    c = ws.ws_col;
+    r = ws.ws_row;
+    return true;
+}
+
+// A terminal only sends key presses, so each key is pressed and released at once
+static void sendKey(int key, int mods, unsigned int c = 0)
+{
+    key_callback(nullptr, key, 0, GLFW_PRESS, mods);
+    if (c) char_callback(nullptr, c);
+    key_callback(nullptr, key, 0, GLFW_RELEASE, mods);
+}
+
+// Final byte of an escape sequence (with its numeric parameter) to a key
+static int sequenceKey(char final, int param)
+{
+    switch (final)
+    {
+    case 'A': return GLFW_KEY_UP;
+    case 'B': return GLFW_KEY_DOWN;
+    case 'C': return GLFW_KEY_RIGHT;
+    case 'D': return GLFW_KEY_LEFT;
+    case 'H': return GLFW_KEY_HOME;
+    case 'F': return GLFW_KEY_END;
+    case 'P': case 'Q': case 'R': case 'S': return GLFW_KEY_F1 + (final - 'P');
+    case '~': break;
+    default: return GLFW_KEY_UNKNOWN;
+    }
+    switch (param)
+    {
+    case 1: case 7: return GLFW_KEY_HOME;
+    case 4: case 8: return GLFW_KEY_END;
+    case 2: return GLFW_KEY_INSERT;
+    case 3: return GLFW_KEY_DELETE;
+    case 5: return GLFW_KEY_PAGE_UP;
+    case 6: return GLFW_KEY_PAGE_DOWN;
+    case 11: case 12: case 13: case 14: case 15: return GLFW_KEY_F1 + (param - 11);
+    case 17: case 18: case 19: case 20: case 21: return GLFW_KEY_F6 + (param - 17);
+    case 23: case 24: return GLFW_KEY_F11 + (param - 23);
+    default: return GLFW_KEY_UNKNOWN;
+    }
+}
+
+// Printable characters that have a key of their own (unshifted, as GLFW names keys)
+static int charKey(unsigned int c, int& mods)
+{
+    if (c >= 'a' && c <= 'z') return GLFW_KEY_A + (c - 'a');
+    if (c >= 'A' && c <= 'Z') { mods |= GLFW_MOD_SHIFT; return GLFW_KEY_A + (c - 'A'); }
+    if ((c >= '0' && c <= '9') || (c && strchr(" ',-./;=[\\]`", (int)c))) return (int)c;
+    return GLFW_KEY_UNKNOWN;
+}
+
+void TerminalPresenter::pollInput()
+{
+    if (!active || !raw_input) return;
+
+    unsigned char buf[256];
+    ssize_t n;
+    while ((n = read(STDIN_FILENO, buf, sizeof(buf))) > 0)
+    {
+        for (ssize_t i = 0; i < n; i++)
+        {
+            unsigned int c = buf[i];
+            int mods = 0;
+
+            if (c == 0x1B && i + 1 < n && (buf[i + 1] == '[' || buf[i + 1] == 'O'))
+            {
+                // CSI or SS3 sequence: ESC [ params final, where the second param (if any) encodes modifiers
+                int params[2] = { 0, 0 }, count = 0;
+                i += 2;
+                while (i < n && ((buf[i] >= '0' && buf[i] <= '9') || buf[i] == ';'))
+                {
+                    if (buf[i] == ';') count = min(count + 1, 1);
+                    else params[count] = params[count] * 10 + (buf[i] - '0');
+                    i++;
+                }
+                if (i >= n) break;
+                if (params[1] > 1)
+                {
+                    const int m = params[1] - 1;
+                    mods = (m & 1 ? GLFW_MOD_SHIFT : 0) | (m & 2 ? GLFW_MOD_ALT : 0) | (m & 4 ? GLFW_MOD_CONTROL : 0);
+                }
+                int key = sequenceKey((char)buf[i], params[0]);
+                if (key != GLFW_KEY_UNKNOWN) sendKey(key, mods);
+                continue;
+            }
+            if (c == 0x1B && i + 1 < n) // Alt+key
+            {
+                mods |= GLFW_MOD_ALT;
+                c = buf[++i];
+            }
+
+            if (c == 0x1B) sendKey(GLFW_KEY_ESCAPE, mods);
+            else if (c == '\r' || c == '\n') sendKey(GLFW_KEY_ENTER, mods);
+            else if (c == '\t') sendKey(GLFW_KEY_TAB, mods);
+            else if (c == 0x7F || c == 0x08) sendKey(GLFW_KEY_BACKSPACE, mods);
+            else if (c >= 1 && c <= 26) sendKey(GLFW_KEY_A + (c - 1), mods | GLFW_MOD_CONTROL);
+            else if (c >= 0x20)
+            {
+                // UTF-8 sequences become one character
+                int extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+                if (extra) c &= 0x3F >> extra;
+                for (; extra && i + 1 < n; extra--) c = (c << 6) | (buf[++i] & 0x3F);
+
+                int key = charKey(c, mods);
+                if (key != GLFW_KEY_UNKNOWN) sendKey(key, mods, c);
+                else char_callback(nullptr, c);
+            }
+        }
+    }
+}
+
+#endif
+
+// ============================================================================
+// Output
+// ============================================================================
+
+static void appendNumber(std::string& s, int n)
+{
+    char buf[12];
+    s.append(buf, (size_t)snprintf(buf, sizeof(buf), "%d", n));
+}
+
+static int glyphBytes(unsigned char code)
+{
+    return code ? 3 : 1;
+}
+
+static void appendGlyph(unsigned char code)
+{
+    if (!code)
+    {
+        out += ' ';
+        return;
+    }
+    if (glyphs == Glyphs::Braille)
+    {
+        // U+2800 + dot bits
+        out += '\xE2';
+        out += (char)(0xA0 | (code >> 6));
+        out += (char)(0x80 | (code & 0x3F));
+        return;
+    }
+    static const char* const blocks[4] = { " ", "\xE2\x96\x80", "\xE2\x96\x84", "\xE2\x96\x88" }; // None, upper, lower, full
+    out += blocks[code];
+}
+
+// Moves the cursor to row, col of the grid, by whichever is shortest: rewriting the unchanged
+// cells in between, moving forward, or moving to an absolute position
+static void moveTo(int row, int col)
+{
+    const int r = grid_y + row, c = grid_x + col;
+    if (cur_row == r && cur_col == c) return;
+
+    if (cur_row == r && cur_col >= grid_x && cur_col < c)
+    {
+        const int gap = c - cur_col;
+        const unsigned char* between = &cells[(size_t)row * grid_w + (cur_col - grid_x)];
+        int rewrite = 0;
+        for (int i = 0; i < gap && rewrite <= 6; i++) rewrite += glyphBytes(between[i]);
+
+        const int forward = gap == 1 ? 3 : gap < 10 ? 4 : gap < 100 ? 5 : 6;
+        if (rewrite <= forward)
+        {
+            for (int i = 0; i < gap; i++) appendGlyph(between[i]);
+        }
+        else
+        {
+            out += "\x1B[";
+            if (gap > 1) appendNumber(out, gap);
+            out += 'C';
+        }
+    }
+    else
+    {
+        out += "\x1B[";
+        appendNumber(out, r + 1);
+        if (c)
+        {
+            out += ';';
+            appendNumber(out, c + 1);
+        }
+        out += 'H';
+    }
+    cur_row = r;
+    cur_col = c;
+}
+
+// Sizes the grid for the terminal, then clears it in the Canvas colours
+static void layout(int term_cols, int term_rows)
+{
+    cols = term_cols;
+    rows = term_rows;
+
+    const int cw = glyphs == Glyphs::Braille ? 2 : 1, ch = glyphs == Glyphs::Braille ? 4 : 2;
+    const int w = Screen::canvas_width, h = Screen::canvas_height;
+    for (factor = 1;; factor++)
+    {
+        grid_w = (w + cw * factor - 1) / (cw * factor);
+        grid_h = (h + ch * factor - 1) / (ch * factor);
+        if (!cols || (grid_w <= cols && grid_h <= rows)) break; // Unknown size: show it all
+    }
+    grid_x = cols ? (cols - grid_w) / 2 : 0;
+    grid_y = cols ? (rows - grid_h) / 2 : 0;
+
+    for (int c = 0; c < 3; c++)
+    {
+        colors[c] = (unsigned char)(renderer.fgColor()[c] * 255 + 0.5f);
+        colors[3 + c] = (unsigned char)(renderer.bgColor()[c] * 255 + 0.5f);
+    }
+    out += "\x1B[38;2";
+    for (int c = 0; c < 6; c++)
+    {
+        if (c == 3) out += ";48;2";
+        out += ';';
+        appendNumber(out, colors[c]);
+    }
+    out += "m\x1B[2J";
+
+    cells.assign((size_t)grid_w * grid_h, 0); // Cleared to blanks
+    shown.clear();
+    cur_row = cur_col = -1;
+}
+
+// Dot dx, dy of cell cx, cy: on if any Canvas pixel it covers is on
+static inline bool dot(const unsigned char* pixels, int stride, int w, int h, int x, int y)
+{
+    if (factor == 1) return x < w && y < h && (pixels[y * stride + (x >> 3)] >> (x & 7)) & 1;
+
+    const int x1 = x * factor, y1 = y * factor, x2 = min(x1 + factor, w), y2 = min(y1 + factor, h);
+    for (int py = y1; py < y2; py++)
+        for (int px = x1; px < x2; px++)
+            if ((pixels[py * stride + (px >> 3)] >> (px & 7)) & 1) return true;
+    return false;
+}
+
+void TerminalPresenter::present()
+{
+    if (!active || Screen::offscreen) return;
+
+    int c = 0, r = 0;
+    terminalSize(c, r);
+    bool recolor = false;
+    for (int i = 0; i < 3; i++)
+    {
+        recolor |= colors[i] != (unsigned char)(renderer.fgColor()[i] * 255 + 0.5f);
+        recolor |= colors[3 + i] != (unsigned char)(renderer.bgColor()[i] * 255 + 0.5f);
+    }
+    if (c != cols || r != rows || recolor || cells.empty()) layout(c, r);
+
+    const unsigned char* pixels = Screen::pixels;
+    const int w = Screen::canvas_width, h = Screen::canvas_height, stride = w / 8;
+    const size_t size = (size_t)stride * h;
+    if (shown.size() == size && !memcmp(shown.data(), pixels, size))
+    {
+        if (!out.empty()) writeAll(out.data(), out.size());
+        out.clear();
+        return;
+    }
+    shown.assign(pixels, pixels + size);
+
+    // Braille dots are numbered down the left column, then the right, then the bottom row
+    static const unsigned char braille_bits[4][2] = { { 0x01, 0x08 }, { 0x02, 0x10 }, { 0x04, 0x20 }, { 0x40, 0x80 } };
+    const int dot_w = (w + factor - 1) / factor, dot_h = (h + factor - 1) / factor;
+    next_cells.resize(cells.size());
+    for (int cy = 0; cy < grid_h; cy++)
+    {
+        for (int cx = 0; cx < grid_w; cx++)
+        {
+            unsigned char code = 0;
+            if (glyphs == Glyphs::Braille)
+            {
+                for (int dy = 0; dy < 4; dy++)
+                    for (int dx = 0; dx < 2; dx++)
+                        if (cx * 2 + dx < dot_w && cy * 4 + dy < dot_h && dot(pixels, stride, w, h, cx * 2 + dx, cy * 4 + dy))
+                            code |= braille_bits[dy][dx];
+            }
+            else
+            {
+                if (cy * 2 < dot_h && dot(pixels, stride, w, h, cx, cy * 2)) code |= 1;
+                if (cy * 2 + 1 < dot_h && dot(pixels, stride, w, h, cx, cy * 2 + 1)) code |= 2;
+            }
+            next_cells[(size_t)cy * grid_w + cx] = code;
+        }
+    }
+
+    for (int cy = 0; cy < grid_h; cy++)
+    {
+        for (int cx = 0; cx < grid_w; cx++)
+        {
+            const size_t i = (size_t)cy * grid_w + cx;
+            if (next_cells[i] == cells[i]) continue;
+
+            moveTo(cy, cx);
+            appendGlyph(next_cells[i]);
+            cells[i] = next_cells[i];
+            if (++cur_col >= cols && cols) cur_col = -1; // Pending wrap at the right edge
+        }
+    }
+
+    if (!out.empty()) writeAll(out.data(), out.size());
+    out.clear();
+}
+
+// ============================================================================
+// Setup
+// ============================================================================
+
+// Engine output would scroll the frames, so it goes to the console screen (F12) only
+class NullStreambuf : public std::streambuf
+{
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+static NullStreambuf null_streambuf;
+static std::streambuf* saved_cout = nullptr;
+
+bool TerminalPresenter::parseOption(const std::string& arg)
+{
+    size_t eq = arg.find('=');
+    if (arg.substr(0, eq) != "--terminal") return false;
+
+    const std::string value = eq == std::string::npos ? "braille" : arg.substr(eq + 1);
+    if (value == "braille") glyphs = Glyphs::Braille;
+    else if (value == "half") glyphs = Glyphs::HalfBlock;
+    else throw std::runtime_error("Invalid value for --terminal: '" + value + "' (expected braille or half)");
+
+    on = true;
+    Headless::options.enabled = true;
+    Headless::options.real_clock = true;
+    Headless::options.paced = true;
+    return true;
+}
+
+bool TerminalPresenter::enabled()
+{
+    return on;
+}
+
+void TerminalPresenter::init()
+{
+    if (!on || active) return;
+    if (!openTerminal()) APP_FATAL << "Failed to open the terminal";
+    active = true;
+
+    saved_cout = std::cout.rdbuf(&null_streambuf);
+
+    out += "\x1B[?1049h\x1B[?25l"; // Alternate screen, hidden cursor
+    cells.clear();
+}
+
+void TerminalPresenter::restore()
+{
+    if (!active) return;
+    active = false;
+
+    const char reset[] = "\x1B[0m\x1B[?25h\x1B[?1049l";
+    writeAll(reset, sizeof(reset) - 1);
+    closeTerminal();
+
+    if (std::cout.rdbuf() == &null_streambuf) std::cout.rdbuf(saved_cout);
+}
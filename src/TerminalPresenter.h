@@ -0,0 +1,25 @@
+#ifndef TERMINAL_PRESENTER_H
+#define TERMINAL_PRESENTER_H
+
+#include <string>
+
+// Presents the Canvas in a text terminal, e.g. to watch an app over SSH. It runs on the headless backend
+// (--terminal implies --headless, with the real clock paced to --fps):
+//   --terminal[=braille|half]   2x4 pixels per cell as braille patterns (default), or 1x2 as half blocks
+// The Canvas is shrunk by a whole factor if it doesn't fit (a dot is on if any of its pixels is) and centered.
+// Each frame writes only the cells that changed, using the shortest cursor moves, in a single write.
+// Keys typed in the terminal go through key_callback and char_callback like window input.
+namespace TerminalPresenter
+{
+    enum class Glyphs { Braille, HalfBlock };
+
+    bool parseOption(const std::string& arg); // Applies arg if it is --terminal (throws on bad values)
+    bool enabled();
+
+    void init(); // Switches the terminal to raw input and an alternate screen
+    void present(); // Writes the cells that changed since the last frame
+    void pollInput(); // Sends pending keys to key_callback and char_callback
+    void restore(); // Puts the terminal back as it was (safe to call more than once, or when not enabled)
+}
+
+#endif
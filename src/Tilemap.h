@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// A grid of tile numbers drawn in one call by Screen::tilemap
+// All tiles share one size (width a multiple of 8) and are stored back to back as packed 1bpp images
+struct Tilemap
+{
+    int cols = 0, rows = 0; // Map size in cells
+    int tile_width = 0, tile_height = 0; // Tile size in pixels
+    int tile_count = 0;
+    std::vector<unsigned char> tiles; // tile_count images of tile_height rows of tile_width / 8 bytes
+    std::vector<uint16_t> cells; // Row-major; 0 is an empty cell, n is tile n - 1 (numbers past tile_count are empty too)
+
+    int tileBytes() const { return tile_width / 8 * tile_height; }
+};
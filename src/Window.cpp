@@ -1,7 +1,9 @@
 #include "App.h"
+#include "FrameScheduler.h"
 #include "keyboard.h"
 #include "LuaHost.h"
 #include "misc.h"
+#include "Renderer.h"
 #include "Screen.h"
 #include "Window.h"
 
@@ -18,27 +20,55 @@ static void window_close_callback(GLFWwindow* glfw_window)
     }
 }
 
+// The window contents must be repainted (without a GL framebuffer they are ours to keep, and an idle loop
+// presents nothing until told to)
+static void window_refresh_callback(GLFWwindow*)
+{
+    renderer.invalidate();
+    Screen::render_frames = 3;
+}
+
 Window::Window(const char* title)
-    : width(640), height(360), isFullscreen(false), monitor(0)
+    : width(640), height(360), window(0), title(title), isFullscreen(false), monitor(0)
+{
+}
+
+void Window::init()
 {
     cout("Starting application...");
 
     if (!glfwInit()) app.fatal("Failed to initialize GLFW");
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
     glfwWindowHint(GLFW_VISIBLE, GL_FALSE); // Delay showing the window until it's ready
 
-    window = glfwCreateWindow(width, height, title, NULL, NULL); // Initial window creation
-    if (!window) app.fatal("Failed to create GLFW window");
+    if (!Renderer::software)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        window = glfwCreateWindow(width, height, title, NULL, NULL); // Initial window creation
+        if (!window)
+        {
+            cout(" OpenGL 4.3 unavailable, presenting on the CPU");
+            Renderer::software = true;
+        }
+    }
 
-    glfwMakeContextCurrent(window); // Now we have a context and can initialize GLAD
+    if (Renderer::software)
+    {
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        window = glfwCreateWindow(width, height, title, NULL, NULL);
+    }
+    if (!window) app.fatal("Failed to create GLFW window");
 
     cout(" Window [created]");
 
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) app.fatal("Failed to initialize GLAD");
+    if (!Renderer::software)
+    {
+        glfwMakeContextCurrent(window); // Now we have a context and can initialize GLAD
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) app.fatal("Failed to initialize GLAD");
+    }
 
     glfwSetWindowUserPointer(window, this);
     //glfwSetWindowSizeCallback(window, window_size_callback); // Available if needed
@@ -56,7 +86,7 @@ Window::Window(const char* title)
     int desktopWidth = mode->width;
     int desktopHeight = mode->height;
     refresh_rate_at_startup = mode->refreshRate;
-    glfwSwapInterval(1); // Enable vsync for windowed mode
+    if (!Renderer::software) glfwSwapInterval(1); // Enable vsync for windowed mode
 
     if (desktopWidth * 9 >= desktopHeight * 16)
     {
@@ -113,51 +143,68 @@ Window::Window(const char* title)
     glfwSetCharCallback(window, char_callback); // Mainly for text input scenarios
 
     glfwSetWindowCloseCallback(window, window_close_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
 
     setBackgroundColor(0.0f, 0.0f, 0.0f);
 }
 
 void Window::cleanup()
 {
+    if (!window) return;
     glfwDestroyWindow(window);
     cout(" Window [ok]");
 }
 
 void Window::setBackgroundColor(float r, float g, float b)
 {
-    glClearColor(r, g, b, 1.0f);
+    if (!Renderer::software) glClearColor(r, g, b, 1.0f);
 }
 
 void Window::setTitle(const char* title)
 {
-    if (title)
+    if (title && window)
         glfwSetWindowTitle(window, title);
 }
 
 void Window::pollEvents()
 {
-    glfwPollEvents();
+    if (window) glfwPollEvents();
+}
+
+void Window::waitEvents(double timeout)
+{
+    if (window) glfwWaitEventsTimeout(timeout);
 }
 
 void Window::swapBuffers()
 {
-    glfwSwapBuffers(window);
+    if (!window) return;
+
+    if (Renderer::pipelined) renderer.submit();
+    else if (!Renderer::software) glfwSwapBuffers(window);
+
+    // With no vsync to wait on, software presentation keeps to the refresh rate
+    double fps = FrameScheduler::settings.frame_limit;
+    if (fps <= 0.0 && Renderer::software) fps = refresh_rate_at_startup;
+    if (fps > 0.0) FrameScheduler::limit(fps);
+
     app.metrics.buffer_swaps++;
 }
 
 bool Window::shouldClose()
 {
-    return glfwWindowShouldClose(window);
+    return window && glfwWindowShouldClose(window);
 }
 
 void Window::show(Screen* screen)
 {
     if (screen) screen->setActive();
-    glfwShowWindow(window);
+    if (window) glfwShowWindow(window);
 }
 
 bool Window::toggleFullscreen()
 {
+    if (!window) return false;
     isFullscreen = !isFullscreen;
 
     if (isFullscreen)
@@ -173,7 +220,7 @@ bool Window::toggleFullscreen()
         glfwSetWindowMonitor(window, NULL, windowed_layout.x, windowed_layout.y, windowed_layout.w, windowed_layout.h, 0);
     }
 
-    glfwSwapInterval(1); // Ensure vsync
+    renderer.enableVsync(); // Ensure vsync
     return isFullscreen;
 }
 
@@ -195,7 +242,7 @@ void Window::framebuffer_size_callback(GLFWwindow* window, int width, int height
     {
         win->width = width;
         win->height = height;
-        glViewport(0, 0, width, height);
+        if (!Renderer::software && !Renderer::pipelined) glViewport(0, 0, width, height); // (The presenting thread sets its own)
         Screen::render_frames = 3;
     }
 }
\ No newline at end of file
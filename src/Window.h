@@ -12,16 +12,18 @@ class Window
 public:
     int width;
     int height;
-    GLFWwindow* window;
+    GLFWwindow* window; // Null until init (and in headless mode)
 
     int refresh_rate_at_startup;
 
     Window(const char* title);
 
+    void init(); // Creates the window and GL context and sets up the Canvas (not called in headless mode)
     void cleanup();
     void setBackgroundColor(float r, float g, float b);
     void setTitle(const char* title);
     void pollEvents();
+    void waitEvents(double timeout); // Blocks until an event arrives or timeout seconds pass
     void swapBuffers();
     bool shouldClose();
     void show(Screen* screen = 0);
@@ -30,6 +32,7 @@ public:
     void setFullscreen(bool fullscreen);
 
 private:
+    const char* title;
     bool isFullscreen;
     GLFWmonitor* monitor;
 
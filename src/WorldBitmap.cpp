@@ -0,0 +1,78 @@
+#include "WorldBitmap.h"
+#include "Image.h"
+#include "misc.h"
+#include "Screen.h"
+
+#include <cstdint>
+#include <cstring>
+
+WorldBitmap::WorldBitmap(int width, int height) : w(width), h(height)
+{
+    tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+    tiles.resize((size_t)tiles_x * tiles_y);
+}
+
+// Calls visit(tx, ty, wx, wy, cw, ch) for the part wx, wy, cw x ch of each tile inside both the world and the region
+template <typename Visit>
+static void forTiles(int world_w, int world_h, int x, int y, int rw, int rh, Visit visit)
+{
+    const long long x1 = max((long long)x, 0LL), x2 = min((long long)x + rw, (long long)world_w);
+    const long long y1 = max((long long)y, 0LL), y2 = min((long long)y + rh, (long long)world_h);
+    if (x1 >= x2 || y1 >= y2) return;
+
+    const int S = WorldBitmap::TILE_SIZE;
+    for (int ty = (int)(y1 / S); ty <= (int)((y2 - 1) / S); ty++)
+    {
+        const int wy = max((int)y1, ty * S), ch = min((int)y2, ty * S + S) - wy;
+        for (int tx = (int)(x1 / S); tx <= (int)((x2 - 1) / S); tx++)
+        {
+            const int wx = max((int)x1, tx * S), cw = min((int)x2, tx * S + S) - wx;
+            visit(tx, ty, wx, wy, cw, ch);
+        }
+    }
+}
+
+void WorldBitmap::read(int x, int y, int rw, int rh, unsigned char* dst) const
+{
+    const int stride = rw / 8;
+    memset(dst, 0, (size_t)stride * rh);
+
+    forTiles(w, h, x, y, rw, rh, [&](int tx, int ty, int wx, int wy, int cw, int ch)
+    {
+        if (const unsigned char* t = tile(tx, ty))
+            blitUnsafe(dst, stride, wx - x, wy - y, t, TILE_STRIDE, wx - tx * TILE_SIZE, wy - ty * TILE_SIZE, cw, ch,
+                CanvasKernels::Op::Copy);
+    });
+}
+
+void WorldBitmap::write(int x, int y, int rw, int rh, const unsigned char* src)
+{
+    const int stride = rw / 8;
+    const Image region = { rw, rh, src };
+
+    forTiles(w, h, x, y, rw, rh, [&](int tx, int ty, int wx, int wy, int cw, int ch)
+    {
+        std::unique_ptr<unsigned char[]>& t = tiles[(size_t)ty * tiles_x + tx];
+        const bool blank = bitmapCount(&region, wx - x, wy - y, cw, ch) == 0;
+        if (!t)
+        {
+            if (blank) return; // Stays unallocated
+            t = std::make_unique<unsigned char[]>(TILE_BYTES); // Zeroed
+            allocated++;
+        }
+
+        blitUnsafe(t.get(), TILE_STRIDE, wx - tx * TILE_SIZE, wy - ty * TILE_SIZE, src, stride, wx - x, wy - y, cw, ch,
+            CanvasKernels::Op::Copy);
+
+        // Erasing may have left the tile blank
+        if (blank)
+        {
+            const uint64_t* words = (const uint64_t*)t.get();
+            for (int i = 0; i < TILE_BYTES / 8; i++)
+                if (words[i]) return;
+            t.reset();
+            allocated--;
+        }
+    });
+}
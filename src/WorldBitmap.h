@@ -0,0 +1,35 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+// A packed 1bpp bitmap much larger than the canvas, stored as fixed-size tiles that are allocated when a
+// set pixel is first written to them and freed again when they become blank, so mostly empty worlds stay
+// small. Primitives draw into a region through read / write (see lime.graphics.drawWorld); Screen::blitWorld
+// copies a camera viewport to the canvas.
+class WorldBitmap
+{
+public:
+    static constexpr int TILE_SIZE = 128; // Tiles are TILE_SIZE x TILE_SIZE pixels
+    static constexpr int TILE_STRIDE = TILE_SIZE / 8;
+    static constexpr int TILE_BYTES = TILE_STRIDE * TILE_SIZE;
+    static constexpr int MAX_SIZE = 65536; // Per side
+
+    WorldBitmap(int width, int height);
+
+    int width() const { return w; }
+    int height() const { return h; }
+    int tilesX() const { return tiles_x; }
+    int tilesY() const { return tiles_y; }
+    int allocatedTiles() const { return allocated; }
+
+    const unsigned char* tile(int tx, int ty) const { return tiles[(size_t)ty * tiles_x + tx].get(); } // nullptr while blank
+
+    void read(int x, int y, int rw, int rh, unsigned char* dst) const; // Copy a region to dst (stride rw / 8); pixels outside the world are off
+    void write(int x, int y, int rw, int rh, const unsigned char* src); // Store src (stride rw / 8) into a region; pixels outside the world are dropped
+
+private:
+    int w, h, tiles_x, tiles_y;
+    int allocated = 0;
+    std::vector<std::unique_ptr<unsigned char[]>> tiles;
+};
@@ -0,0 +1,170 @@
+-- MAINSCRIPT
+-- Primitive benchmark for Lime2D
+-- Times drawing primitives on the full canvas and reports the average cost per call.
+-- Results are shown on screen and printed to the console (F12).
+-- Headless runs need --real-clock: the default virtual clock does not advance while a frame is drawn.
+
+local lg = lime.graphics
+local lt = lime.time
+
+local W, H = lg.WIDTH, lg.HEIGHT
+
+-- 16x16 checkerboard sprite and a round mask for the blit cases
+local sprite, mask = {}, {}
+for y = 0, 15 do
+    local row = (y % 2 == 0) and 0x55 or 0xAA
+    local r = (y < 8) and (y + 1) or (16 - y)
+    local m = 0
+    for x = 8 - r, 7 + r do m = bit.bor(m, bit.lshift(1, x)) end
+    sprite[#sprite + 1], sprite[#sprite + 2] = row, row
+    mask[#mask + 1], mask[#mask + 2] = bit.band(m, 0xFF), bit.rshift(m, 8)
+end
+lg.defineImage("bench_sprite", 16, 16, sprite)
+lg.defineImage("bench_mask", 16, 16, mask)
+lg.newCanvas("bench_layer", W, H)
+
+-- Packed copy of a drawn title screen, and a delta against it
+lg.setTarget("bench_layer")
+lg.ron(10, 10, W - 20, 60)
+for i = 0, 19 do lg.con(15 + i * 15, 100 + (i % 5) * 15, 10 + i % 3, i % 2 == 0) end
+lg.center("LIME2D BENCHMARK", 9)
+lg.resetTarget()
+lg.definePackedImage("bench_title", lg.packImage("bench_layer"))
+lg.newCanvas("bench_frame", W, H)
+lg.setTarget("bench_frame")
+lg.blit("bench_layer", 0, 0)
+lg.con(W / 2, H / 2, 40)
+lg.resetTarget()
+lg.definePackedImage("bench_delta", lg.packImage("bench_frame", "bench_layer"))
+
+-- 16k x 16k world with a few screens of content
+lg.newWorld("bench_world", 16384, 16384)
+for i = 0, 3 do
+    lg.drawWorld("bench_world", 5000 + i * W, 7000, W, H, function() lg.blit("bench_layer", 0, 0) end)
+end
+
+-- Canvas-sized map of glyph tiles for the tilemap cases
+lg.newTilemap("bench_map", W / 8, H / 16, { 176, 177, 178, 219 })
+for r = 0, H / 16 - 1 do
+    for c = 0, W / 8 - 1 do lg.setTile("bench_map", c, r, (r + c) % 5) end
+end
+
+local star = { 160, 10, 220, 220, 20, 90, 300, 90, 100, 220 }
+
+local fill_on = false -- The fill case alternates so every call repaints the whole canvas
+
+-- 100-point zigzag wireframe for the polyline cases
+local zigzag = {}
+for i = 0, 99 do
+    zigzag[#zigzag + 1] = 10 + math.floor(i * (W - 20) / 99)
+    zigzag[#zigzag + 1] = (i % 2 == 0) and 20 or (H - 20)
+end
+
+local snap_base = nil -- Kept so the snapshot case shares its unchanged tiles
+
+-- A frame's worth of mixed shapes for the deferred drawing cases
+local function shapes()
+    for i = 0, 49 do
+        local x, y = (i * 37) % W, (i * 23) % H
+        lg.con(x - 16, y - 16, 32)
+        lg.ron(x, y, 40, 24, i % 2 == 0)
+        lg.lon(x, y, W - x, H - y, 3)
+        lg.ton(x, y, x + 30, y + 5, x + 10, y + 28)
+    end
+end
+
+-- { label, iterations, function }
+local cases = {
+    { "ron full canvas",          500, function() lg.ron(0, 0, W, H) end },
+    { "roff full canvas",         500, function() lg.roff(0, 0, W, H) end },
+    { "ron HUD bar (unaligned)", 20000, function() lg.ron(3, 5, W - 7, 20) end },
+    { "ron panel dithered",       2000, function() lg.setPattern(24); lg.ron(3, 5, W - 7, H - 11); lg.setPattern() end },
+    { "ron panel solid",          2000, function() lg.ron(3, 5, W - 7, H - 11) end },
+    { "ron outline",             20000, function() lg.ron(3, 5, W - 7, H - 11, false) end },
+    { "lon horizontal",          20000, function() lg.lon(1, 100, W - 2, 100) end },
+    { "lon vertical",            20000, function() lg.lon(100, 1, 100, H - 2) end },
+    { "lon shallow (run-slice)", 20000, function() lg.lon(1, 90, W - 2, 110) end },
+    { "lon w=5 round caps",      20000, function() lg.lon(20, 30, W - 20, H - 30, 5, "round") end },
+    { "lsetsc zigzag x100",       2000, function() lg.lsetsc(zigzag) end },
+    { "lsetsc zigzag x100 w=3",   2000, function() lg.lsetsc(zigzag, true, 3, "miter") end },
+    { "textBox style 3",          2000, function() lg.textBox(1, 1, lg.ROWS - 2, lg.COLS - 2, 3) end },
+    { "con filled (d=32)",       20000, function() lg.con(101, 50, 32) end },
+    { "con outline (d=32)",      20000, function() lg.con(101, 50, 32, false) end },
+    { "eon filled (300x200)",     2000, function() lg.eon(13, 7, 300, 200) end },
+    { "eon outline (300x200)",    2000, function() lg.eon(13, 7, 300, 200, false) end },
+    { "ton filled (large)",      20000, function() lg.ton(10, 10, W - 20, 40, 120, H - 10) end },
+    { "polyon star (nonzero)",   20000, function() lg.polyon(star, true, "nonzero") end },
+    { "fset full canvas",          500, function() fill_on = not fill_on; lg.fset(W / 2, H / 2, fill_on) end },
+    { "lon clipped (long)",      20000, function() lg.lon(-10000, -300, W + 10000, H + 300) end },
+    { "con clipped (d=4000)",     2000, function() lg.con(-2000, -2000, 4000) end },
+    { "blit 16x16 (aligned)",    20000, function() lg.blit("bench_sprite", 16, 16) end },
+    { "blit 16x16 (shifted, xor)", 20000, function() lg.blit("bench_sprite", 19, 21, "xor") end },
+    { "blit 16x16 (masked)",     20000, function() lg.blit("bench_sprite", 19, 21, "copy", "bench_mask") end },
+    { "blit canvas full screen",  2000, function() lg.blit("bench_layer", 0, 0) end },
+    { "blit canvas (or, x=3)",    2000, function() lg.blit("bench_layer", 3, 0, "or") end },
+    { "transformImage (cached)", 20000, function() lg.transformImage("bench_sprite", "rot90") end },
+    { "blit 16x16 rot90 (cached)", 20000, function() lg.blit(lg.transformImage("bench_sprite", "rot90"), 19, 21) end },
+    { "transformImage canvas rot90", 200, function() lg.setTarget("bench_layer"); lg.resetTarget(); lg.transformImage("bench_layer", "rot90") end },
+    { "scroll full canvas dy=1",  2000, function() lg.scroll(0, 1) end },
+    { "scroll full canvas dx=3",  2000, function() lg.scroll(3, 0) end },
+    { "blitRect in place (x=5)",  2000, function() lg.blitRect(0, 0, W - 8, H - 8, 5, 3) end },
+    { "blitPacked title (aligned)", 2000, function() lg.blitPacked("bench_title", 0, 0) end },
+    { "blitPacked title (x=3)",   2000, function() lg.blitPacked("bench_title", 3, 0) end },
+    { "blitPacked delta frame",   2000, function() lg.blitPacked("bench_delta", 0, 0) end },
+    { "blitWorld camera (aligned)", 2000, function() lg.blitWorld("bench_world", 5000 + W / 2, 7000) end },
+    { "blitWorld camera (x+3)",   2000, function() lg.blitWorld("bench_world", 5003 + W / 2, 7003) end },
+    { "snapshot (one tile changed)", 2000, function() snap_base = snap_base or lg.snapshot(); lg.pon(W / 2, H / 2); lg.discardSnapshot(lg.snapshot()) end },
+    { "snapshot + restore",       2000, function() local id = lg.snapshot(); lg.ron(0, 0, 40, 40); lg.restoreSnapshot(id); lg.discardSnapshot(id) end },
+    { "drawTilemap full (aligned)", 2000, function() lg.drawTilemap("bench_map", 0, 0) end },
+    { "drawTilemap (scrolled 3,5)", 2000, function() lg.drawTilemap("bench_map", 0, 0, 3, 5) end },
+    { "overlap 16x16 vs 16x16",  20000, function() lg.overlap("bench_sprite", 19, 21, "bench_mask", 27, 30) end },
+    { "overlapCanvas 16x16",     20000, function() lg.overlapCanvas("bench_sprite", 19, 21) end },
+    { "countPixels full canvas",  2000, function() lg.countPixels(0, 0, W, H) end },
+    { "raycast across canvas",   20000, function() lg.raycast(0, 0, W - 1, H - 1) end },
+    { "200 shapes (immediate)",    200, shapes },
+    { "200 shapes (deferred)",     200, function() lg.setDeferred(true); shapes(); lg.setDeferred(false) end },
+}
+
+local results = nil
+local clock_note = nil -- Set when the clock did not move during the run
+
+local function run()
+    results = {}
+    local start = lt.sinceStart()
+    for _, c in ipairs(cases) do
+        local label, n, fn = c[1], c[2], c[3]
+        lg.clear()
+        local t0 = lt.sinceStart()
+        for _ = 1, n do fn() end
+        local us = (lt.sinceStart() - t0) * 1e6 / n
+        results[#results + 1] = string.format("%-28s %10.2f us/call", label, us)
+        print(results[#results])
+    end
+    -- Headless runs use a virtual clock that only advances between frames, so every case reads 0
+    clock_note = nil
+    if lt.sinceStart() == start then
+        clock_note = "Headless timings are not meaningful (run with --real-clock)"
+        print(clock_note)
+    end
+end
+
+function lime.draw()
+    if not results then run() end
+
+    lg.clear()
+    lg.center(string.format("Lime2D benchmark (%dx%d)", W, H), 1)
+    for i, line in ipairs(results) do
+        lg.locate(2 + i, 4)
+        lg.print(line)
+    end
+    if clock_note then lg.center(clock_note, lg.ROWS - 3) end
+    lg.center("Press R to run again, Esc to quit", lg.ROWS - 2)
+end
+
+function lime.keypressed(key)
+    if key == lime.keyboard.KEY_R then
+        results = nil
+    elseif key == lime.keyboard.KEY_ESCAPE then
+        lime.window.quit()
+    end
+end
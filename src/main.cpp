@@ -53,7 +53,10 @@
 
 #include "App.h"
 #include "FusedArchive.h"
+#include "Headless.h"
 #include "LuaHost.h"
+#include "Renderer.h"
+#include "TerminalPresenter.h"
 
 //#include <lua.hpp> // Not sure what this does or if it's useful
 #include <filesystem>
@@ -63,6 +66,20 @@ namespace fs = std::filesystem;
 
 static void runWithExeAndArgs(const fs::path& exePath, std::vector<fs::path> startupFiles)
 {
+    // Take out engine options (--headless etc.) before the working directory changes
+    try
+    {
+        std::erase_if(startupFiles, [](const fs::path& arg) {
+            if (arg == "--software") return Renderer::software = true;
+            if (arg == "--pipeline") return Renderer::pipelined = true;
+            return TerminalPresenter::parseOption(arg.string()) || Headless::parseOption(arg.string());
+        });
+    }
+    catch (const std::exception& e)
+    {
+        app.fatal(e.what());
+    }
+
     // Set working directory to the EXE location (as your engine expects)
     if (!exePath.empty())
     {
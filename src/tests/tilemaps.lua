@@ -0,0 +1,43 @@
+-- MAINSCRIPT
+-- Tilemap argument checks. Run headless; a failed check is a fatal error (non-zero exit):
+--   lime2d-jit.exe --headless --frames=1 tests/tilemaps.lua
+
+local lg = lime.graphics
+
+local function expectError(what, fn, ...)
+    local ok = pcall(fn, ...)
+    if ok then error(what .. ": expected an error", 2) end
+end
+
+local function expectCells(what, name, cols, rows, cells)
+    for r = 0, rows - 1 do
+        for c = 0, cols - 1 do
+            local want, got = cells[r * cols + c + 1], lg.getTile(name, c, r)
+            if got ~= want then error(string.format("%s: cell %d,%d is %d, expected %d", what, c, r, got, want), 2) end
+        end
+    end
+end
+
+-- Sizes that wrap around in 32 bits must not pass the bounds check
+lg.newTilemap("tiny", 1, 1, { 65 })
+expectError("huge width", lg.setTiles, "tiny", { 1 }, 1, 0, math.maxinteger or 2 ^ 53)
+expectError("width of INT_MAX", lg.setTiles, "tiny", { 1 }, 1, 0, 2147483647)
+expectError("width of UINT_MAX", lg.setTiles, "tiny", { 1, 1 }, 0, 0, 4294967295)
+expectError("huge row", lg.setTiles, "tiny", { 1 }, 0, 2 ^ 40, 1)
+expectError("huge col", lg.setTiles, "tiny", { 1 }, 2 ^ 40, 0, 1)
+expectCells("after bad sizes", "tiny", 1, 1, { 0 })
+
+-- A bad entry leaves the map unchanged
+lg.newTilemap("map", 4, 3, { 65, 66, 67 })
+lg.setTiles("map", { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 })
+expectError("bad entry", lg.setTiles, "map", { 2, 3, 9, 2 })
+expectError("non-number entry", lg.setTiles, "map", { 2, 3, "x" })
+expectCells("after bad entries", "map", 4, 3, { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 })
+
+-- A block that fits is stored row by row
+lg.setTiles("map", { 2, 3, 0, 2, 3 }, 1, 1, 3)
+expectCells("block", "map", 4, 3, { 1, 1, 1, 1, 1, 2, 3, 0, 1, 2, 3, 1 })
+expectError("block past the bottom", lg.setTiles, "map", { 1, 1, 1, 1, 1 }, 0, 2)
+
+print("tilemaps: ok")
+lime.window.quit()